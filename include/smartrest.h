@@ -23,6 +23,8 @@
 
 #include <vector>
 #include <string>
+#include <utility>
+#include <cstdint>
 
 /**
 
@@ -32,6 +34,10 @@
  *  A SmartREST message consists of a comma-separated-values.
  *  \note The value can contain white spaces, and escaped commas, double
  *  quote, control characters, etc.
+ *
+ *  The lexer does not copy the buffer it scans, unless it is handed over as
+ *  a temporary string, see SrLexer(std::string&&). Tokens returned by scan()
+ *  are views into the buffer, hence the buffer must outlive them.
  */
 class SrLexer
 {
@@ -51,14 +57,76 @@ public:
      *  with its data type.
      */
     typedef std::pair<SrTokType, std::string> SrToken;
+
+    /**
+     *  \struct SrTokenView
+     *  \brief Zero-copy SmartREST token, an offset/length view into the
+     *  scanned buffer.
+     *
+     *  For quoted values the view excludes the enclosing double quotes, but
+     *  still contains escaped (doubled) double quotes, which are removed
+     *  only on demand by assign(). The numeric value of SR_INT and SR_FLOAT
+     *  tokens is computed while scanning.
+     */
+    struct SrTokenView
+    {
+        /**
+         *  \brief Scanned data type of the token.
+         */
+        SrTokType type;
+        /**
+         *  \brief true if the value contains escaped double quotes.
+         */
+        bool escaped;
+        /**
+         *  \brief true if num holds the value, i.e., the token is SR_FLOAT,
+         *  or SR_INT within the range of int64_t.
+         */
+        bool valid;
+        /**
+         *  \brief Offset of the value in the buffer.
+         */
+        size_t pos;
+        /**
+         *  \brief Length of the value in the buffer, including escapes.
+         */
+        size_t len;
+        /**
+         *  \brief Numeric value, i for SR_INT and d for SR_FLOAT.
+         */
+        union
+        {
+            int64_t i;
+            double d;
+        } num;
+    };
+
     /**
      *  \brief SrLexer constructor.
-     *  \param _s the string for lexical scanning.
+     *  \param _s the string for lexical scanning, referenced but not
+     *  copied, it must outlive the lexer and all tokens scanned from it.
      */
     SrLexer(const std::string& _s)
     {
         reset(_s);
     }
+    /**
+     *  \brief SrLexer constructor, taking over the temporary string \a _s.
+     *  \param _s the string for lexical scanning.
+     */
+    SrLexer(std::string &&_s)
+    {
+        reset(std::move(_s));
+    }
+    /**
+     *  \brief SrLexer constructor.
+     *  \param buf the buffer for lexical scanning, referenced but not copied.
+     *  \param len length of the buffer.
+     */
+    SrLexer(const char *buf, size_t len)
+    {
+        reset(buf, len);
+    }
     virtual ~SrLexer()
     {
     }
@@ -73,6 +141,16 @@ public:
      *  \return the next CSV value with its type information as a token.
      */
     SrToken next();
+    /**
+     *  \brief Scan the next token without copying it.
+     *
+     *  Same as next(), except the token is returned as a view into the
+     *  buffer, no memory is allocated.
+     *
+     *  \param tok assigned with the next token.
+     *  \return the type of the token.
+     */
+    SrTokType scan(SrTokenView &tok);
     /**
      *  \brief Check if the given tokens is a delimiter for a
      *  SmartREST record.
@@ -86,7 +164,14 @@ public:
      */
     bool isdelimiter(const SrToken &tok) const
     {
-        return tok.first == SR_NEWLINE || tok.first == SR_EOB;
+        return isdelimiter(tok.first);
+    }
+    /**
+     *  \brief Check if a token of type \a type is a delimiter.
+     */
+    bool isdelimiter(SrTokType type) const
+    {
+        return type == SR_NEWLINE || type == SR_EOB;
     }
     /**
      *  \brief Reset the lexer with a new string.
@@ -95,14 +180,62 @@ public:
      *  buffer to the given string. The purpose of this function is for
      *  re-using an existing lexer, instead of create a new one every time.
      *
-     *  \param _s the new string for lexing.
+     *  \param _s the new string for lexing, referenced but not copied.
      */
     void reset(const std::string &_s)
     {
-        s = _s;
+        reset(_s.data(), _s.size());
+    }
+    /**
+     *  \brief Reset the lexer with the temporary string \a _s, which is
+     *  taken over by the lexer.
+     */
+    void reset(std::string &&_s)
+    {
+        own = std::move(_s);
+        reset(NULL, own.size());
+    }
+    /**
+     *  \brief Reset the lexer with the buffer \a buf of length \a len.
+     *
+     *  \param buf the new buffer for lexing, NULL for the string owned by
+     *  the lexer.
+     *  \param len length of the buffer.
+     */
+    void reset(const char *buf, size_t len)
+    {
+        s = buf;
+        n = len;
         pre = start = end = 0;
         delimit = false;
     }
+    /**
+     *  \brief Get the buffer the lexer is scanning, token views are
+     *  relative to it.
+     */
+    const char *buffer() const
+    {
+        return s ? s : own.data();
+    }
+    /**
+     *  \brief Compute the numeric value of the SR_INT or SR_FLOAT token
+     *  \a tok, the value is stored in tok.num.
+     *
+     *  \param buf buffer the token was scanned from.
+     *  \param tok token view, tok.valid is set false for all other types
+     *  and for SR_INT values out of range.
+     */
+    static void number(const char *buf, SrTokenView &tok);
+    /**
+     *  \brief Assign the value of the token view \a tok to \a out, removing
+     *  escaping double quotes.
+     *
+     *  \param out string to assign the value to.
+     *  \param buf buffer the token was scanned from.
+     *  \param tok token view.
+     */
+    static void assign(std::string &out, const char *buf,
+            const SrTokenView &tok);
 
 public:
     /**
@@ -119,7 +252,9 @@ public:
     size_t end;
 
 private:
-    std::string s;
+    std::string own;
+    const char *s;
+    size_t n;
     bool delimit;
 };
 
@@ -129,6 +264,12 @@ private:
  *
  *  A SmartREST record is a list of CSVs (comma separated values), along with
  *  its scanned type returned from a SrLexer.
+ *
+ *  Tokens are stored as views into the buffer of the SrParser, the record
+ *  is only valid as long as this buffer. A copy of a record owns the values
+ *  it refers to, and is independent of the buffer. operator[] and value()
+ *  materialize the requested token on first access, which is not
+ *  thread-safe.
  */
 class SrRecord
 {
@@ -136,30 +277,55 @@ public:
     /**
      *  \brief SrRecord constructor.
      */
-    SrRecord()
+    SrRecord() : buf(NULL)
+    {
+    }
+    /**
+     *  \brief SrRecord copy constructor, the copy owns its values.
+     */
+    SrRecord(const SrRecord &r) : buf(NULL)
     {
+        *this = r;
     }
+    SrRecord(SrRecord &&r) = default;
     virtual ~SrRecord()
     {
     }
 
+    SrRecord &operator=(const SrRecord &r);
+    SrRecord &operator=(SrRecord &&r) = default;
+
     /**
-     *  \brief Append a token to the record.
-     *  \param tok token to be appended.
+     *  \brief Clear the record for tokens scanned from \a _buf.
+     *
+     *  Allocated capacity is kept, hence a record re-used for many
+     *  messages does not allocate memory in the steady state.
+     */
+    void reset(const char *_buf)
+    {
+        buf = _buf;
+        own.clear();
+        data.clear();
+        cache.clear();
+    }
+    /**
+     *  \brief Append a token view, relative to the buffer set by reset().
      */
-    void push_back(SrLexer::SrToken &tok)
+    void push_back(const SrLexer::SrTokenView &tok)
     {
         data.push_back(tok);
     }
+    /**
+     *  \brief Append a token to the record.
+     *  \param tok token to be appended.
+     */
+    void push_back(SrLexer::SrToken &tok);
     /**
      *  \brief Get the i-th token from the record.
      *  \param i index, cause undefined behavior if i is out of range.
      *  \return the token at position i.
      */
-    const SrLexer::SrToken &operator[](size_t i) const
-    {
-        return data[i];
-    }
+    const SrLexer::SrToken &operator[](size_t i) const;
     /**
      *  \brief Get the value of i-th token.
      *  \param i index, cause undefined behavior if i is out of range.
@@ -167,7 +333,7 @@ public:
      */
     const std::string &value(size_t i) const
     {
-        return data[i].second;
+        return (*this)[i].second;
     }
     /**
      *  \brief Get the type of i-th token.
@@ -176,7 +342,7 @@ public:
      */
     SrLexer::SrTokType type(size_t i) const
     {
-        return data[i].first;
+        return data[i].type;
     }
     /**
      *  \brief Get the type of i-th token at an integer.
@@ -190,7 +356,90 @@ public:
      */
     int typeInt(size_t i) const
     {
-        return data[i].first;
+        return data[i].type;
+    }
+    /**
+     *  \brief Get the i-th value as an integer.
+     *
+     *  The value is computed by the lexer, no conversion takes place.
+     *
+     *  \param i index, cause undefined behavior if i is out of range.
+     *  \param v assigned with the value on success, untouched otherwise.
+     *  \return 0 on success, -1 if the token is not SR_INT, -2 if the
+     *  value is out of the range of int64_t.
+     */
+    int asInt(size_t i, int64_t &v) const
+    {
+        const SrLexer::SrTokenView &t = data[i];
+        if (t.type != SrLexer::SR_INT)
+        {
+            return -1;
+        } else if (!t.valid)
+        {
+            return -2;
+        }
+
+        v = t.num.i;
+        return 0;
+    }
+    /**
+     *  \brief Get the i-th value as an unsigned 32-bit integer, e.g., a
+     *  message ID.
+     *
+     *  \param i index, cause undefined behavior if i is out of range.
+     *  \param v assigned with the value on success, untouched otherwise.
+     *  \return 0 on success, -1 if the token is not SR_INT, -2 if the
+     *  value is negative or out of the range of uint32_t.
+     */
+    int asU32(size_t i, uint32_t &v) const
+    {
+        int64_t x = 0;
+        const int c = asInt(i, x);
+        if (c)
+        {
+            return c;
+        } else if (x < 0 || x > UINT32_MAX)
+        {
+            return -2;
+        }
+
+        v = x;
+        return 0;
+    }
+    /**
+     *  \brief Get the i-th value as a double.
+     *
+     *  \param i index, cause undefined behavior if i is out of range.
+     *  \param v assigned with the value on success, untouched otherwise.
+     *  \return 0 on success, -1 if the token is neither SR_INT nor
+     *  SR_FLOAT.
+     */
+    int asDouble(size_t i, double &v) const;
+    /**
+     *  \brief Get the raw value of i-th token without copying.
+     *
+     *  \param i index, cause undefined behavior if i is out of range.
+     *  \return pointer to the value, which is not null-terminated and still
+     *  contains escaped double quotes if escaped(i).
+     */
+    const char *raw(size_t i) const
+    {
+        return base() + data[i].pos;
+    }
+    /**
+     *  \brief Get the length of the raw value of i-th token.
+     */
+    size_t length(size_t i) const
+    {
+        return data[i].len;
+    }
+    /**
+     *  \brief Check if the raw value of i-th token contains escaped
+     *  double quotes.
+     */
+    bool escaped(size_t i) const
+    {
+        return data[i].escaped;
     }
     /**
      *  \brief Return the size of the record.
@@ -202,7 +451,15 @@ public:
     }
 
 private:
-    std::vector<SrLexer::SrToken> data;
+    const char *base() const
+    {
+        return buf ? buf : own.data();
+    }
+
+    const char *buf;
+    std::string own;
+    std::vector<SrLexer::SrTokenView> data;
+    mutable std::vector<SrLexer::SrToken> cache;
 };
 
 /**
@@ -218,11 +475,24 @@ class SrParser
 public:
     /**
      *  \brief SrParser constructor. A container for a list of SrRecord.
-     *  \param _s message contains the hold request or response.
+     *  \param _s message contains the hold request or response, referenced
+     *  but not copied, it must outlive the parser and the parsed records.
      */
     SrParser(const std::string &_s) : lex(_s)
     {
     }
+    /**
+     *  \brief SrParser constructor, taking over the temporary string \a _s.
+     */
+    SrParser(std::string &&_s) : lex(std::move(_s))
+    {
+    }
+    /**
+     *  \brief SrParser constructor for the buffer \a buf of length \a len.
+     */
+    SrParser(const char *buf, size_t len) : lex(buf, len)
+    {
+    }
 
     virtual ~SrParser()
     {
@@ -240,18 +510,35 @@ public:
     SrRecord next()
     {
         SrRecord r;
-        SrLexer::SrToken t = lex.next();
+        next(r);
+
+        return r;
+    }
+    /**
+     *  \brief Parse the next SmartREST record into \a r.
+     *
+     *  Same as next(), but re-uses the memory of \a r, which makes
+     *  parsing free of memory allocations in the steady state.
+     *
+     *  \param r record to parse into.
+     *  \return size of the record, 0 at the end of the buffer.
+     */
+    size_t next(SrRecord &r)
+    {
+        SrLexer::SrTokenView t;
+        r.reset(lex.buffer());
+        lex.scan(t);
         pre = lex.pre;
         start = lex.start;
 
-        for (; !lex.isdelimiter(t); t = lex.next())
+        for (; !lex.isdelimiter(t.type); lex.scan(t))
         {
             r.push_back(t);
         }
 
         end = lex.end;
 
-        return r;
+        return r.size();
     }
 
     /**
@@ -262,6 +549,13 @@ public:
     {
         lex.reset(_s);
     }
+    /**
+     *  \brief Reset the SmartREST parser with the temporary string \a _s.
+     */
+    void reset(std::string &&_s)
+    {
+        lex.reset(std::move(_s));
+    }
 
 public:
 
@@ -22,11 +22,14 @@
 #define SRAGENT_H
 
 #include <map>
+#include <memory>
 #include "smartrest.h"
 #include "srqueue.h"
 #include "srbootstrap.h"
 #include "srintegrate.h"
 #include "srtimer.h"
+#include "srtimerqueue.h"
+#include "srexecutor.h"
 
 /**
  *  \class SrMsgHandler
@@ -60,6 +63,10 @@ typedef SrMsgHandler AbstractMsgHandler;
  *  is received. The agent contains both an ingress and egress SrQueue, which
  *  are usually connected to an SrDevicePush and SrReporter for receiving
  *  responses and reporting requests.
+ *
+ *  Active timers are kept in an SrTimerQueue ordered by fire time. The agent
+ *  sleeps on a single eventfd until the earliest fire time, or until a new
+ *  batch arrives at the ingress queue, hence an idle agent never wakes up.
  *  \note The agent does not guarantee accurate timer scheduling, which is
  *  especially true when the system is under heavy load. The only guarantee
  *  is that a timer will not be scheduled before its intended fire time.
@@ -72,6 +79,87 @@ private:
 public:
     typedef uint16_t MsgID;
     typedef uint32_t MsgXID;
+
+    /**
+     *  \brief Direct-indexed handler table by MsgID.
+     *
+     *  The 16-bit ID space is split into 256 pages of 256 handlers, a page
+     *  is only allocated when a handler in its range is registered, so a
+     *  lookup is two loads.
+     */
+    class MsgTable
+    {
+    public:
+        SrMsgHandler *find(MsgID id) const
+        {
+            SrMsgHandler ** const p = pages[id >> 8].get();
+            return p ? p[id & 0xff] : NULL;
+        }
+
+        void set(MsgID id, SrMsgHandler *h);
+
+    private:
+        std::unique_ptr<SrMsgHandler*[]> pages[256];
+    };
+
+    /**
+     *  \brief Open addressing handler table by (MsgXID, MsgID).
+     *
+     *  Linear probing in a table kept at most half full, cleared handlers
+     *  keep their slot.
+     */
+    class XMsgTable
+    {
+    public:
+        XMsgTable() :
+                n(0)
+        {
+        }
+
+        SrMsgHandler *find(MsgXID xid, MsgID id) const
+        {
+            if (slots.empty())
+            {
+                return NULL;
+            }
+
+            const uint64_t k = key(xid, id);
+            const size_t mask = slots.size() - 1;
+            for (size_t i = hash(k) & mask;; i = (i + 1) & mask)
+            {
+                if (slots[i].first == k)
+                {
+                    return slots[i].second;
+                } else if (slots[i].first == EMPTY)
+                {
+                    return NULL;
+                }
+            }
+        }
+
+        void set(MsgXID xid, MsgID id, SrMsgHandler *h);
+
+    private:
+
+        // keys are 48 bits, hence never equal to EMPTY
+        static const uint64_t EMPTY = ~(uint64_t) 0;
+
+        static uint64_t key(MsgXID xid, MsgID id)
+        {
+            return (uint64_t) xid << 16 | id;
+        }
+
+        static size_t hash(uint64_t k)
+        {
+            k *= 0x9e3779b97f4a7c15ULL;
+            return k ^ (k >> 32);
+        }
+
+        typedef std::pair<uint64_t, SrMsgHandler*> _Slot;
+        std::vector<_Slot> slots;
+        size_t n;
+    };
+
     /**
      *  \brief SrAgent constructor.
      *
@@ -164,6 +252,13 @@ public:
      *  \return 0 on success, -1 otherwise.
      */
     int send(const SrNews &news);
+    /**
+     *  \brief Move news to egress queue for reporting.
+     *
+     *  Same as send(const SrNews&), except the request is moved instead of
+     *  copied, e.g., agent.send(SrNews(std::move(s))).
+     */
+    int send(SrNews &&news);
     /**
      *  \brief Enter the agent loop.
      *
@@ -173,18 +268,54 @@ public:
      */
     void loop();
     /**
-     *  \brief Add an SrTimer timer to the agent. Non thread-safe.
+     *  \brief Add an SrTimer timer to the agent.
      *
      *  \note This function does not start the timer, you have to start
-     *  the timer first.
-     *  \note This function also does no existence check, adding the same
-     *  timer multiple times results in the timer being added multiple times.
+     *  the timer either before or after adding it.
+     *  \note Adding the same timer multiple times has no effect. A timer
+     *  removes itself from the agent when destroyed.
      *
      *  \param timer reference to an SrTimer to add to the agent.
      */
     void addTimer(SrTimer &timer)
     {
-        timers.push_back(&timer);
+        tq->add(timer);
+    }
+    /**
+     *  \brief Replace the timer scheduling backend. Non thread-safe.
+     *
+     *  The agent takes ownership of \a queue, all timers added so far are
+     *  moved to it. The default backend is an SrTimerHeap, an SrTimerWheel
+     *  scales better with thousands of frequently restarted timers.
+     *
+     *  \note Must not be called while the agent loop is running.
+     *  \param queue pointer to a heap allocated SrTimerQueue.
+     */
+    void setTimerQueue(SrTimerQueue *queue);
+    /**
+     *  \brief Run handlers on a worker pool instead of the agent thread.
+     *  Non thread-safe.
+     *
+     *  All SrMsgHandler and SrTimerHandler callbacks are submitted to
+     *  \a exec, keyed by the handler, respectively the timer. Hence, a slow
+     *  handler does not delay timers or other handlers, while each handler
+     *  still runs one call at a time, in order of arrival. The agent does
+     *  not take ownership of \a exec, which must be started, and NULL
+     *  restores running handlers on the agent thread. While \a exec is
+     *  not running, handlers run on the agent thread and an error is
+     *  logged. Latency of a single handler is reported by
+     *  SrExecutor::stats(key), with the handler or the timer as key.
+     *
+     *  \note Handlers run by an executor must be thread-safe with respect
+     *  to each other. SrAgent::send(), SrTimer::start() and SrTimer::stop()
+     *  are thread-safe.
+     *  \note Must not be called while the agent loop is running.
+     *
+     *  \param exec pointer to a started SrExecutor, or NULL.
+     */
+    void setExecutor(SrExecutor *exec)
+    {
+        this->exec = exec;
     }
     /**
      *  \brief Add a message handler to the agent. Non thread-safe.
@@ -197,7 +328,7 @@ public:
      */
     void addMsgHandler(MsgID msgid, SrMsgHandler *functor)
     {
-        handlers[msgid] = functor;
+        handlers.set(msgid, functor);
     }
     /**
      *  \brief Add a message handler to the agent. Non thread-safe.
@@ -215,7 +346,7 @@ public:
      */
     void addXMsgHandler(MsgXID msgxid, MsgID msgid, SrMsgHandler *f)
     {
-        sh[XMsgID(msgxid, msgid)] = f;
+        sh.set(msgxid, msgid, f);
     }
 
 public:
@@ -225,22 +356,22 @@ public:
     SrQueue<SrOpBatch> ingress;
     /**
      *  \brief Outgoing queue for sending SmartREST requests.
+     *
+     *  The queue is split into SR_PRIO_LANES priority lanes by srNewsLane(),
+     *  switching it to a ring backend with setRing() drops the lanes.
      */
     SrQueue<SrNews> egress;
 
 private:
     void processMessages();
+    void dispatch(SrMsgHandler *h, SrRecord &r);
+    void fire(SrTimer *t);
 
 private:
 
-    typedef std::map<MsgID, SrMsgHandler*> _Handler;
-    typedef std::pair<MsgXID, MsgID> XMsgID;
-    typedef std::map<XMsgID, SrMsgHandler*> _XHandler;
-    typedef std::vector<SrTimer*> _Timer;
-    typedef _Timer::iterator _TimerIter;
-    _Timer timers;
-    _Handler handlers;
-    _XHandler sh;
+    std::unique_ptr<SrTimerQueue> tq;
+    MsgTable handlers;
+    XMsgTable sh;
     string _tenant;
     string _username;
     string _password;
@@ -249,8 +380,11 @@ private:
     const string did;
     string xid;
     string id;
+    MsgXID mxid;
     SrBootstrap *pboot;
     SrIntegrate *pigt;
+    SrExecutor *exec;
+    int efd;
 };
 
 #endif /* SRAGENT_H */
@@ -25,6 +25,16 @@
 #include "srqueue.h"
 #include "srnethttp.h"
 #include "srlogger.h"
+#include "srstreamparser.h"
+
+/**
+ *  \brief Maximum size in bytes of an incomplete record on the long polling
+ *  connection. Larger records abort the connect request, which bounds the
+ *  memory a broken or malicious response can take.
+ */
+#ifndef SR_PUSH_RECORD_MAX
+#define SR_PUSH_RECORD_MAX (256 * 1024)
+#endif
 
 /**
  * \class SrDevicePush
@@ -39,8 +49,11 @@
  *  received bayeux advice. The class also features reliable push
  *  (message: 88,batch number) to avoid missing operations due to a
  *  broken connection.
+ *
+ *  Responses of the connect request are parsed while they arrive, every
+ *  chunk of complete operations is put into the ingress queue right away.
  */
-class SrDevicePush
+class SrDevicePush: private SrRecordHandler
 {
 public:
     /**
@@ -171,15 +184,18 @@ protected:
     int connect();
 
     /**
-     *  \brief Process the received bayeux advice and the batch
-     *  number for reliable push.
+     *  \brief Process a record of the connect response as it arrives.
      *
-     *  \note This function removes the bayeux advice and the batch number
-     *  messages from s after processing.
-     *
-     *  \param s the entire response.
+     *  The bayeux advice and the batch number for reliable push are
+     *  processed, all other records are collected for the ingress queue.
+     */
+    void operator()(SrRecord &r, const char *raw, size_t len);
+
+    /**
+     *  \brief Put the records collected from one chunk into the ingress
+     *  queue.
      */
-    void process(std::string &s);
+    void flush();
 
     /**
      *  \brief pthread routine.
@@ -199,10 +215,15 @@ private:
     };
 
     SrNetHttp http;
+    SrStreamParser stream;
+    std::string batch;
+    std::string xctx;
+    bool stale;
     pthread_t tid;
     std::string bayeuxID;
     std::string xids;
     size_t bnum;
+    size_t pnum;
     SrQueue<SrOpBatch> &queue;
     const std::string &channel;
     BayeuxState bayeuxState;
@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SRENCODER_H
+#define SRENCODER_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include "srtypes.h"
+
+/**
+ *  \struct SrStrRef
+ *  \brief Non-owning reference to a string argument of SrEncoder.
+ */
+struct SrStrRef
+{
+    SrStrRef(const std::string &s) :
+            p(s.data()), n(s.size())
+    {
+    }
+
+    SrStrRef(const char *s) :
+            p(s), n(strlen(s))
+    {
+    }
+
+    SrStrRef(const char *s, size_t n) :
+            p(s), n(n)
+    {
+    }
+
+    const char *p;
+    size_t n;
+};
+
+/**
+ *  \struct SrInt
+ *  \brief SrEncoder field for a signed integer.
+ */
+struct SrInt
+{
+    typedef int64_t type;
+
+    static size_t bound(type)
+    {
+        return 20;
+    }
+
+    static char *write(char *p, type v)
+    {
+        const uint64_t u = v < 0 ? 0 - (uint64_t) v : v;
+        *p = '-';
+
+        return digits(p + (v < 0), u);
+    }
+
+    /**
+     *  \brief Write the decimal digits of \a u at \a p.
+     *  \return one past the last digit.
+     */
+    static char *digits(char *p, uint64_t u)
+    {
+        char tmp[20];
+        char *t = tmp + sizeof(tmp);
+
+        do
+        {
+            *--t = '0' + u % 10;
+            u /= 10;
+        } while (u);
+
+        const size_t n = tmp + sizeof(tmp) - t;
+        memcpy(p, t, n);
+
+        return p + n;
+    }
+};
+
+/**
+ *  \struct SrUInt
+ *  \brief SrEncoder field for an unsigned integer.
+ */
+struct SrUInt
+{
+    typedef uint64_t type;
+
+    static size_t bound(type)
+    {
+        return 20;
+    }
+
+    static char *write(char *p, type v)
+    {
+        return SrInt::digits(p, v);
+    }
+};
+
+/**
+ *  \struct SrFloat
+ *  \brief SrEncoder field for a floating point number.
+ *
+ *  With \a P >= 0 the value is written with exactly P decimals, rounded half
+ *  away from zero. With the default P = -1 the value is written in the
+ *  shortest decimal form that parses back to the same double. Both never
+ *  use the locale and never use an exponent, which the SmartREST lexer
+ *  would classify as string. Values beyond 2^53 after scaling (or with 16
+ *  and more significant digits in the shortest form) are searched for the
+ *  shortest round trip digits via snprintf and strtod instead, and written
+ *  without exponent as well, e.g., 1e-30 takes 32 characters and 1e300
+ *  takes 301 characters. With \a P >= 0 such values get no decimals.
+ */
+template<int P = -1> struct SrFloat
+{
+    typedef double type;
+
+    static size_t bound(type v)
+    {
+        // one decimal digit per 3.3 bits of the binary exponent
+        int e = 0;
+        std::frexp(v, &e);
+
+        return std::isfinite(v) ? 32 + (e < 0 ? -e : e) * 77 / 256 : 32;
+    }
+
+    static char *write(char *p, type v)
+    {
+        if (std::isnan(v) || std::isinf(v))
+        {
+            const char* const s = std::isnan(v) ? "nan" : v < 0 ? "-inf" : "inf";
+            const size_t n = strlen(s);
+            memcpy(p, s, n);
+
+            return p + n;
+        }
+
+        const double a = std::fabs(v);
+        if (P >= 0)
+        {
+            const int d = P < 22 ? P : 22;
+            return a * pow10(d) < 9007199254740992.0 ?
+                    fixed(p, v, std::llround(a * pow10(d)), d) : slow(p, v);
+        }
+
+        for (int d = 0; d <= 22 && a * pow10(d) < 9007199254740992.0; ++d)
+        {
+            // exact test: m / 10^d is what a correctly rounding parser
+            // yields for the decimal string written below
+            const int64_t m = std::llround(a * pow10(d));
+            if (m / pow10(d) == a)
+            {
+                return fixed(p, v, m, d);
+            }
+        }
+
+        return slow(p, v);
+    }
+
+private:
+
+    static double pow10(int d)
+    {
+        static const double t[] =
+        {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        return t[d];
+    }
+
+    /**
+     *  Write m / 10^d with d decimals.
+     */
+    static char *fixed(char *p, double v, uint64_t m, int d)
+    {
+        if (std::signbit(v) && m)
+        {
+            *p++ = '-';
+        }
+
+        char tmp[24];
+        char *e = SrInt::digits(tmp, m);
+        int n = e - tmp;
+
+        // leading zeros for values below 1, e.g., 0.05
+        for (; n <= d; ++n)
+        {
+            memmove(tmp + 1, tmp, n);
+            *tmp = '0';
+        }
+
+        memcpy(p, tmp, n - d);
+        p += n - d;
+
+        if (d)
+        {
+            *p++ = '.';
+            memcpy(p, tmp + n - d, d);
+            p += d;
+        }
+
+        return p;
+    }
+
+    static char *slow(char *p, double v)
+    {
+        // shortest precision that reads back as v, at most 17 digits
+        char s[32];
+        for (int k = 0; k < 17; ++k)
+        {
+            snprintf(s, sizeof(s), "%.*e", k, v);
+            if (strtod(s, NULL) == v)
+            {
+                break;
+            }
+        }
+
+        // s is [-]d[.ddd]e[+-]x, with the decimal point of the locale
+        const char *q = s;
+        if (*q == '-')
+        {
+            *p++ = *q++;
+        }
+
+        char dig[24];
+        int n = 0;
+        for (; *q != 'e'; ++q)
+        {
+            if (*q >= '0' && *q <= '9')
+            {
+                dig[n++] = *q;
+            }
+        }
+
+        for (; n > 1 && dig[n - 1] == '0'; --n)
+        {
+            // trailing zeros of the mantissa
+        }
+
+        // number of digits before the decimal point
+        const int ip = atoi(q + 1) + 1;
+        if (ip <= 0)
+        {
+            *p++ = '0';
+            *p++ = '.';
+            memset(p, '0', -ip);
+            p += -ip;
+            memcpy(p, dig, n);
+            p += n;
+        } else if (ip >= n)
+        {
+            memcpy(p, dig, n);
+            memset(p + n, '0', ip - n);
+            p += ip;
+        } else
+        {
+            memcpy(p, dig, ip);
+            p[ip] = '.';
+            memcpy(p + ip + 1, dig + ip, n - ip);
+            p += n + 1;
+        }
+
+        return p;
+    }
+};
+
+/**
+ *  \struct SrId
+ *  \brief SrEncoder field for a string written as is, e.g., a managed
+ *  object ID, without checking for characters which require quoting.
+ */
+struct SrId
+{
+    typedef SrStrRef type;
+
+    static size_t bound(const type &s)
+    {
+        return s.n;
+    }
+
+    static char *write(char *p, const type &s)
+    {
+        memcpy(p, s.p, s.n);
+
+        return p + s.n;
+    }
+};
+
+/**
+ *  \struct SrStr
+ *  \brief SrEncoder field for an arbitrary string.
+ *
+ *  The string is enclosed in double quotes, and double quotes in it are
+ *  doubled, if it contains characters the SrLexer would not read back as
+ *  is: commas, double quotes, non-printable characters, or leading white
+ *  spaces.
+ */
+struct SrStr
+{
+    typedef SrStrRef type;
+
+    static size_t bound(const type &s)
+    {
+        return 2 * s.n + 2;
+    }
+
+    static char *write(char *p, const type &s)
+    {
+        bool quote = s.n && (s.p[0] == ' ' || s.p[0] == '"');
+        for (size_t i = 0; i < s.n && !quote; ++i)
+        {
+            const char c = s.p[i];
+            quote = c == ',' || c == '"' || c < ' ' || c >= 0x7f;
+        }
+
+        if (!quote)
+        {
+            memcpy(p, s.p, s.n);
+            return p + s.n;
+        }
+
+        *p++ = '"';
+        for (size_t i = 0; i < s.n; ++i)
+        {
+            if ((*p++ = s.p[i]) == '"')
+            {
+                *p++ = '"';
+            }
+        }
+        *p++ = '"';
+
+        return p;
+    }
+};
+
+template<typename ... F> struct _SrFields;
+
+template<> struct _SrFields<>
+{
+    static size_t bound()
+    {
+        return 0;
+    }
+
+    static char *write(char *p)
+    {
+        return p;
+    }
+};
+
+template<typename F, typename ... R> struct _SrFields<F, R...>
+{
+    static size_t bound(const typename F::type &a,
+            const typename R::type &... r)
+    {
+        return 1 + F::bound(a) + _SrFields<R...>::bound(r...);
+    }
+
+    static char *write(char *p, const typename F::type &a,
+            const typename R::type &... r)
+    {
+        *p++ = ',';
+
+        return _SrFields<R...>::write(F::write(p, a), r...);
+    }
+};
+
+/**
+ *  \class SrEncoder
+ *  \brief Compile-time encoder for SmartREST requests.
+ *
+ *  SrEncoder formats a SmartREST request with message ID \a MSG and the
+ *  fields \a F (SrInt, SrUInt, SrFloat, SrId, SrStr) directly into a
+ *  buffer, without any intermediate strings. E.g., the measurement
+ *  "103,<id>,<cpu>" of a template "NOW UNSIGNED NUMBER":
+ *
+ *      typedef SrEncoder<103, SrId, SrFloat<1>> CPU;
+ *      agent.send(CPU::news(agent.ID(), cpu));
+ *
+ *  \note No trailing newline is written, as required by SrAgent::send.
+ */
+template<unsigned MSG, typename ... F> class SrEncoder
+{
+public:
+    /**
+     *  \brief Upper bound of the length of the encoded request.
+     */
+    static size_t bound(const typename F::type &... args)
+    {
+        return 10 + _SrFields<F...>::bound(args...);
+    }
+
+    /**
+     *  \brief Encode the request into the caller-provided buffer \a buf.
+     *
+     *  \param buf the buffer.
+     *  \param size size of the buffer.
+     *  \return length of the request, 0 if size is less than bound().
+     */
+    static size_t encode(char *buf, size_t size,
+            const typename F::type &... args)
+    {
+        if (size < bound(args...))
+        {
+            return 0;
+        }
+
+        return write(buf, args...) - buf;
+    }
+
+    /**
+     *  \brief Append the request to \a out, e.g., a pooled string whose
+     *  capacity is re-used.
+     */
+    static void append(std::string &out, const typename F::type &... args)
+    {
+        const size_t b = bound(args...);
+
+        // short requests go through the stack, so the string does not
+        // grow beyond the actual length, e.g., out of its inline buffer
+        if (b <= 256)
+        {
+            char tmp[256];
+            out.append(tmp, write(tmp, args...) - tmp);
+        } else
+        {
+            const size_t n = out.size();
+            out.resize(n + b);
+            out.resize(write(&out[n], args...) - out.data());
+        }
+    }
+
+    /**
+     *  \brief Encode the request as SrNews, with one allocation at most.
+     *
+     *  \param args the field values.
+     *  \return the request with the default priority.
+     */
+    static SrNews news(const typename F::type &... args)
+    {
+        SrNews n;
+        append(n.data, args...);
+
+        return n;
+    }
+
+private:
+
+    static char *write(char *p, const typename F::type &... args)
+    {
+        return _SrFields<F...>::write(SrInt::digits(p, MSG), args...);
+    }
+};
+
+#endif /* SRENCODER_H */
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SREXECUTOR_H
+#define SREXECUTOR_H
+
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+/**
+ *  \brief Snapshot of SrExecutor statistics, times in nanoseconds.
+ */
+struct SrExecutorStats
+{
+    /** number of submitted tasks. */
+    uint64_t submitted;
+    /** number of completed tasks. */
+    uint64_t completed;
+    /** number of strands a worker took from another worker. */
+    uint64_t stolen;
+    /** number of tasks waiting to be executed. */
+    uint64_t depth;
+    /** maximum number of tasks waiting at the same time. */
+    uint64_t maxDepth;
+    /** total and maximum time between submission and execution. */
+    uint64_t waitTotal;
+    uint64_t waitMax;
+    /** total and maximum execution time. */
+    uint64_t runTotal;
+    uint64_t runMax;
+};
+
+/**
+ *  \class SrExecutor
+ *  \brief Fixed-size worker thread pool for running agent handlers.
+ *
+ *  Tasks are submitted with a key, usually the address of the handler they
+ *  run. Tasks with the same key form a strand: they run one at a time, in
+ *  submission order, hence a handler is never run concurrently with itself
+ *  and sees its messages in the order they were received. Tasks with
+ *  different keys run in parallel.
+ *
+ *  Each worker owns a deque of runnable strands. A worker takes strands
+ *  from the front of its own deque, and steals from the back of the other
+ *  workers' deques when its own is empty.
+ *
+ *  \note A handler run by the executor must be thread-safe with respect to
+ *  all other handlers, see SrAgent::setExecutor().
+ */
+class SrExecutor
+{
+public:
+    typedef std::function<void()> Task;
+
+    /**
+     *  \brief SrExecutor constructor.
+     *  \param workers number of worker threads, at least 1.
+     */
+    SrExecutor(size_t workers);
+    /**
+     *  \brief SrExecutor destructor, stops the workers, see stop().
+     */
+    virtual ~SrExecutor();
+
+    /**
+     *  \brief Start all worker threads.
+     *  \return 0 on success, an error code from pthread_create otherwise.
+     */
+    int start();
+    /**
+     *  \brief Stop and join all worker threads.
+     *
+     *  Tasks which have not yet started are not executed.
+     */
+    void stop();
+    /**
+     *  \brief Submit \a task to the strand \a key.
+     *  \return 0 on success, -1 if the executor is not started or is
+     *  stopping, \a task is not run in this case.
+     */
+    int submit(const void *key, Task &&task);
+    /**
+     *  \brief Get a snapshot of the statistics.
+     */
+    SrExecutorStats stats() const;
+    /**
+     *  \brief Get a snapshot of the statistics of the strand \a key.
+     *
+     *  SrAgent keys message handlers by the SrMsgHandler, and timer
+     *  callbacks by the SrTimer, so this gives the latency of a single
+     *  handler. stolen is not tracked per strand and always 0.
+     *
+     *  \note A strand is released as soon as it has no more tasks, only
+     *  its statistics are kept for the lifetime of the executor. Hence an
+     *  object allocated at the address of a freed one shares no ordering
+     *  with it, but continues its statistics.
+     *
+     *  \return statistics of \a key, all 0 if nothing was submitted to it.
+     */
+    SrExecutorStats stats(const void *key) const;
+
+protected:
+    /**
+     *  \brief pthread routine function.
+     *  \param arg pointer to a _Worker instance.
+     */
+    static void *func(void *arg);
+
+private:
+
+    struct _Job
+    {
+        Task task;
+        timespec t;
+    };
+
+    struct _Strand
+    {
+        const void *key;
+        std::deque<_Job> jobs;
+        SrExecutorStats *stats;
+    };
+
+    struct _Worker
+    {
+        SrExecutor *exec;
+        size_t index;
+        pthread_t tid;
+        pthread_mutex_t mutex;
+        std::deque<_Strand*> ready;
+    };
+
+    void schedule(_Strand *s, size_t worker);
+    _Strand *take(size_t worker);
+    void run(_Strand *s, size_t worker);
+
+    std::vector<std::unique_ptr<_Worker>> workers;
+    std::unordered_map<const void*, std::unique_ptr<_Strand>> strands;
+    std::unordered_map<const void*, SrExecutorStats> kstats;
+    mutable pthread_mutex_t mutex;
+    sem_t sem;
+    std::atomic<size_t> next;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> submitted;
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> stolen;
+    std::atomic<uint64_t> maxDepth;
+    std::atomic<uint64_t> waitTotal;
+    std::atomic<uint64_t> waitMax;
+    std::atomic<uint64_t> runTotal;
+    std::atomic<uint64_t> runMax;
+};
+
+#endif /* SREXECUTOR_H */
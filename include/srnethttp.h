@@ -22,8 +22,11 @@
 #define SRNETHTTP_H
 
 #include <utility>
+#include <vector>
 #include "srnetinterface.h"
 
+class SrStreamParser;
+
 /**
  *  \class SrNetHttp
  *  \brief Tailored HTTP implementation for Cumulocity SmartREST protocol.
@@ -48,9 +51,31 @@ public:
      *  events, etc.
      *
      *  \param request one or multiple SmartREST requests
-     *  \return size of response on success, -1 on failure.
+     *  \return size of response (bytes streamed if setStream is used) on
+     *  success, -1 on failure.
      */
     int post(const std::string &request);
+    /**
+     *  \brief HTTP post multiple independent requests concurrently.
+     *
+     *  All requests are in flight at the same time, each on its own
+     *  connection, which are kept for the next call. Mainly used for
+     *  replaying buffered requests, where the throughput is otherwise
+     *  bound by the round-trip time.
+     *
+     *  \note The stream set by setStream() is not used, responses are
+     *  always buffered.
+     *
+     *  \param reqs requests to post.
+     *  \param n number of requests.
+     *  \param status resized to \a n, receives the size of the response
+     *  of each request on success, -1 on failure.
+     *  \param resps resized to \a n, receives the response of each
+     *  request.
+     *  \return number of successful requests.
+     */
+    int post(const std::string *reqs, size_t n, std::vector<int> &status,
+            std::vector<std::string> &resps);
     /**
      *  \brief Cancel the current HTTP transaction.
      *
@@ -66,6 +91,18 @@ public:
     {
         meter.first = meter.second = 0;
     }
+    /**
+     *  \brief Stream responses into an SrStreamParser.
+     *
+     *  When set, the response is fed chunk by chunk into \a sp as it
+     *  arrives, instead of being accumulated into the response buffer, so
+     *  records are processed before the transfer finishes. The stream is
+     *  finished after a successful post, and reset after a failed one, its
+     *  undelivered bytes (e.g., an error text) are then kept as response.
+     *
+     *  \param sp the stream parser, NULL to buffer responses again.
+     */
+    void setStream(SrStreamParser *sp);
 
     /**
      *  \brief HTTP response status code. Undefined if post method failed.
@@ -74,8 +111,15 @@ public:
 
 private:
 
+    static size_t writeStream(void *ptr, size_t size, size_t nmemb,
+            void *data);
+
     struct curl_slist *chunk;
     std::pair<time_t, time_t> meter;
+    SrStreamParser *stream;
+    size_t rx;
+    CURLM *multi;
+    std::vector<CURL*> easy;
 };
 
 #endif /* SRNETHTTP_H */
@@ -61,6 +61,19 @@ public:
      */
     void setTimeout(long timeout);
 
+    /**
+     *  \brief Set TCP keep-alive probing for the connection.
+     *
+     *  Defaults to SR_CURL_KEEPIDLE and SR_CURL_KEEPINTVL. Probing keeps
+     *  NAT mappings on cellular links alive, so that a cached connection
+     *  is still usable when it is picked up for the next request.
+     *
+     *  \param idle seconds of idle time before the first probe, 0 to
+     *  disable keep-alive.
+     *  \param interval seconds between probes.
+     */
+    void setKeepAlive(long idle, long interval);
+
     /**
      *  \brief Enable/disable debug mode.
      *
@@ -111,6 +124,19 @@ public:
 
 protected:
 
+    /**
+     *  \brief Attach a libcurl handle to the process wide share.
+     *
+     *  Handles attached to the share reuse DNS entries and TLS sessions of
+     *  each other. Connections are not shared, as libcurl before 7.68 does
+     *  not support sharing them between threads. Needed for handles not
+     *  created by this class, e.g. by curl_easy_duphandle, which does not
+     *  inherit the share.
+     *
+     *  \param h libcurl handle.
+     */
+    static void share(CURL *h);
+
     /**
      *  \brief libcurl handle.
      */
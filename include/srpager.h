@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SRPAGER_H
+#define SRPAGER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#ifndef SR_FILEBUF_PAGE_SCALE
+#define SR_FILEBUF_PAGE_SCALE 3
+#endif
+
+#define SR_FILEBUF_PAGE_BASE 9
+#define SR_FILEBUF_PAGE_SIZE (1<<(SR_FILEBUF_PAGE_BASE+SR_FILEBUF_PAGE_SCALE))
+
+#define SR_FILEBUF_STREAM 0
+#define SR_FILEBUF_MMAP 1
+#define SR_FILEBUF_LOG 2
+
+#ifndef SR_FILEBUF_ENGINE
+#define SR_FILEBUF_ENGINE SR_FILEBUF_STREAM
+#endif
+
+#ifndef SR_FILEBUF_SYNC
+#define SR_FILEBUF_SYNC 1
+#endif
+
+#ifndef SR_FILEBUF_COMPRESS
+#define SR_FILEBUF_COMPRESS 0
+#endif
+
+#define SR_FILEBUF_ZIP 0x100 // engine flag, compress file backed batches
+
+/**
+ *  Byte range [pos, pos + len) of a buffered message in the arena, and its
+ *  priority lane as by srNewsLane().
+ */
+struct _Span
+{
+    _Span(size_t p = 0, size_t n = 0, uint8_t l = 1) :
+            pos(p), len(n), lane(l)
+    {
+    }
+
+    size_t pos, len;
+    uint8_t lane;
+};
+
+typedef std::vector<_Span> _Spans;
+
+/**
+ *  \class _Pager
+ *  \brief Request buffer of the SrReporter.
+ *
+ *  A pager stores buffered requests in batches. emplace_back() appends to
+ *  the last batch if it fits into a page, otherwise it starts a new batch.
+ *  Batches are replayed with at() and released with pop_front(). When the
+ *  capacity is exhausted, the oldest batches are discarded.
+ *
+ *  \note This is an internal interface of SrReporter, it is only exposed
+ *  for testing and benchmarking the engines.
+ */
+class _Pager
+{
+protected:
+    typedef std::string string;
+public:
+    _Pager(uint32_t _cap) :
+            cap(_cap), nevb(0), nevm(0)
+    {
+    }
+
+    virtual ~_Pager()
+    {
+    }
+
+    /**
+     *  Create a pager, memory backed if \a fn is empty, otherwise file
+     *  backed by file engine \a engine (SR_FILEBUF_STREAM, SR_FILEBUF_MMAP
+     *  or SR_FILEBUF_LOG), optionally or'ed with SR_FILEBUF_ZIP.
+     */
+    static _Pager *create(int engine, const string &fn, uint32_t cap);
+
+    size_t capacity() const
+    {
+        return cap;
+    }
+
+    virtual void setCapacity(uint32_t _cap)
+    {
+        cap = _cap;
+    }
+
+    virtual bool empty() const = 0;
+    virtual size_t bsize() const = 0;
+    virtual size_t size() const = 0;
+    void front(string &s) const
+    {
+        at(0, s);
+    }
+
+    /**
+     *  Append batch \a k to \a s, batches are popped with pop_front().
+     */
+    virtual void at(size_t k, string &s) const = 0;
+    virtual void pop_front() = 0;
+    virtual int emplace_back(const char *base, const _Spans &v) = 0;
+    virtual void clear() = 0;
+
+    /**
+     *  Let the next emplace_back() start a new batch.
+     */
+    virtual void seal()
+    {
+    }
+
+    /**
+     *  Set the dictionary for compressing batches. Dictionaries are kept
+     *  next to the buffer, so batches buffered with a previous one, also
+     *  in a previous run, are still replayed.
+     */
+    virtual void setDictionary(const string &dict)
+    {
+        (void) dict;
+    }
+
+    /**
+     *  Total bytes handed to emplace_back(), and bytes stored for them
+     *  after compression. Both are 0 without compression.
+     */
+    virtual void ratio(uint64_t &raw, uint64_t &stored) const
+    {
+        raw = stored = 0;
+    }
+
+    /**
+     *  Limit the buffer to about \a bytes, 0 for no limit. File engines
+     *  round the budget down to whole pages as capacity.
+     */
+    virtual void setBudget(size_t bytes)
+    {
+        if (bytes)
+        {
+            setCapacity(bytes / SR_FILEBUF_PAGE_SIZE ? bytes / SR_FILEBUF_PAGE_SIZE : 1);
+        }
+    }
+
+    /**
+     *  Bytes used for buffered messages, including the index.
+     */
+    virtual size_t used() const
+    {
+        return size() * SR_FILEBUF_PAGE_SIZE;
+    }
+
+    /**
+     *  Total bytes and messages evicted to stay within the capacity or
+     *  budget. File engines evict whole batches, their messages are
+     *  counted by newline, except for the stream engine and compressed
+     *  buffers, which do not count messages.
+     */
+    virtual void evicted(uint64_t &bytes, uint64_t &msgs) const
+    {
+        bytes = nevb;
+        msgs = nevm;
+    }
+
+protected:
+
+    uint32_t cap;
+    std::atomic<uint64_t> nevb, nevm;
+};
+
+#endif /* SRPAGER_H */
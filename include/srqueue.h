@@ -21,12 +21,20 @@
 #ifndef SRQUEUE_H
 #define SRQUEUE_H
 
-#include <queue>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <iterator>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include "srring.h"
 
 /**
  *  \class SrQueue
@@ -34,7 +42,24 @@
  *
  *  SrQueue is a consumer/producer queue for multi-thread communication.
  *  It uses the mutex facility from pthread to implement atomic get and
- *  put operations, and semaphore to avoid busy waiting.
+ *  put operations, and semaphore to avoid busy waiting. The semaphore
+ *  signals the queue is non-empty rather than counting elements: put()
+ *  only posts it when the queue was empty, and a consumer passes it on
+ *  when it leaves elements behind. Hence, a burst of puts costs a single
+ *  post, and drain() or takeAll() empty the queue with a single wait and
+ *  a single lock acquisition.
+ *
+ *  Alternatively, a queue can be switched to a lock-free bounded SrRing
+ *  backend (see setRing()), which suits queues with many producers and a
+ *  single consumer, e.g., the SrAgent egress queue. In this mode, put()
+ *  never takes a lock, and the semaphore is only touched when the consumer
+ *  is parked on an empty ring, or a producer is parked on a full ring.
+ *
+ *  The default backend can also be split into priority lanes (see
+ *  setLanes()), e.g., the SrAgent egress queue puts alarms ahead of bulk
+ *  measurements. Consumers then take elements from the highest priority
+ *  non-empty lane, FIFO within a lane, except that a lane skipped too
+ *  often is served once to avoid starvation.
  */
 template<typename T> class SrQueue
 {
@@ -46,6 +71,18 @@ public:
     {
         Q_OK = 0, Q_TIMEOUT, Q_BUSY, Q_EMPTY, Q_NOTIME
     };
+    /**
+     *  \brief Policy of put() when a bounded ring backend is full.
+     */
+    enum FullPolicy
+    {
+        /** put() fails with -1, the new element is discarded. */
+        Q_REJECT = 0,
+        /** the oldest element is discarded to make room. */
+        Q_OVERWRITE,
+        /** put() blocks until the consumer makes room. */
+        Q_BLOCK
+    };
     /**
      *  \brief Event wraps the element type and an error code.
      *
@@ -54,19 +91,123 @@ public:
      *  thus element T requires a default constructor.
      */
     typedef std::pair<T, ErrCode> Event;
+    /**
+     *  \brief Lane classifier, returns the lane of an element, 0 is the
+     *  highest priority.
+     */
+    typedef size_t (*Classifier)(const T&);
     SrQueue() :
-            q()
+            q(), ring(), policy(Q_REJECT), sleepers(0), blocked(0), nfd(-1),
+            classify(NULL), quota(0)
+    {
+        mutex = PTHREAD_MUTEX_INITIALIZER;
+        memset(&sem, 0, sizeof(sem));
+        memset(&space, 0, sizeof(space));
+        sem_init(&sem, 0, 0);
+        sem_init(&space, 0, 0);
+    }
+
+    /**
+     *  \brief SrQueue constructor with a lock-free bounded ring backend.
+     *
+     *  \param capacity capacity of the ring, see setRing().
+     *  \param policy behaviour of put() when the ring is full.
+     */
+    SrQueue(size_t capacity, FullPolicy policy = Q_REJECT) :
+            q(), ring(), policy(Q_REJECT), sleepers(0), blocked(0), nfd(-1),
+            classify(NULL), quota(0)
     {
         mutex = PTHREAD_MUTEX_INITIALIZER;
         memset(&sem, 0, sizeof(sem));
+        memset(&space, 0, sizeof(space));
         sem_init(&sem, 0, 0);
+        sem_init(&space, 0, 0);
+        setRing(capacity, policy);
     }
 
     virtual ~SrQueue()
     {
+        sem_destroy(&space);
         sem_destroy(&sem);
         pthread_mutex_destroy(&mutex);
     }
+
+    /**
+     *  \brief Switch the queue to a lock-free bounded ring backend.
+     *
+     *  \note This function is not thread-safe, it must be called before the
+     *  queue is shared with other threads, e.g., before starting the
+     *  SrReporter and entering SrAgent::loop().
+     *
+     *  \param capacity capacity of the ring, rounded up to the next power
+     *  of 2. 0 switches back to the default unbounded backend.
+     *  \param policy behaviour of put() when the ring is full.
+     *  \return 0 on success, -1 if the queue is not empty.
+     *
+     *  \note The ring backend has no priority lanes, see setLanes().
+     */
+    int setRing(size_t capacity, FullPolicy policy = Q_REJECT)
+    {
+        if (!empty())
+        {
+            return -1;
+        }
+
+        ring.reset(capacity ? new SrRing<T>(capacity) : NULL);
+        this->policy = policy;
+        if (ring)
+        {
+            lanes.clear();
+        }
+
+        return 0;
+    }
+    /**
+     *  \brief Split the default backend into \a n priority lanes.
+     *
+     *  put() assigns each element to lane \a f(element), larger lanes are
+     *  clamped to the last lane. get(), drain() and takeAll() serve the
+     *  highest priority non-empty lane, but a non-empty lane skipped
+     *  \a quota times is served before any higher lane.
+     *
+     *  \note This function is not thread-safe, see setRing(). It switches
+     *  a ring backend back to the default backend.
+     *
+     *  \param n number of lanes, 0 or 1 switches back to a single FIFO.
+     *  \param f lane classifier.
+     *  \param quota starvation limit for lower priority lanes.
+     *  \return 0 on success, -1 if the queue is not empty.
+     */
+    int setLanes(size_t n, Classifier f, size_t quota = 16)
+    {
+        if (!empty())
+        {
+            return -1;
+        }
+
+        ring.reset();
+        lanes.clear();
+        lanes.resize(n > 1 && f ? n : 0);
+        skips.assign(lanes.size(), 0);
+        classify = f;
+        this->quota = quota;
+
+        return 0;
+    }
+    /**
+     *  \brief Set a file descriptor, e.g., an eventfd, to signal when an
+     *  element is put into the queue.
+     *
+     *  With the default backend, the signal is only written when the queue
+     *  turns non-empty, hence the consumer must empty the queue (e.g., by
+     *  takeAll()) after each signal. -1 disables the signal.
+     *
+     *  \note This function is not thread-safe, see setRing().
+     */
+    void setNotify(int fd)
+    {
+        nfd = fd;
+    }
     /**
      *  \brief get an element from the queue.
      *
@@ -80,22 +221,20 @@ public:
      */
     Event get()
     {
+        if (ring)
+        {
+            return rget(NULL);
+        }
+
         sem_wait(&sem);
         Event e;
 
         if (pthread_mutex_lock(&mutex) == 0)
         {
-            if (q.empty())
-            {
-                e.second = Q_EMPTY;
-            } else
-            {
-                e = std::make_pair(q.front(), Q_OK);
-                q.pop();
-            }
-            pthread_mutex_unlock(&mutex);
+            pop(e);
         } else
         {
+            sem_post(&sem);
             e.second = Q_BUSY;
         }
 
@@ -114,18 +253,28 @@ public:
      */
     Event get(int millisec)
     {
-        timeval tv = { 0, 0 };
-        gettimeofday(&tv, NULL);
-        timeval delta = { millisec / 1000, (millisec % 1000) * 1000 };
-        timeval res;
-        timeradd(&tv, &delta, &res);
-        const timespec tp = {   res.tv_sec, res.tv_usec * 1000};
         Event e;
 
+        if (ring && ring->pop(e.first))
+        {
+            notifySpace();
+            e.second = Q_OK;
+
+            return e;
+        }
+
+        timespec tp;
+        deadline(millisec, &tp);
+
+        if (ring)
+        {
+            return millisec ? rget(&tp) : Event(T(), Q_TIMEOUT);
+        }
+
         // Testing for q.empty() is because for some version of
         // sem_timedwait could timeout and return with -1 while
         // sem_getvalue() is actual non-0.
-        if ((sem_timedwait(&sem, &tp) == -1) && q.empty())
+        if ((sem_timedwait(&sem, &tp) == -1) && isEmpty())
         {
             e.second = Q_TIMEOUT;
             return e;
@@ -133,21 +282,133 @@ public:
 
         if (pthread_mutex_trylock(&mutex) == 0)
         {
-            if (q.empty())
+            pop(e);
+        } else
+        {
+            sem_post(&sem);
+            e.second = Q_BUSY;
+        }
+
+        return e;
+    }
+
+    /**
+     *  \brief Move up to \a max elements out of the queue.
+     *
+     *  Waits at most \a millisec milliseconds for the queue to become
+     *  non-empty, then moves all available elements, but not more than
+     *  \a max, into the output iterator \a out, in FIFO order, under a
+     *  single lock acquisition.
+     *
+     *  \param out output iterator, e.g., std::back_inserter(deque).
+     *  \param max maximum number of elements to take.
+     *  \param millisec wait time in milliseconds, 0 for no waiting, negative
+     *  value for waiting forever.
+     *  \return number of elements taken, 0 on timeout.
+     */
+    template<typename OutputIt>
+    size_t drain(OutputIt out, size_t max, int millisec)
+    {
+        size_t n = 0;
+        timespec tp;
+
+        if (ring)
+        {
+            Event e;
+            if (max == 0)
             {
-                e.second = Q_EMPTY;
-            } else
+                return 0;
+            } else if (ring->pop(e.first))
             {
-                e = std::make_pair(q.front(), Q_OK);
-                q.pop();
+                notifySpace();
+            } else if (millisec == 0 || (e = rget(
+                    millisec > 0 ? deadline(millisec, &tp) : NULL)).second)
+            {
+                return 0;
             }
+
+            for (*out++ = std::move(e.first), ++n;
+                    n < max && ring->pop(e.first); ++n)
+            {
+                notifySpace();
+                *out++ = std::move(e.first);
+            }
+
+            return n;
+        }
+
+        const int c = millisec == 0 ? sem_trywait(&sem) : millisec < 0 ?
+                sem_wait(&sem) : sem_timedwait(&sem, deadline(millisec, &tp));
+
+        if (c == -1 && isEmpty())
+        {
+            return 0;
+        }
+
+        if (pthread_mutex_lock(&mutex) == 0)
+        {
+            for (T item; n < max && take(item); ++n)
+            {
+                *out++ = std::move(item);
+            }
+
+            const bool remain = !isEmpty();
             pthread_mutex_unlock(&mutex);
-        } else
+
+            if (remain)
+            {
+                sem_post(&sem);
+            }
+        }
+
+        return n;
+    }
+
+    /**
+     *  \brief Move all elements out of the queue without waiting.
+     *
+     *  When \a out is empty, its content is swapped with the underlying
+     *  container, i.e., no element is moved or copied and \a out hands its storage
+     *  over to the queue for reuse. Otherwise all elements are appended to
+     *  \a out in FIFO order.
+     *
+     *  \param out receives all elements of the queue.
+     *  \return number of elements taken.
+     */
+    size_t takeAll(std::deque<T> &out)
+    {
+        if (ring)
         {
-            e.second = Q_BUSY;
+            return drain(std::back_inserter(out), (size_t) -1, 0);
         }
 
-        return e;
+        size_t n = 0;
+
+        if (pthread_mutex_lock(&mutex) == 0)
+        {
+            n = q.size();
+            if (!lanes.empty())
+            {
+                for (T item; take(item); ++n)
+                {
+                    out.push_back(std::move(item));
+                }
+            } else if (out.empty())
+            {
+                out.swap(q);
+            } else
+            {
+                out.insert(out.end(), std::make_move_iterator(q.begin()),
+                        std::make_move_iterator(q.end()));
+                q.clear();
+            }
+
+            // consume the non-empty signal, the queue is empty now.
+            sem_trywait(&sem);
+            pthread_mutex_unlock(&mutex);
+        }
+
+        return n;
     }
 
     /**
@@ -155,15 +416,56 @@ public:
      *
      *  \param item the element to put into the queue.
      *  \return 0 on success, -1 otherwise.
+     *
+     *  \note With a ring backend and policy Q_REJECT, -1 signals the ring
+     *  is full.
      */
     int put(const T& item)
     {
+        return emplace(item);
+    }
+
+    /**
+     *  \brief move element item into the queue.
+     *
+     *  Same as put(const T&), except the element is moved instead of
+     *  copied. On failure, \a item is left untouched.
+     */
+    int put(T&& item)
+    {
+        return emplace(std::move(item));
+    }
+
+    /**
+     *  \brief construct an element from \a args in place at the end of the
+     *  queue.
+     *
+     *  \return 0 on success, -1 otherwise, same as put().
+     */
+    template<typename ... Args>
+    int emplace(Args&&... args)
+    {
+        if (ring)
+        {
+            return rput(std::forward<Args>(args)...);
+        }
+
+        if (!lanes.empty())
+        {
+            return lput(T(std::forward<Args>(args)...));
+        }
+
         if (pthread_mutex_lock(&mutex) == 0)
         {
-            q.push(item);
+            const bool wasEmpty = q.empty();
+            q.emplace_back(std::forward<Args>(args)...);
 
             pthread_mutex_unlock(&mutex);
-            sem_post(&sem);
+            if (wasEmpty)
+            {
+                sem_post(&sem);
+                notify();
+            }
 
             return 0;
         }
@@ -180,7 +482,18 @@ public:
      */
     size_t size() const
     {
-        return q.size();
+        if (ring)
+        {
+            return ring->size();
+        }
+
+        size_t n = q.size();
+        for (const auto &l : lanes)
+        {
+            n += l.size();
+        }
+
+        return n;
     }
 
     /**
@@ -193,14 +506,253 @@ public:
      */
     bool empty() const
     {
-        return q.empty();
+        return ring ? ring->empty() : isEmpty();
     }
 
 private:
 
-    std::queue<T> q;
+    /**
+     *  Pop the front element under the lock and release the lock, the
+     *  non-empty signal is passed on if elements are left.
+     */
+    void pop(Event &e)
+    {
+        e.second = take(e.first) ? Q_OK : Q_EMPTY;
+        const bool remain = !isEmpty();
+        pthread_mutex_unlock(&mutex);
+
+        if (remain)
+        {
+            sem_post(&sem);
+        }
+    }
+
+    bool isEmpty() const
+    {
+        for (const auto &l : lanes)
+        {
+            if (!l.empty())
+            {
+                return false;
+            }
+        }
+
+        return q.empty();
+    }
+
+    /**
+     *  Move the next element into \a item under the lock. With lanes, this
+     *  is the front of the highest priority non-empty lane, or of the
+     *  highest lane skipped quota times.
+     */
+    bool take(T &item)
+    {
+        std::deque<T> *d = &q;
+
+        if (!lanes.empty())
+        {
+            const size_t n = lanes.size();
+            size_t h = n, s = n;
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (lanes[i].empty())
+                {
+                    skips[i] = 0;
+                    continue;
+                }
+
+                h = h == n ? i : h;
+                s = s == n && skips[i] >= quota ? i : s;
+            }
+
+            if (h == n)
+            {
+                return false;
+            }
+
+            const size_t c = s < n ? s : h;
+            for (size_t i = 0; i < n; ++i)
+            {
+                skips[i] += i != c && !lanes[i].empty() ? 1 : 0;
+            }
+
+            skips[c] = 0;
+            d = &lanes[c];
+        } else if (q.empty())
+        {
+            return false;
+        }
+
+        item = std::move(d->front());
+        d->pop_front();
+
+        return true;
+    }
+
+    /**
+     *  Lanes backend put, same signaling as the default backend.
+     */
+    int lput(T &&item)
+    {
+        const size_t l = classify(item);
+
+        if (pthread_mutex_lock(&mutex) == 0)
+        {
+            const bool wasEmpty = isEmpty();
+            lanes[l < lanes.size() ? l : lanes.size() - 1].push_back(std::move(item));
+
+            pthread_mutex_unlock(&mutex);
+            if (wasEmpty)
+            {
+                sem_post(&sem);
+                notify();
+            }
+
+            return 0;
+        }
+        return -1;
+    }
+
+    /**
+     *  Absolute CLOCK_REALTIME time \a millisec from now, as required by
+     *  sem_timedwait.
+     */
+    static const timespec *deadline(int millisec, timespec *tp)
+    {
+        timeval tv = { 0, 0 };
+        gettimeofday(&tv, NULL);
+        timeval delta = { millisec / 1000, (millisec % 1000) * 1000 };
+        timeval res;
+        timeradd(&tv, &delta, &res);
+        tp->tv_sec = res.tv_sec;
+        tp->tv_nsec = res.tv_usec * 1000;
+
+        return tp;
+    }
+
+    /**
+     *  Ring backend get. The consumer registers itself as sleeper before
+     *  re-checking the ring, so a producer either sees the sleeper and
+     *  posts the semaphore, or the consumer sees the new element.
+     */
+    Event rget(const timespec *tp)
+    {
+        Event e;
+
+        while (true)
+        {
+            sleepers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (ring->pop(e.first))
+            {
+                sleepers.fetch_sub(1);
+                notifySpace();
+                e.second = Q_OK;
+
+                return e;
+            }
+
+            const int c = tp ? sem_timedwait(&sem, tp) : sem_wait(&sem);
+            sleepers.fetch_sub(1);
+
+            if (c == -1 && errno == ETIMEDOUT)
+            {
+                if (ring->pop(e.first))
+                {
+                    notifySpace();
+                    e.second = Q_OK;
+                } else
+                {
+                    e.second = Q_TIMEOUT;
+                }
+
+                return e;
+            }
+        }
+    }
+
+    /**
+     *  Ring backend put. With policy Q_BLOCK the producer parks on the space
+     *  semaphore, mirroring the consumer side in rget(). \a args are only
+     *  consumed once a cell is claimed, so they can be retried safely.
+     */
+    template<typename ... Args>
+    int rput(Args&&... args)
+    {
+        while (!ring->emplace(std::forward<Args>(args)...))
+        {
+            if (policy == Q_REJECT)
+            {
+                return -1;
+            } else if (policy == Q_OVERWRITE)
+            {
+                T old;
+                ring->pop(old);
+            } else
+            {
+                blocked.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (ring->emplace(std::forward<Args>(args)...))
+                {
+                    blocked.fetch_sub(1);
+                    break;
+                }
+
+                sem_wait(&space);
+                blocked.fetch_sub(1);
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) > 0)
+        {
+            sem_post(&sem);
+        }
+
+        notify();
+
+        return 0;
+    }
+
+    void notify()
+    {
+        const uint64_t v = 1;
+        if (nfd != -1 && write(nfd, &v, sizeof(v)) == -1)
+        {
+            // counter saturated, the consumer is signaled anyway
+        }
+    }
+
+    void notifySpace()
+    {
+        if (policy != Q_BLOCK)
+        {
+            return;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (blocked.load(std::memory_order_relaxed) > 0)
+        {
+            sem_post(&space);
+        }
+    }
+
+    std::deque<T> q;
     sem_t sem;
     pthread_mutex_t mutex;
+    std::unique_ptr<SrRing<T>> ring;
+    FullPolicy policy;
+    sem_t space;
+    std::atomic<int> sleepers;
+    std::atomic<int> blocked;
+    int nfd;
+    std::vector<std::deque<T>> lanes;
+    std::vector<size_t> skips;
+    Classifier classify;
+    size_t quota;
 };
 
 #endif /* SRQUEUE_H */
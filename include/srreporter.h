@@ -21,6 +21,7 @@
 #ifndef SRREPORTER_H
 #define SRREPORTER_H
 
+#include <atomic>
 #include <memory>
 #include "srtypes.h"
 #include "srnethttp.h"
@@ -30,14 +31,85 @@
 
 #define SR_MQTTOPT_KEEPALIVE 1
 
+#define SR_REPORTEROPT_BATCH_BYTES 1
+#define SR_REPORTEROPT_BATCH_NUM 2
+#define SR_REPORTEROPT_LATENCY 3
+#define SR_REPORTEROPT_REPLAY 4
+
+/**
+ *  \class SrReporterStats
+ *  \brief Snapshot of the aggregation counters of a SrReporter.
+ *
+ *  A batch is the set of messages aggregated into one request. The
+ *  queueing delay of a batch is the time its oldest message spent in the
+ *  SrReporter since taken off the egress queue, until the batch is handed
+ *  to the network stack.
+ */
+struct SrReporterStats
+{
+    /**
+     *  \brief Number of batches.
+     */
+    uint64_t batches;
+    /**
+     *  \brief Number of messages in all batches.
+     */
+    uint64_t messages;
+    /**
+     *  \brief Number of payload bytes in all batches.
+     */
+    uint64_t bytes;
+    /**
+     *  \brief Sum of the queueing delays of all batches in milliseconds.
+     */
+    uint64_t delay;
+    /**
+     *  \brief Maximum queueing delay of a batch in milliseconds.
+     */
+    uint32_t maxDelay;
+    /**
+     *  \brief Number of messages in the last batch.
+     */
+    uint32_t lastSize;
+    /**
+     *  \brief Bytes written to the file backed buffer before compression,
+     *  0 unless SR_FILEBUF_COMPRESS is enabled.
+     */
+    uint64_t bufRaw;
+    /**
+     *  \brief Bytes written to the file backed buffer after compression,
+     *  bufRaw / bufStored is the achieved compression ratio.
+     */
+    uint64_t bufStored;
+    /**
+     *  \brief Bytes currently used by the request buffer, updated once
+     *  per reporter cycle. Whole pages for the file backed buffer.
+     */
+    uint64_t bufUsed;
+    /**
+     *  \brief Bytes evicted from the request buffer to stay within its
+     *  capacity or budget.
+     */
+    uint64_t bufEvicted;
+    /**
+     *  \brief Messages evicted from the request buffer. Not counted by
+     *  the stream engine (SR_FILEBUF_ENGINE=0) and with
+     *  SR_FILEBUF_COMPRESS, which evict whole batches.
+     */
+    uint64_t bufEvictedMsgs;
+};
+
 /**
  *  \class SrReporter
  *  \brief The reporter thread for sending all requests to Cumulocity.
  *
  *  The SrReporter is responsible for sending all requests (measurements,
  *  alarms, events, etc.) to Cumulocity. For traffic saving, the SrReporter
- *  implements request aggregation when there are consecutive requests in the
- *  queue within less than SR_REPORTER_VAL (default 400) milliseconds. It also
+ *  implements adaptive request aggregation: the SrReporter wakes up when a
+ *  request is queued, and sends the aggregated requests when a byte or
+ *  message threshold is reached, the oldest request waited for the maximum
+ *  latency (default SR_REPORTER_VAL, 400 milliseconds), or a request with
+ *  SR_PRIO_URGENT arrives (see setOpt()). It also
  *  implements a multiple retry and exponential waiting mechanism for
  *  counteracting the instability of mobile networks. Additionally, it
  *  implements a capacity limited buffering technique for counteracting long
@@ -50,6 +122,7 @@
  *  not be lost in case of sudden outage.
  */
 class _Pager;
+struct _Arena;
 
 class SrReporter
 {
@@ -73,7 +146,7 @@ public:
      *  file backed buffering.
      */
     SrReporter(const string &server, const string &xid, const string &auth,
-            SrQueue<SrNews> &out, SrQueue<SrOpBatch> &in, uint16_t cap = 1000,
+            SrQueue<SrNews> &out, SrQueue<SrOpBatch> &in, uint32_t cap = 1000,
             const string buffile = "");
     /**
      *  \brief SrReporter MQTT constructor.
@@ -98,7 +171,7 @@ public:
      */
     SrReporter(const string &server, const string &deviceId, const string &xid,
             const string &user, const string &pass, SrQueue<SrNews> &out,
-            SrQueue<SrOpBatch> &in, uint16_t cap = 1000, const string buffile =
+            SrQueue<SrOpBatch> &in, uint32_t cap = 1000, const string buffile =
                     "");
     virtual ~SrReporter();
 
@@ -127,7 +200,7 @@ public:
      *  file backed buffering, page fragmentation will also waste a
      *  fraction of the capacity.
      */
-    uint16_t capacity() const;
+    uint32_t capacity() const;
     /**
      *  \brief Set the capacity of the request buffer.
      *
@@ -139,7 +212,42 @@ public:
      *
      *  \param cap new buffer capacity.
      */
-    void setCapacity(uint16_t cap);
+    void setCapacity(uint32_t cap);
+    /**
+     *  \brief Set the byte budget of the request buffer.
+     *
+     *  For the memory buffer, buffered requests and their index are
+     *  limited to about \a bytes, in addition to the capacity. When the
+     *  budget is exceeded, the oldest SR_PRIO_BULK request is evicted
+     *  first, then the oldest ordinary request, and SR_PRIO_URGENT
+     *  requests last. X-ID requests are kept, so the remaining requests
+     *  are still sent with their X-ID.
+     *
+     *  For the file backed buffer, the capacity is set to \a bytes
+     *  divided by the page size, and the oldest batches are evicted. The
+     *  mmap engine (SR_FILEBUF_ENGINE=1) sizes its ring file by the
+     *  capacity: the file is re-laid out for the new capacity when the next
+     *  request is buffered, and when it is opened with a capacity other
+     *  than the one it was written with. Buffered requests are kept, only
+     *  the oldest batches beyond a smaller capacity are evicted.
+     *
+     *  \param bytes budget in bytes, 0 for no byte limit.
+     */
+    void setBudget(size_t bytes);
+    /**
+     *  \brief Prime the buffer compression with a SmartREST template.
+     *
+     *  The message IDs of all request templates in \a srt are used as
+     *  dictionary for compressing the file backed buffer, in addition to
+     *  the X-ID. Only effective when SR_FILEBUF_COMPRESS is enabled.
+     *
+     *  \param srt SmartREST template, as registered with registerSrTemplate().
+     *
+     *  \note Must be called before start(). Dictionaries are kept in a
+     *  file next to the buffer, hence buffered requests from a previous
+     *  run are replayed with any template.
+     */
+    void setDictionary(const string &srt);
     /**
      *  \brief Start the SrReporter thread.
      *
@@ -189,6 +297,37 @@ public:
      *  as they would otherwise has no effect.
      */
     void mqttSetOpt(int option, long parameter);
+    /**
+     *  \brief Set aggregation options.
+     *
+     *  Supported option list:
+     *
+     *  - SR_REPORTEROPT_BATCH_BYTES: send when the aggregated requests
+     *    reach this number of bytes, default 15360. Requests are still
+     *    split at the MQTT payload limit of 16 KB.
+     *  - SR_REPORTEROPT_BATCH_NUM: send when this number of requests are
+     *    aggregated, default and maximum SR_REPORTER_NUM.
+     *  - SR_REPORTEROPT_LATENCY: maximum milliseconds a request waits for
+     *    aggregation, default SR_REPORTER_VAL. This is also the interval
+     *    for re-trying buffered requests when idle.
+     *  - SR_REPORTEROPT_REPLAY: number of buffered batches posted
+     *    concurrently when replaying the buffer after a network error,
+     *    default 4, 1 replays one batch per cycle. Only for HTTP.
+     *
+     *  Options can be changed at any time, the thresholds take effect
+     *  with the next queued request, the latency with the next batch.
+     *
+     *  \param option aggregation option.
+     *  \param parameter positive value for the option.
+     */
+    void setOpt(int option, long parameter);
+    /**
+     *  \brief Get the aggregation counters.
+     *
+     *  \note The counters are updated by the SrReporter thread, the
+     *  snapshot is not atomic as a whole.
+     */
+    SrReporterStats stats() const;
 
 protected:
     /**
@@ -199,15 +338,30 @@ protected:
 
 private:
 
+    void collect(std::deque<SrNews> &pend, int64_t &t0);
+    void count(size_t n, size_t bytes, int64_t t0);
+
     std::unique_ptr<SrNetHttp> http;
     std::unique_ptr<SrNetMqtt> mqtt;
     SrQueue<SrNews> &out;
     SrQueue<SrOpBatch> &in;
     const string &xid;
     std::unique_ptr<_Pager> ptr;
+    std::unique_ptr<_Arena> arena;
     bool sleeping;
     bool isfilebuf;
     pthread_t tid;
+    std::atomic<uint32_t> maxBytes;
+    std::atomic<uint32_t> maxNum;
+    std::atomic<uint32_t> latency;
+    std::atomic<uint32_t> inflight;
+    std::atomic<uint64_t> nbatch;
+    std::atomic<uint64_t> nmsg;
+    std::atomic<uint64_t> nbyte;
+    std::atomic<uint64_t> ndelay;
+    std::atomic<uint32_t> mdelay;
+    std::atomic<uint32_t> lastn;
+    std::atomic<uint64_t> nused;
 };
 
 #endif /* SRREPORTER_H */
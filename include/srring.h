@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SRRING_H
+#define SRRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#ifndef SR_CACHELINE
+#define SR_CACHELINE 64
+#endif
+
+/**
+ *  \class SrRing
+ *  \brief Lock-free bounded ring buffer.
+ *
+ *  SrRing is a fixed capacity ring of sequenced cells. Producers and
+ *  consumers claim cells with a single compare-and-swap on the enqueue or
+ *  dequeue position, and publish them by bumping the sequence number of
+ *  the cell, hence neither side ever takes a lock. The enqueue and dequeue
+ *  positions live on separate cache lines, so producers do not false share
+ *  with the consumer.
+ *
+ *  The ring is safe for any number of producers and consumers, it is used
+ *  by SrQueue as a multi-producer/single-consumer backend. Waiting for
+ *  elements or for free space is not handled here, see SrQueue.
+ *
+ *  \note Element T requires a default constructor.
+ */
+template<typename T> class SrRing
+{
+public:
+    /**
+     *  \brief SrRing constructor.
+     *
+     *  \param cap capacity of the ring, rounded up to the next power of 2.
+     */
+    SrRing(size_t cap) :
+            cells(NULL), mask(0), enq(0), deq(0)
+    {
+        size_t n = 2;
+        for (; n < cap; n <<= 1)
+        {
+            // empty
+        }
+
+        cells = new Cell[n];
+        mask = n - 1;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    virtual ~SrRing()
+    {
+        delete[] cells;
+    }
+
+    /**
+     *  \brief Put element item into the ring.
+     *
+     *  \param item the element to put into the ring.
+     *  \return true on success, false if the ring is full.
+     */
+    bool push(const T &item)
+    {
+        return emplace(item);
+    }
+
+    /**
+     *  \brief Move element item into the ring.
+     *
+     *  \param item the element to move into the ring, untouched if the ring
+     *  is full.
+     *  \return true on success, false if the ring is full.
+     */
+    bool push(T &&item)
+    {
+        return emplace(std::move(item));
+    }
+
+    /**
+     *  \brief Construct an element from \a args in the ring.
+     *
+     *  \return true on success, false if the ring is full, \a args are not
+     *  consumed in this case.
+     */
+    template<typename ... Args>
+    bool emplace(Args&&... args)
+    {
+        size_t pos = 0;
+        Cell* const c = claim(enq, 0, pos);
+        if (c == NULL)
+        {
+            return false;
+        }
+
+        c->data = T(std::forward<Args>(args)...);
+        c->seq.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     *  \brief Get the oldest element from the ring.
+     *
+     *  \param item assigned with the element on success, untouched
+     *  otherwise.
+     *  \return true on success, false if the ring is empty.
+     */
+    bool pop(T &item)
+    {
+        size_t pos = 0;
+        Cell* const c = claim(deq, 1, pos);
+        if (c == NULL)
+        {
+            return false;
+        }
+
+        item = std::move(c->data);
+        c->data = T();
+        c->seq.store(pos + mask + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     *  \brief Get the capacity of the ring.
+     */
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    /**
+     *  \brief Get the number of elements in the ring.
+     *
+     *  \note The value is only a snapshot when other threads are
+     *  accessing the ring at the same time.
+     */
+    size_t size() const
+    {
+        const size_t d = deq.load(std::memory_order_acquire);
+        const size_t e = enq.load(std::memory_order_acquire);
+
+        return e > d ? e - d : 0;
+    }
+
+    /**
+     *  \brief Check if the ring is empty, same restriction as size().
+     */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    /**
+     *  Claim the cell at position \a p. A cell is ready for the producer
+     *  when its sequence equals the position, and ready for the consumer
+     *  when it equals position + 1 (\a lag).
+     */
+    Cell *claim(std::atomic<size_t> &p, size_t lag, size_t &pos)
+    {
+        pos = p.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell* const c = &cells[pos & mask];
+            const size_t seq = c->seq.load(std::memory_order_acquire);
+            const intptr_t dif = (intptr_t) seq - (intptr_t) (pos + lag);
+
+            if (dif == 0)
+            {
+                if (p.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed))
+                {
+                    return c;
+                }
+            } else if (dif < 0)
+            {
+                return NULL;
+            } else
+            {
+                pos = p.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Cell *cells;
+    size_t mask;
+    char pad0[SR_CACHELINE];
+    std::atomic<size_t> enq;
+    char pad1[SR_CACHELINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> deq;
+    char pad2[SR_CACHELINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif /* SRRING_H */
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SRSTREAMPARSER_H
+#define SRSTREAMPARSER_H
+
+#include "smartrest.h"
+
+/**
+ *  \class SrRecordHandler
+ *  \brief Virtual base class for consumers of SrStreamParser.
+ */
+class SrRecordHandler
+{
+public:
+    virtual ~SrRecordHandler()
+    {
+    }
+
+    /**
+     *  \brief Callback for a complete SmartREST record.
+     *
+     *  \param r the record, only valid during the call.
+     *  \param raw the record as received, including the trailing newline
+     *  (if any), only valid during the call.
+     *  \param len length of \a raw.
+     */
+    virtual void operator()(SrRecord &r, const char *raw, size_t len) = 0;
+
+    /**
+     *  \brief Callback after all complete records of one chunk are
+     *  delivered, e.g., for forwarding them as a batch.
+     */
+    virtual void flush()
+    {
+    }
+};
+
+/**
+ *  \class SrStreamParser
+ *  \brief Incremental SmartREST parser for partial network buffers.
+ *
+ *  SrStreamParser accepts a SmartREST response in arbitrary chunks, as
+ *  they arrive from the network, e.g., from the libcurl write callback (see
+ *  SrNetHttp::setStream) or after SrNetSocket::recv. Each record is passed
+ *  to the SrRecordHandler as soon as its terminating newline arrives, which
+ *  allows processing to start before the transfer finishes. Only the
+ *  incomplete last record is kept in memory, quoted values may span any
+ *  number of chunks.
+ *
+ *  Records are tokenized exactly as by SrParser.
+ */
+class SrStreamParser
+{
+public:
+    /**
+     *  \brief SrStreamParser constructor.
+     *
+     *  \param h handler called for each complete record.
+     *  \param limit maximum size in bytes of an incomplete record, 0 for
+     *  unlimited.
+     */
+    SrStreamParser(SrRecordHandler &h, size_t limit = 0) :
+            h(h), limit(limit), pos(0), lex(NULL, 0)
+    {
+    }
+    virtual ~SrStreamParser()
+    {
+    }
+
+    /**
+     *  \brief Feed the next chunk of the stream.
+     *
+     *  \param p pointer to the chunk.
+     *  \param n size of the chunk.
+     *  \return number of records delivered, -1 if an incomplete record
+     *  exceeds the limit, all buffered data is discarded in this case.
+     */
+    int feed(const char *p, size_t n);
+
+    /**
+     *  \brief Mark the end of the stream, the last record does not need a
+     *  terminating newline.
+     *
+     *  \return number of records delivered. The parser is reset and can be
+     *  used for the next stream.
+     */
+    int finish();
+
+    /**
+     *  \brief Discard all buffered data, e.g., after a failed transfer.
+     */
+    void reset()
+    {
+        buf.clear();
+        pos = 0;
+    }
+
+    /**
+     *  \brief Get the buffered bytes not yet delivered, e.g., the text of
+     *  an unterminated error response.
+     */
+    std::string rest() const
+    {
+        return buf.substr(pos);
+    }
+
+    /**
+     *  \brief Number of buffered bytes not yet delivered.
+     */
+    size_t pending() const
+    {
+        return buf.size() - pos;
+    }
+
+private:
+
+    int parse(bool last);
+
+    SrRecordHandler &h;
+    const size_t limit;
+    std::string buf;
+    size_t pos;
+    SrLexer lex;
+    SrRecord r;
+};
+
+#endif /* SRSTREAMPARSER_H */
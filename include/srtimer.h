@@ -22,11 +22,14 @@
 #define SRTIMER_H
 
 #include <utility>
+#include <functional>
 #include <time.h>
+#include <stdint.h>
 #include "srtypes.h"
 
 class SrTimer;
 class SrAgent;
+class SrTimerQueue;
 
 /**
  *  \brief Comparison operator for timespec.
@@ -60,10 +63,40 @@ typedef SrTimerHandler AbstractTimerFunctor;
 /**
  *  \class SrTimer
  *  \brief A periodical timer with millisecond resolution.
+ *
+ *  Once added to an SrAgent, the timer notifies the agent's SrTimerQueue
+ *  whenever it is started or stopped. The schedule is changed under the
+ *  queue lock, hence start(), stop() and setInterval() are thread-safe
+ *  with respect to the agent loop, e.g., when called from an SrExecutor
+ *  worker.
+ *
+ *  By default, the agent restarts the timer after the callback returns, so
+ *  the callback execution time and the scheduling latency add up to the
+ *  period. In periodic mode (see setPeriodic()), the n-th fire time is the
+ *  start time plus n periods instead, hence the timer does not drift, and
+ *  periods missed due to a slow callback or a suspended system are handled
+ *  according to the CatchUp policy. Optionally, the fire times can be
+ *  aligned to the wall clock (see setAlignment()).
  */
 class SrTimer
 {
 public:
+    /**
+     *  \brief Policy for missed periods in periodic mode.
+     */
+    enum CatchUp
+    {
+        /** a fire late by one period or more is dropped, the timer resumes
+         *  at the next period in the future. */
+        SKIP = 0,
+        /** all missed periods are coalesced into one callback, the timer
+         *  resumes at the next period in the future. */
+        COALESCE,
+        /** the callback is fired once per missed period, back to back,
+         *  until the timer is back on schedule. */
+        BURST
+    };
+
     /**
      *  \brief SrTimer constructor.
      *
@@ -72,13 +105,14 @@ public:
      *  \param callback functor to be executed when the timer fires.
      */
     SrTimer(int millisec, SrTimerHandler *callback = NULL) :
-            cb(callback), val(millisec), active(false)
+            cb(callback), tq(NULL), qprev(NULL), qnext(NULL), qpos(0),
+            qtick(0), anchor(0), nth(0), skipped(0), nmissed(0),
+            val(millisec), align(0), policy(SKIP), periodic(false),
+            wall(false), active(false), queued(false)
     {
     }
 	
-    virtual ~SrTimer()
-    {
-    }
+    virtual ~SrTimer();
 
     /**
      *  \brief Check if the timer is active.
@@ -98,8 +132,32 @@ public:
         return val;
     }
 	
+    /**
+     *  \brief Check if the timer is in periodic mode.
+     */
+    bool isPeriodic() const
+    {
+        return periodic;
+    }
+
+    /**
+     *  \brief Get the number of periods missed before the current callback.
+     *
+     *  With policy COALESCE, this is the number of periods coalesced into
+     *  the current callback, with BURST the number of periods still to
+     *  catch up, and with SKIP the number of periods dropped since the
+     *  previous callback. Always 0 when not in periodic mode.
+     */
+    uint32_t missed() const
+    {
+        return nmissed;
+    }
+	
     /**
      *  \brief Get the schedule time of the timer.
+     *
+     *  In periodic mode, the schedule time is the previous fire time.
+     *
      *  \return the schedule time, undefined if timer is inactive.
      */
     const timespec &shedTime() const
@@ -131,15 +189,59 @@ public:
     /**
      *  \brief Set the period to millisec for the timer.
      *
+     *  If the timer is active, its fire time is moved to the schedule time
+     *  plus the new period, and the timer is rescheduled accordingly.
+     *
      *  \note This function does not activate the timer.
      *  \note Set a negative interval causes undefined behavior.
      *
      *  \param millisec the new period in milliseconds.
      */
-    void setInterval(int millisec)
+    void setInterval(int millisec);
+
+    /**
+     *  \brief Enable or disable periodic mode.
+     *
+     *  Takes effect at the next start().
+     *
+     *  \param on true for periodic mode, false for the default restart
+     *  after each callback.
+     *  \param catchup policy for missed periods.
+     */
+    void setPeriodic(bool on, CatchUp catchup = SKIP)
     {
-        val = millisec;
+        periodic = on;
+        policy = catchup;
     }
+
+    /**
+     *  \brief Align the fire times to the wall clock.
+     *
+     *  Only applies in periodic mode. When set, start() schedules the first
+     *  fire time at the next multiple of \a millisec since the Epoch
+     *  (CLOCK_REALTIME), e.g., 60000 fires on minute boundaries, and all
+     *  following fire times are computed on the wall clock as well, so
+     *  they stay aligned when the system clock is adjusted. Takes effect at
+     *  the next start().
+     *
+     *  \param millisec alignment in milliseconds, 0 disables alignment.
+     */
+    void setAlignment(int millisec)
+    {
+        align = millisec;
+    }
+
+    /**
+     *  \brief Advance a fired periodic timer to its next period.
+     *
+     *  Called by SrAgent when a periodic timer expires, before the callback
+     *  is run. Applies the CatchUp policy and reschedules the timer.
+     *
+     *  \param now current CLOCK_MONOTONIC time.
+     *  \return true if the callback shall be run, false if the fire is
+     *  skipped.
+     */
+    bool rearm(const timespec &now);
 	
     /**
      *  \brief Connect callback functor to the timer.
@@ -158,39 +260,53 @@ public:
     /**
      *  \brief Start the timer.
      *
-     *  This function activates the timer, sets the schedule time to now,
-     *  and the fire time according to the current period.
+     *  This function activates the timer, sets the schedule time to now
+     *  (CLOCK_MONOTONIC), and the fire time according to the current period.
      */
-    void start()
-    {
-        clock_gettime(CLOCK_MONOTONIC_COARSE, &beg);
-        end.tv_sec = beg.tv_sec + val / 1000;
-        end.tv_nsec = beg.tv_nsec + (val % 1000) * 1000000;
-
-        if (end.tv_nsec >= 1000000000)
-        {
-            ++end.tv_sec;
-            end.tv_nsec -= 1000000000;
-        }
-
-        active = true;
-    }
+    void start();
 	
     /**
      *  \brief Stop the timer. Sets the timer to inactive.
      */
-    void stop()
-    {
-        active = false;
-    }
+    void stop();
 
 private:
 
+    friend class SrTimerQueue;
+
+    /**
+     *  Apply \a fn to the schedule under the queue lock, and re-schedule
+     *  the timer. Without queue, \a fn is applied directly.
+     */
+    void modify(const std::function<void()> &fn);
+    /**
+     *  Set the fire time to the schedule time plus the period.
+     */
+    void arm();
+    /**
+     *  Set the fire time to the nth period after the anchor.
+     */
+    void armPeriod();
+
     SrTimerHandler *cb;
+    SrTimerQueue *tq;
+    SrTimer *qprev;
+    SrTimer *qnext;
+    size_t qpos;
+    uint64_t qtick;
     timespec beg;
     timespec end;
+    int64_t anchor;
+    uint64_t nth;
+    uint32_t skipped;
+    uint32_t nmissed;
     int val;
+    int align;
+    CatchUp policy;
+    bool periodic;
+    bool wall;
     bool active;
+    bool queued;
 };
 
 #endif /* SRTIMER_H */
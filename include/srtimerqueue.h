@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SRTIMERQUEUE_H
+#define SRTIMERQUEUE_H
+
+#include <set>
+#include <vector>
+#include <pthread.h>
+#include "srtimer.h"
+
+/**
+ *  \class SrTimerQueue
+ *  \brief Abstract scheduling queue of active SrTimer ordered by fire time.
+ *
+ *  SrAgent keeps all added timers in an SrTimerQueue. Added timers notify
+ *  the queue when they are started or stopped, so only active timers are
+ *  scheduled, and the agent can sleep until the earliest fire time instead
+ *  of polling. The public interface is thread-safe, subclasses implement
+ *  the ordering by overriding the protected primitives, which are always
+ *  called with the queue lock held.
+ *
+ *  While the agent sleeps (between wait() and awake()), a timer update
+ *  that schedules a fire time earlier than the awaited deadline writes to
+ *  the wakeup file descriptor (see setWakeup()), so the agent re-computes
+ *  its deadline.
+ */
+class SrTimerQueue
+{
+public:
+    SrTimerQueue();
+    virtual ~SrTimerQueue();
+
+    /**
+     *  \brief Add timer to the queue, scheduled if it is active.
+     *
+     *  Adding a timer which is already in the queue has no effect.
+     */
+    void add(SrTimer &timer);
+    /**
+     *  \brief Remove timer from the queue.
+     */
+    void remove(SrTimer &timer);
+    /**
+     *  \brief Re-schedule timer after it was started or stopped.
+     */
+    void update(SrTimer &timer);
+    /**
+     *  \brief Apply \a fn to timer and re-schedule it, atomically with
+     *  respect to all other queue operations.
+     *
+     *  \param timer timer in the queue.
+     *  \param fn changes the schedule of timer, called with the queue lock
+     *  held, hence must not call back into the queue.
+     */
+    void update(SrTimer &timer, const std::function<void()> &fn);
+    /**
+     *  \brief Move all timers with fire time not later than \a now into
+     *  \a fired, in fire time order. The timers are unscheduled but remain
+     *  active, they are scheduled again when re-started.
+     *
+     *  \return number of expired timers.
+     */
+    size_t expired(const timespec &now, std::vector<SrTimer*> &fired);
+    /**
+     *  \brief Get the earliest fire time and mark the caller as sleeping.
+     *
+     *  \param t assigned with the earliest fire time.
+     *  \return true if any timer is scheduled, false otherwise.
+     */
+    bool wait(timespec &t);
+    /**
+     *  \brief Mark the caller as awake, see wait().
+     */
+    void awake();
+    /**
+     *  \brief Move all timers to queue \a other, scheduling the active
+     *  ones there.
+     */
+    void moveTo(SrTimerQueue &other);
+    /**
+     *  \brief Set the eventfd for waking up a sleeping caller, -1 disables
+     *  the wakeup.
+     */
+    void setWakeup(int fd)
+    {
+        efd = fd;
+    }
+
+protected:
+
+    /**
+     *  \brief Schedule \a timer at timer.fireTime().
+     */
+    virtual void schedule(SrTimer &timer) = 0;
+    /**
+     *  \brief Unschedule a scheduled \a timer.
+     */
+    virtual void unschedule(SrTimer &timer) = 0;
+    /**
+     *  \brief Get the earliest scheduled fire time.
+     *  \return false if no timer is scheduled.
+     */
+    virtual bool next(timespec &t) = 0;
+    /**
+     *  \brief Unschedule all expired timers and append them to \a fired.
+     */
+    virtual void expire(const timespec &now, std::vector<SrTimer*> &fired) = 0;
+    /**
+     *  \brief Backend specific position of \a timer in the queue.
+     */
+    static size_t &position(SrTimer &timer)
+    {
+        return timer.qpos;
+    }
+    /**
+     *  \brief Backend specific key of \a timer, e.g., the fire tick.
+     */
+    static uint64_t &key(SrTimer &timer)
+    {
+        return timer.qtick;
+    }
+    /**
+     *  \brief Intrusive list links of \a timer.
+     */
+    static SrTimer *&prevOf(SrTimer &timer)
+    {
+        return timer.qprev;
+    }
+    static SrTimer *&nextOf(SrTimer &timer)
+    {
+        return timer.qnext;
+    }
+
+private:
+
+    std::set<SrTimer*> timers;
+    pthread_mutex_t mutex;
+    timespec awaited;
+    int efd;
+    bool waiting;
+};
+
+/**
+ *  \class SrTimerHeap
+ *  \brief Binary min-heap implementation of SrTimerQueue.
+ *
+ *  Schedule, unschedule and expiry are O(log n), the earliest fire time is
+ *  O(1). The fire time is cached in the heap, so the heap stays consistent
+ *  while a timer is re-started from another thread.
+ */
+class SrTimerHeap: public SrTimerQueue
+{
+public:
+    virtual ~SrTimerHeap()
+    {
+    }
+
+protected:
+
+    virtual void schedule(SrTimer &timer);
+    virtual void unschedule(SrTimer &timer);
+    virtual bool next(timespec &t);
+    virtual void expire(const timespec &now, std::vector<SrTimer*> &fired);
+
+private:
+
+    typedef std::pair<timespec, SrTimer*> _Entry;
+
+    void up(size_t i);
+    void down(size_t i);
+    void place(size_t i, const _Entry &e)
+    {
+        heap[i] = e;
+        position(*e.second) = i;
+    }
+
+    std::vector<_Entry> heap;
+};
+
+/**
+ *  \class SrTimerWheel
+ *  \brief Hierarchical timing wheel implementation of SrTimerQueue.
+ *
+ *  The wheel has 4 levels of 256 slots with a tick of 1 millisecond, i.e.,
+ *  it covers 2^32 ms (about 49 days) ahead, timers further ahead are
+ *  parked in the last slot and re-hashed when it comes round. Schedule and
+ *  unschedule are O(1), a timer is cascaded at most once per level, and
+ *  occupancy bitmaps make finding the next fire time independent of the
+ *  number of timers. Fire times are rounded up to the next tick, so a
+ *  timer may fire up to 1 ms late, but never early.
+ *
+ *  Prefer SrTimerWheel over the default SrTimerHeap with thousands of
+ *  timers which are frequently restarted, see SrAgent::setTimerQueue().
+ */
+class SrTimerWheel: public SrTimerQueue
+{
+public:
+    SrTimerWheel();
+    virtual ~SrTimerWheel()
+    {
+    }
+
+protected:
+
+    virtual void schedule(SrTimer &timer);
+    virtual void unschedule(SrTimer &timer);
+    virtual bool next(timespec &t);
+    virtual void expire(const timespec &now, std::vector<SrTimer*> &fired);
+
+private:
+
+    enum
+    {
+        BITS = 8, SLOTS = 1 << BITS, LEVELS = 4, READY = LEVELS * SLOTS
+    };
+
+    uint64_t ticks(const timespec &t, bool up) const;
+    void link(SrTimer &timer);
+    void unlink(SrTimer &timer);
+    void cascade(size_t level);
+    void collect(size_t pos, std::vector<SrTimer*> &fired);
+    int findSlot(size_t level, size_t from) const;
+
+    SrTimer *slots[READY + 1];
+    uint64_t bitmap[LEVELS][SLOTS / 64];
+    timespec origin;
+    uint64_t cur;
+};
+
+#endif /* SRTIMERQUEUE_H */
@@ -22,9 +22,15 @@
 #define SRTYPES_H
 
 #include <string>
+#include <utility>
+#include <cstdint>
 
 #define SR_PRIO_BUF 1
 #define SR_PRIO_XID 2
+#define SR_PRIO_URGENT 4
+#define SR_PRIO_BULK 8
+
+#define SR_PRIO_LANES 3
 
 /**
  *  \class SrNews
@@ -57,6 +63,21 @@ struct SrNews
     {
     }
 
+    /**
+     *  \brief SrNews constructor.
+     *
+     *  Same as above, except \a s is moved into member \a data.
+     */
+    SrNews(std::string &&s, uint8_t prio = 0) :
+            data(std::move(s)), prio(prio)
+    {
+    }
+
+    SrNews(const SrNews &news) = default;
+    SrNews(SrNews &&news) = default;
+    SrNews &operator=(const SrNews &news) = default;
+    SrNews &operator=(SrNews &&news) = default;
+
     /**
      *  \brief The request to send to Cumulocity.
      */
@@ -75,12 +96,30 @@ struct SrNews
      *  \a SR_PRIO_XID: request uses a different template XID than
      *  SrAgent.XID(), and the first field in the CSV is the alternate XID.
      *
+     *  \a SR_PRIO_URGENT: request is latency critical, e.g., an alarm, the
+     *  SrReporter sends it together with all pending requests immediately
+     *  instead of waiting for more requests to aggregate.
+     *
+     *  \a SR_PRIO_BULK: request is bulk data, e.g., periodic measurements,
+     *  it may be overtaken by other requests in the egress queue.
+     *
      *  \note prio can be bit-wise XOR-ed, multiple priority can be set
      *  at the same time.
      */
     uint8_t prio;
 };
 
+/**
+ *  \brief Priority lane of a SrNews, see SrQueue::setLanes().
+ *
+ *  Lane 0 for SR_PRIO_URGENT, lane 2 for SR_PRIO_BULK and lane 1 for all
+ *  others.
+ */
+inline size_t srNewsLane(const SrNews &news)
+{
+    return news.prio & SR_PRIO_URGENT ? 0 : news.prio & SR_PRIO_BULK ? 2 : 1;
+}
+
 /**
  *  \class SrOpBatch
  *  \brief Data type represents a SmartREST response, i.e., a batch of
@@ -106,6 +145,23 @@ struct SrOpBatch
             data(s)
     {
     }
+
+    /**
+     *  \brief SrOpBatch constructor.
+     *
+     *  Construct a SrOpBatch by moving string \a s.
+     *
+     *  \param s string
+     */
+    SrOpBatch(std::string &&s) :
+            data(std::move(s))
+    {
+    }
+
+    SrOpBatch(const SrOpBatch &batch) = default;
+    SrOpBatch(SrOpBatch &&batch) = default;
+    SrOpBatch &operator=(const SrOpBatch &batch) = default;
+    SrOpBatch &operator=(SrOpBatch &&batch) = default;
 	
     /**
      *  \brief Buffer contains the response.
@@ -22,6 +22,7 @@
 #define SRUTILS_H
 
 #include <string>
+#include <cstdint>
 #include "srnethttp.h"
 
 /**
@@ -87,5 +88,17 @@ std::string b64Encode(const std::string &s);
  *  \return Decoded string.
  */
 std::string b64Decode(const std::string &s);
+/**
+ *  \brief CRC-32C (Castagnoli) checksum.
+ *
+ *  Uses the CRC32 instructions of SSE4.2 or ARMv8 when available, a table
+ *  driven implementation otherwise.
+ *
+ *  \param crc checksum of the preceding data, 0 for a new checksum.
+ *  \param p pointer to the data.
+ *  \param n length of the data.
+ *  \return Checksum over the preceding data and [p, p + n).
+ */
+uint32_t crc32c(uint32_t crc, const void *p, size_t n);
 
 #endif /* SRUTILS_H */
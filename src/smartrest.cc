@@ -18,27 +18,364 @@
  * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <locale.h>
 #include "smartrest.h"
 
+#ifndef SR_LEXER_SIMD
+#define SR_LEXER_SIMD 1
+#endif
+
+#if SR_LEXER_SIMD && defined(__AVX2__)
+#include <immintrin.h>
+#define SR_LEXER_BLOCK 32
+#elif SR_LEXER_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define SR_LEXER_BLOCK 16
+#elif SR_LEXER_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define SR_LEXER_BLOCK 16
+#endif
+
 using namespace std;
 
-SrLexer::SrToken SrLexer::next()
+/**
+ *  isgraph for the "C" locale, without the table lookup through the
+ *  current locale.
+ */
+static inline bool _graph(char c)
 {
-    SrLexer::SrToken tok;
+    return c > ' ' && c < 0x7f;
+}
+
+/**
+ *  Character classes for scanning a value: digit, dot, other, double quote,
+ *  and stop for characters which end a non-quoted value (comma, double
+ *  quote, and all non-printable characters).
+ */
+enum
+{
+    _D = 1, _P = 2, _O = 4, _Q = 8, _S = 16
+};
+
+static struct _Classes
+{
+    _Classes()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            tab[i] = i >= ' ' && i < 0x7f ? _O : _O | _S;
+        }
+
+        for (int i = '0'; i <= '9'; ++i)
+        {
+            tab[i] = _D;
+        }
+
+        tab['.'] = _P;
+        tab[','] = _O | _S;
+        tab['"'] = _Q | _S;
+    }
+
+    unsigned char operator[](char c) const
+    {
+        return tab[(unsigned char) c];
+    }
+
+    unsigned char tab[256];
+} _cls;
+
+#ifdef SR_LEXER_BLOCK
+
+#if SR_LEXER_BLOCK == 32
+static const uint32_t _ALL = 0xffffffff;
+#else
+static const uint32_t _ALL = 0xffff;
+#endif
+
+/**
+ *  Classify SR_LEXER_BLOCK bytes at \a p into bit masks, one bit per byte:
+ *  \a stop for the bytes which end a value (see _Classes, only the double
+ *  quote if \a quoted), \a digit and \a dot.
+ */
+static inline void _block(const char *p, bool quoted, uint32_t &stop,
+        uint32_t &digit, uint32_t &dot)
+{
+#if SR_LEXER_BLOCK == 32
+    const __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    __m256i st = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+
+    if (!quoted)
+    {   // bytes >= 0x80 are negative, hence not printable either
+        const __m256i pr = _mm256_and_si256(
+                _mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1f)),
+                _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), v));
+        st = _mm256_or_si256(st, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+        st = _mm256_or_si256(st, _mm256_andnot_si256(pr, _mm256_set1_epi8(-1)));
+    }
+
+    const __m256i d = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+
+    stop = _mm256_movemask_epi8(st);
+    digit = _mm256_movemask_epi8(d);
+    dot = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+#elif defined(__SSE2__)
+    const __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i st = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+
+    if (!quoted)
+    {   // bytes >= 0x80 are negative, hence not printable either
+        const __m128i pr = _mm_and_si128(
+                _mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+                _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+        st = _mm_or_si128(st, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+        st = _mm_or_si128(st, _mm_andnot_si128(pr, _mm_set1_epi8(-1)));
+    }
+
+    const __m128i d = _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+            _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+
+    stop = _mm_movemask_epi8(st);
+    digit = _mm_movemask_epi8(d);
+    dot = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+#else
+    static const uint8_t w[16] =
+    {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    const uint8x16_t bits = vld1q_u8(w);
+    const int8x16_t v = vld1q_s8((const int8_t*) p);
+    uint8x16_t st = vceqq_s8(v, vdupq_n_s8('"'));
+
+    if (!quoted)
+    {
+        const uint8x16_t pr = vandq_u8(vcgtq_s8(v, vdupq_n_s8(0x1f)),
+                vcltq_s8(v, vdupq_n_s8(0x7f)));
+        st = vorrq_u8(st, vceqq_s8(v, vdupq_n_s8(',')));
+        st = vorrq_u8(st, vmvnq_u8(pr));
+    }
 
-    if (end == s.size())
+    const uint8x16_t d = vandq_u8(vcgtq_s8(v, vdupq_n_s8('0' - 1)),
+            vcltq_s8(v, vdupq_n_s8('9' + 1)));
+    const uint8x16_t m[3] =
     {
-        tok.first = SR_EOB;
-        pre = start = end;
+        st, d, vceqq_s8(v, vdupq_n_s8('.'))
+    };
+    uint32_t r[3];
 
-        return tok;
+    // movemask: weight the lanes, then add up each half pairwise
+    for (int i = 0; i < 3; ++i)
+    {
+        const uint8x16_t b = vandq_u8(m[i], bits);
+        uint8x8_t x = vpadd_u8(vget_low_u8(b), vget_high_u8(b));
+        x = vpadd_u8(x, x);
+        x = vpadd_u8(x, x);
+        r[i] = vget_lane_u8(x, 0) | (uint32_t) vget_lane_u8(x, 1) << 8;
+    }
+
+    stop = r[0];
+    digit = r[1];
+    dot = r[2];
+#endif
+}
+
+#endif /* SR_LEXER_BLOCK */
+
+/**
+ *  Scalar scan from s[i] up to the first byte of class \a mask, or \a n,
+ *  accumulating classes into \a seen and dots into \a dots.
+ */
+static inline size_t _scalar(const char *s, size_t i, size_t n,
+        unsigned char mask, unsigned int &seen, unsigned int &dots)
+{
+    for (; i < n; ++i)
+    {
+        const unsigned char c = _cls[s[i]];
+
+        if (c & mask)
+        {
+            break;
+        }
+
+        seen |= c;
+        dots += c >> 1 & 1;
+    }
+
+    return i;
+}
+
+/**
+ *  Scan a value from s[i] up to the first byte which ends it, i.e., the
+ *  first double quote if \a quoted, otherwise the first stop byte (see
+ *  _Classes). Classes of all bytes before are accumulated into \a seen,
+ *  and dots are counted into \a dots.
+ *
+ *  \return position of the byte which ends the value, or n.
+ */
+static inline size_t _run(const char *s, size_t i, size_t n, bool quoted,
+        unsigned int &seen, unsigned int &dots)
+{
+    const unsigned char mask = quoted ? _Q : _S;
+
+#ifdef SR_LEXER_BLOCK
+    // most values are short, the vector setup only pays off for long ones
+    const size_t head = i + SR_LEXER_BLOCK < n ? i + SR_LEXER_BLOCK : n;
+    i = _scalar(s, i, head, mask, seen, dots);
+    if (i < head)
+    {
+        return i;
+    }
+
+    for (; i + SR_LEXER_BLOCK <= n; i += SR_LEXER_BLOCK)
+    {
+        uint32_t stop = 0, digit = 0, dot = 0;
+        _block(s + i, quoted, stop, digit, dot);
+
+        // bytes before the first stop byte
+        const uint32_t m = stop ? (stop & -stop) - 1 : _ALL;
+        digit &= m;
+        dot &= m;
+
+        seen |= (digit ? _D : 0) | (dot ? _P : 0)
+                | (m & ~(digit | dot) ? _O : 0);
+        // only none, one or more dots matter, no need for popcount
+        dots += dot ? (dot & (dot - 1) ? 2 : 1) : 0;
+
+        if (stop)
+        {
+            return i + __builtin_ctz(stop);
+        }
+    }
+#endif
+
+    return _scalar(s, i, n, mask, seen, dots);
+}
+
+/**
+ *  Parse an SR_INT value, i.e., an optional sign followed by decimal
+ *  digits only.
+ *
+ *  \return false if the value is out of the range of int64_t.
+ */
+static bool _int(const char *p, const char *e, int64_t &v)
+{
+    const bool neg = *p == '-';
+    p += neg || *p == '+';
+    uint64_t u = 0;
+
+    // 19 digits never overflow
+    for (const char *f = e - p > 19 ? p + 19 : e; p < f; ++p)
+    {
+        u = u * 10 + (*p - '0');
+    }
+
+    for (; p < e; ++p)
+    {
+        if (__builtin_mul_overflow(u, 10, &u)
+                || __builtin_add_overflow(u, (uint64_t) (*p - '0'), &u))
+        {
+            return false;
+        }
+    }
+
+    if (u > (uint64_t) INT64_MAX + neg)
+    {
+        return false;
+    }
+
+    v = neg ? -(int64_t) (u - 1) - 1 : (int64_t) u;
+    return true;
+}
+
+/**
+ *  Parse an SR_FLOAT value, i.e., an optional sign, decimal digits and one
+ *  dot, no exponent.
+ *
+ *  Values of up to 15 significant digits, which covers all measurements
+ *  in practice, are converted exactly as one division of two doubles
+ *  (Clinger's fast path). Longer values fall back to strtod in the "C"
+ *  locale.
+ */
+static double _float(const char *p, const char *e)
+{
+    static const double pow10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* const b = p;
+    const bool neg = *p == '-';
+    p += neg || *p == '+';
+    uint64_t m = 0;
+    int sig = 0, frac = 0;
+    bool dot = false;
+
+    for (; p < e; ++p)
+    {
+        if (*p == '.')
+        {
+            dot = true;
+        } else
+        {
+            m = m * 10 + (*p - '0');
+            sig += m != 0;
+            frac += dot;
+
+            if (sig > 15 || frac > 22)
+            {
+                static const locale_t c = newlocale(LC_ALL_MASK, "C", NULL);
+                const std::string t(b, e);
+
+                return strtod_l(t.c_str(), NULL, c);
+            }
+        }
+    }
+
+    const double d = m / pow10[frac];
+    return neg ? -d : d;
+}
+
+void SrLexer::number(const char *buf, SrTokenView &tok)
+{
+    const char* const p = buf + tok.pos;
+
+    if (tok.type == SR_INT)
+    {
+        tok.valid = _int(p, p + tok.len, tok.num.i);
+    } else if (tok.type == SR_FLOAT)
+    {
+        tok.num.d = _float(p, p + tok.len);
+        tok.valid = true;
+    } else
+    {
+        tok.valid = false;
+    }
+}
+
+SrLexer::SrTokType SrLexer::scan(SrTokenView &tok)
+{
+    const char* const s = buffer();
+    tok.len = 0;
+    tok.escaped = tok.valid = false;
+
+    if (end == n)
+    {
+        pre = start = tok.pos = end;
+
+        return tok.type = SR_EOB;
     }
 
     if (delimit)
     {
         pre = end;
 
-        for (; end < s.size(); ++end)
+        for (; end < n; ++end)
         {
             if (s[end] == ',')
             {
@@ -46,101 +383,207 @@ SrLexer::SrToken SrLexer::next()
                 break;
             } else if (s[end] == '\n')
             {
-                start = end;
-
-                tok.first = SR_NEWLINE;
-                tok.second = s[end++];
+                start = tok.pos = end++;
+                tok.len = 1;
                 delimit = false;
 
-                return tok;
+                return tok.type = SR_NEWLINE;
             }
         }
     }
 
     pre = end;
 
-    for (; end < s.size() && !isgraph(s[end]) && s[end] != '\n'; ++end)
+    for (; end < n && !_graph(s[end]) && s[end] != '\n'; ++end)
     {
     }
 
     start = end;
-    bool escape = false;
-    size_t digits = 0, others = 0, dots = 0;
+    const bool quoted = end < n && s[end] == '"';
+    bool escape = quoted;
+    unsigned int seen = 0, dots = 0;
 
-    if (s[end] == '"')
+    if (quoted)
     {
-        escape = true;
         ++end;
-    } else if (s[end] == '+' || s[end] == '-')
+    } else if (end < n && (s[end] == '+' || s[end] == '-'))
     {
-        tok.second += s[end++];
+        ++end;
     }
 
-    for (; isprint(s[end]) || escape; ++end)
+    tok.pos = quoted ? start + 1 : start;
+
+    if (quoted)
     {
-        if (isdigit(s[end]))
-        {
-            ++digits;
-        } else if (s[end] == '.')
+        while ((end = _run(s, end, n, true, seen, dots)) < n)
         {
-            ++dots;
-        } else if (s[end] == '"')
-        {
-            if (!escape)
+            if (end + 1 < n && s[end + 1] == '"')
             {
-                break;
-            }
-
-            ++end;
-
-            if (s[end] == '"')
-            {
-                ++others;
+                end += 2;
+                seen |= _O;
+                tok.escaped = true;
             } else
             {
+                ++end;
                 escape = false;
                 break;
             }
-        } else if (s[end] == ',' || s[end] == '\n')
-        {
-            if (escape)
-            {
-                ++others;
-            }
-            else
-            {
-                break;
-            }
-        } else
-        {
-            ++others;
         }
-
-        tok.second += s[end];
+    } else
+    {
+        end = _run(s, end, n, false, seen, dots);
     }
 
+    // a closed quoted value ends before the closing double quote
+    tok.len = (quoted && !escape ? end - 1 : end) - tok.pos;
+    delimit = true;
+
     if (escape)
     {
-        tok.first = SR_ERROR;
+        tok.type = SR_ERROR;
     }
-    else if (others || dots > 1)
+    else if ((seen & _O) || dots > 1)
     {
-        tok.first = SR_STRING;
+        tok.type = SR_STRING;
     }
     else if (dots)
     {
-        tok.first = digits ? SR_FLOAT : SR_STRING;
+        tok.type = seen & _D ? SR_FLOAT : SR_STRING;
     }
-    else if (digits)
+    else if (seen & _D)
     {
-        tok.first = SR_INT;
+        tok.type = SR_INT;
     }
     else
     {
-        tok.first = tok.second.empty() ? SR_NONE : SR_STRING;
+        tok.type = tok.len ? SR_STRING : SR_NONE;
     }
 
-    delimit = true;
+    if (tok.type == SR_INT || tok.type == SR_FLOAT)
+    {
+        number(s, tok);
+    }
+
+    return tok.type;
+}
+
+SrLexer::SrToken SrLexer::next()
+{
+    SrTokenView v;
+    SrLexer::SrToken tok;
+
+    tok.first = scan(v);
+    assign(tok.second, buffer(), v);
 
     return tok;
 }
+
+void SrLexer::assign(string &out, const char *buf, const SrTokenView &tok)
+{
+    const char *p = buf + tok.pos;
+    const char* const e = p + tok.len;
+
+    if (!tok.escaped)
+    {
+        out.assign(p, e);
+        return;
+    }
+
+    out.clear();
+
+    while (p < e)
+    {
+        const char *q = (const char*) memchr(p, '"', e - p);
+        if (q == NULL)
+        {
+            out.append(p, e);
+            break;
+        }
+
+        // keep the first of the two double quotes
+        out.append(p, q + 1);
+        p = q + 2;
+    }
+}
+
+SrRecord &SrRecord::operator=(const SrRecord &r)
+{
+    if (this == &r)
+    {
+        return *this;
+    }
+
+    // copy only the span of the buffer referenced by the tokens
+    size_t lo = r.data.empty() ? 0 : r.data.front().pos, hi = lo;
+    for (size_t i = 0; i < r.data.size(); ++i)
+    {
+        lo = min(lo, r.data[i].pos);
+        hi = max(hi, r.data[i].pos + r.data[i].len);
+    }
+
+    own.assign(r.base() + lo, hi - lo);
+    buf = NULL;
+    data = r.data;
+    cache.clear();
+
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i].pos -= lo;
+    }
+
+    return *this;
+}
+
+void SrRecord::push_back(SrLexer::SrToken &tok)
+{
+    if (buf)
+    {   // take over the values before appending to the owned buffer
+        *this = SrRecord(*this);
+    }
+
+    SrLexer::SrTokenView v;
+    v.type = tok.first;
+    v.pos = own.size();
+    v.len = tok.second.size();
+    v.escaped = false;
+
+    own += tok.second;
+    SrLexer::number(own.data(), v);
+    data.push_back(v);
+}
+
+const SrLexer::SrToken &SrRecord::operator[](size_t i) const
+{
+    if (cache.size() < data.size())
+    {
+        cache.resize(data.size(), SrLexer::SrToken(SrLexer::SR_EOB, ""));
+    }
+
+    // SR_EOB never appears in a record, it marks a token not yet copied
+    SrLexer::SrToken &tok = cache[i];
+    if (tok.first == SrLexer::SR_EOB)
+    {
+        tok.first = data[i].type;
+        SrLexer::assign(tok.second, base(), data[i]);
+    }
+
+    return tok;
+}
+
+int SrRecord::asDouble(size_t i, double &v) const
+{
+    const SrLexer::SrTokenView &t = data[i];
+
+    if (t.type == SrLexer::SR_FLOAT)
+    {
+        v = t.num.d;
+    } else if (t.type == SrLexer::SR_INT)
+    {   // integers beyond int64_t are still valid doubles
+        v = t.valid ? (double) t.num.i : _float(raw(i), raw(i) + t.len);
+    } else
+    {
+        return -1;
+    }
+
+    return 0;
+}
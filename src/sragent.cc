@@ -19,7 +19,13 @@
  */
 
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <deque>
 #include <signal.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <curl/curl.h>
 #include <sragent.h>
 #include <srlogger.h>
@@ -39,15 +45,33 @@ static void ignoreSignal(int sig)
 }
 
 SrAgent::SrAgent(const string &_server, const string &deviceid, SrIntegrate *igt, SrBootstrap *boot) :
-        _server(_server), did(deviceid), pboot(boot), pigt(igt)
+        tq(new SrTimerHeap), _server(_server), did(deviceid), mxid(0),
+        pboot(boot), pigt(igt), exec(NULL), efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
 {
     curl_global_init(CURL_GLOBAL_DEFAULT);
     ignoreSignal(SIGPIPE);
+
+    if (efd == -1)
+    {
+        srError("agent: eventfd: " + string(strerror(errno)));
+    }
+
+    tq->setWakeup(efd);
+    ingress.setNotify(efd);
+    egress.setLanes(SR_PRIO_LANES, srNewsLane);
 }
 
 
 SrAgent::~SrAgent()
 {
+    ingress.setNotify(-1);
+    tq.reset();
+
+    if (efd != -1)
+    {
+        close(efd);
+    }
+
     curl_global_cleanup();
 }
 
@@ -86,6 +110,7 @@ int SrAgent::integrate(const string &srv, const string &srt)
     {
         xid = pigt->XID();
         id = pigt->ID();
+        mxid = strtoul(xid.c_str(), NULL, 10);
     }
 
     return c;
@@ -96,95 +121,279 @@ int SrAgent::send(const SrNews &news)
     return egress.put(news);
 }
 
-static string _com(const uint32_t xid, const string &id)
+int SrAgent::send(SrNews &&news)
 {
-    return id + "@" + to_string(xid);
+    return egress.put(std::move(news));
 }
 
-void SrAgent::processMessages()
+void SrAgent::setTimerQueue(SrTimerQueue *queue)
 {
-    SrQueue<SrOpBatch>::Event e = ingress.get(0);   // wait time here will block main loop!
+    std::unique_ptr<SrTimerQueue> old(tq.release());
+    tq.reset(queue);
+    tq->setWakeup(efd);
+    old->moveTo(*tq);
+}
 
-    if (e.second != SrQueue<SrOpBatch>::Q_OK)
+void SrAgent::dispatch(SrMsgHandler *h, SrRecord &r)
+{
+    if (exec)
     {
-        return;
+        const int c = exec->submit(h, [this, h, r]() mutable
+        {
+            (*h)(r, *this);
+        });
+
+        if (c == 0)
+        {
+            return;
+        }
+
+        // never drop an operation, run it here instead
+        srError("agent: executor not running, handler " + r.value(0)
+                + " runs on the agent thread");
     }
 
-    const MsgXID m = strtoul(xid.c_str(), NULL, 10);
-    MsgXID c = m;
-    SmartRest sr(e.first.data);
+    (*h)(r, *this);
+}
 
-    for (SrRecord r = sr.next(); r.size(); r = sr.next())
+void SrAgent::fire(SrTimer *t)
+{
+    if (exec)
     {
-        const MsgID j = strtoul(r[0].second.c_str(), NULL, 10);
+        const int c = exec->submit(t, [this, t]()
+        {
+            t->run(*this);
 
-        if (j == 87)
-        {   // multiple response lines
+            if (!t->isPeriodic() && t->isActive())
+            {
+                t->start();
+            }
+        });
 
-            c = strtoul(r[2].second.c_str(), NULL, 10);
-        } else if (c == m)
+        if (c == 0)
         {
-            _Handler::iterator it = handlers.find(j);
+            return;
+        }
 
-            if (it != handlers.end() && it->second)
-            {
-                srDebug("Trigger Msg " + r[0].second);
-                (*it->second)(r, *this);
-#ifdef DEBUG
-            } else
+        srError("agent: executor not running, timer runs on the agent thread");
+    }
+
+    t->run(*this);
+
+    // start timer again, if still active
+    if (!t->isPeriodic() && t->isActive())
+    {
+        t->start();
+    }
+}
+
+static string _com(const uint32_t xid, const string &id)
+{
+    return id + "@" + to_string(xid);
+}
+
+void SrAgent::MsgTable::set(MsgID id, SrMsgHandler *h)
+{
+    std::unique_ptr<SrMsgHandler*[]> &p = pages[id >> 8];
+    if (!p)
+    {
+        if (h == NULL)
+        {
+            return;
+        }
+
+        p.reset(new SrMsgHandler*[256]());
+    }
+
+    p[id & 0xff] = h;
+}
+
+const uint64_t SrAgent::XMsgTable::EMPTY;
+
+void SrAgent::XMsgTable::set(MsgXID xid, MsgID id, SrMsgHandler *h)
+{
+    if (2 * (n + 1) > slots.size())
+    {   // grow and rehash, keeping the table at most half full
+        std::vector<_Slot> old(std::max((size_t) 16, 2 * slots.size()),
+                _Slot(EMPTY, NULL));
+        old.swap(slots);
+        n = 0;
+
+        for (auto &e : old)
+        {
+            if (e.first != EMPTY)
             {
-                srDebug("Drop Msg " + r[0].second);
-#endif
+                set(e.first >> 16, e.first & 0xffff, e.second);
             }
-        } else
+        }
+    }
+
+    const uint64_t k = key(xid, id);
+    const size_t mask = slots.size() - 1;
+    size_t i = hash(k) & mask;
+    while (slots[i].first != EMPTY && slots[i].first != k)
+    {
+        i = (i + 1) & mask;
+    }
+
+    if (slots[i].first == EMPTY)
+    {
+        slots[i].first = k;
+        ++n;
+    }
+
+    slots[i].second = h;
+}
+
+/**
+ *  Get the i-th value of \a r as a message ID. IDs are SR_INT tokens with
+ *  the value computed by the lexer, other tokens (e.g., padded with
+ *  trailing spaces) fall back to the leading decimal digits, as strtoul.
+ */
+static uint32_t _num(const SrRecord &r, size_t i)
+{
+    uint32_t v = 0;
+    if (r.asU32(i, v) == 0)
+    {
+        return v;
+    }
+
+    const char *p = r.raw(i);
+    const char* const e = p + r.length(i);
+
+    while (p < e && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+
+    for (; p < e && *p >= '0' && *p <= '9'; ++p)
+    {
+        v = v * 10 + (*p - '0');
+    }
+
+    return v;
+}
+
+void SrAgent::processMessages()
+{
+    std::deque<SrOpBatch> batches;
+    SrRecord r;
+
+    // take all pending batches, the ingress signal is only raised again
+    // when the queue turns non-empty
+    ingress.takeAll(batches);
+
+    for (; !batches.empty(); batches.pop_front())
+    {
+        const SrOpBatch &batch = batches.front();
+
+        MsgXID c = mxid;
+        SmartRest sr(batch.data);
+
+        while (sr.next(r))
         {
-            _XHandler::iterator it = sh.find(XMsgID(c, j));
+            const MsgID j = _num(r, 0);
+
+            if (j == 87)
+            {   // multiple response lines
+
+                c = r.size() > 2 ? _num(r, 2) : 0;
+                continue;
+            }
+
+            SrMsgHandler* const h = c == mxid ? handlers.find(j) : sh.find(c, j);
 
-            if (it != sh.end() && it->second)
+            if (h)
             {
-                srDebug("Trigger Msg " + _com(c, r[0].second));
+                if (srLogIsEnabledFor(SRLOG_DEBUG))
+                {
+                    srDebug("Trigger Msg " + (c == mxid ? r[0].second : _com(c, r[0].second)));
+                }
 
-                (*it->second)(r, *this);
+                dispatch(h, r);
 #ifdef DEBUG
             } else
             {
-                srDebug("Drop Msg " + _com(c, r[0].second));
+                srDebug("Drop Msg " + (c == mxid ? r[0].second : _com(c, r[0].second)));
 #endif
             }
         }
     }
 }
 
+static void _until(const timespec &deadline, timespec &timeout)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (deadline <= now)
+    {
+        timeout.tv_sec = timeout.tv_nsec = 0;
+    } else
+    {
+        timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+
+        if (timeout.tv_nsec < 0)
+        {
+            --timeout.tv_sec;
+            timeout.tv_nsec += 1000000000;
+        }
+    }
+}
+
 void SrAgent::loop()
 {
-    // SR_AGENT_VAL is given in milliseconds
-    static const timespec ts = { SR_AGENT_VAL / 1000, (SR_AGENT_VAL % 1000) * 1000000 };
+    std::vector<SrTimer*> fired;
+    pollfd pfd = { efd, POLLIN, 0 };
 
     while (true)
     {
-        // sleeps for a period of time (SR_AGENT_VAL)
-        nanosleep(&ts, NULL);
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
 
-        for (auto &i : timers)
-        {
-            timespec now;
-            clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        fired.clear();
+        tq->expired(now, fired);
 
-            // check, if timer exceeds fire time
-            if (i->isActive() && (i->fireTime() <= now))
+        for (auto &i : fired)
+        {
+            // a previous callback may have stopped the timer
+            if (!i->isActive())
             {
-                // execute timer method
-                i->run(*this);
+                continue;
+            } else if (!i->isPeriodic() || i->rearm(now))
+            {
+                // a periodic timer schedules its next period first, the
+                // callback may still stop or restart the timer
+                fire(i);
+            }
+        }
+
+        // process incoming messages
+        processMessages();
+
+        // sleep until the earliest fire time, a new ingress batch or an
+        // earlier timer started by another thread
+        timespec deadline, timeout;
+        const bool timed = tq->wait(deadline);
 
-                // start timer again, if still active
-                if (i->isActive())
+        if (timed)
+        {
+            _until(deadline, timeout);
+        }
+
+        if (!timed || timeout.tv_sec || timeout.tv_nsec)
+        {
+            if (ppoll(&pfd, 1, timed ? &timeout : NULL, NULL) > 0)
+            {
+                uint64_t v = 0;
+                if (read(efd, &v, sizeof(v)) == -1)
                 {
-                    i->start();
+                    // already reset
                 }
             }
         }
 
-        // process incoming messages
-        processMessages();
+        tq->awake();
     }
 }
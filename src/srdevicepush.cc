@@ -39,7 +39,8 @@ static const char* SERVER_PATH_NOTIFICATIONS = "/devicecontrol/notifications";
 
 SrDevicePush::SrDevicePush(const string &server, const string &xid,
         const string &auth, const string &chn, SrQueue<SrOpBatch> &queue) :
-        http(server + SERVER_PATH_NOTIFICATIONS, xid, auth), tid(0), bnum(0),
+        http(server + SERVER_PATH_NOTIFICATIONS, xid, auth), stream(*this, SR_PUSH_RECORD_MAX),
+        stale(false), tid(0), bnum(0), pnum(0),
         queue(queue), channel(chn), bayeuxState(BAYEUX_STATE_HANDSHAKE)
 {
 }
@@ -145,7 +146,7 @@ void *SrDevicePush::func(void *arg)
                         err += to_string(push->http.errNo);
                     } else
                     {
-                        err = "1," + push->http.response();
+                        err += "1," + push->http.response();
                     }
 
                     srWarning("push: connect failed!");
@@ -154,15 +155,6 @@ void *SrDevicePush::func(void *arg)
 
                     // wait some time for retry
                     ::sleep(WAIT_TIME_AFTER_FAIL);
-                } else
-                {
-                    SrOpBatch b(push->http.response());
-                    push->process(b.data);
-
-                    if (!push->isSleeping())
-                    {
-                        push->queue.put(b);
-                    }
                 }
             }
         }
@@ -222,43 +214,70 @@ int SrDevicePush::connect()
         bayeuxState = BAYEUX_STATE_CONNECT;
     }
 
-    if (http.post("83," + bayeuxID + bstring) < 0)
-    {
+    // operations are put into the ingress queue while they arrive
+    batch.clear();
+    xctx.clear();
+    pnum = 0;
+    http.setStream(&stream);
+    const int c = http.post("83," + bayeuxID + bstring);
+    http.setStream(NULL);
+
+    if (c < 0)
+    {   // operations of a partial chunk are not acknowledged
+        stream.reset();
+        batch.clear();
+        xctx.clear();
+
         return -1;
     }
 
+    // all operations of the response are queued by now
+    if (pnum)
+    {
+        bnum = pnum;
+    }
+
     return 0;
 }
 
-void SrDevicePush::process(string &s)
+void SrDevicePush::operator()(SrRecord &r, const char *raw, size_t len)
 {
-    SmartRest sr(s);
-    size_t p1 = string::npos, p2 = string::npos, s1 = 0, s2 = 0;
+    const string &id = r[0].second;
 
-    for (SrRecord r = sr.next(); r.size(); r = sr.next())
+    if (id == "88")
     {
-        if (r[0].second == "88")
+        int64_t n = 0;
+        if (r.size() > 1 && r.asInt(1, n) == 0)
+        {   // acknowledged with the next connect, if the transfer completes
+            pnum = n;
+        }
+    } else if (id == "86")
+    {   // Settings advice for the client using SmartREST real-time notifications.
+        // timeout,interval,reconnect policy
+
+        bayeuxState = r.size() > 4 && r[4].second == "retry" ? BAYEUX_STATE_CONNECT : BAYEUX_STATE_HANDSHAKE; // none, retry, handshake
+    } else if (id == "87")
+    {   // multiple response lines, repeated in front of every later chunk
+        xctx.assign(raw, len);
+        stale = true;
+    } else
+    {
+        if (!xctx.empty() && (stale || batch.empty()))
         {
-            p1 = sr.pre;
-            bnum = strtoul(r[1].second.c_str(), NULL, 10);
-            s1 = sr.end - p1;
-        } else if (r[0].second == "86")
-        {   // Settings advice for the client using SmartREST real-time notifications.
-            // timeout,interval,reconnect policy
-
-            p2 = sr.pre;
-            bayeuxState = r[4].second == "retry" ? BAYEUX_STATE_CONNECT : BAYEUX_STATE_HANDSHAKE; // none, retry, handshake
-            s2 = sr.end - p2;
+            batch += xctx;
+            stale = false;
         }
-    }
 
-    if (p2 != string::npos)
-    {
-        s.erase(p2, s2);
+        batch.append(raw, len);
     }
+}
 
-    if (p1 != string::npos)
+void SrDevicePush::flush()
+{
+    if (!batch.empty() && !isSleeping())
     {
-        s.erase(p1, s1);
+        queue.put(SrOpBatch(std::move(batch)));
     }
+
+    batch.clear();
 }
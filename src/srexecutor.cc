@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "srexecutor.h"
+#include "srlogger.h"
+
+using namespace std;
+
+// worker running on the current thread, for scheduling to its own deque
+static __thread const SrExecutor *_exec = NULL;
+static __thread size_t _index = 0;
+
+static uint64_t _since(const timespec &t0, timespec &t1)
+{
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (t1.tv_sec - t0.tv_sec) * 1000000000LL + t1.tv_nsec - t0.tv_nsec;
+}
+
+static void _max(atomic<uint64_t> &m, uint64_t v)
+{
+    uint64_t cur = m.load(memory_order_relaxed);
+    while (cur < v && !m.compare_exchange_weak(cur, v, memory_order_relaxed))
+    {
+        // retry
+    }
+}
+
+SrExecutor::SrExecutor(size_t n) :
+        next(0), running(false), submitted(0), completed(0), stolen(0),
+        maxDepth(0), waitTotal(0), waitMax(0), runTotal(0), runMax(0)
+{
+    mutex = PTHREAD_MUTEX_INITIALIZER;
+    memset(&sem, 0, sizeof(sem));
+    sem_init(&sem, 0, 0);
+
+    for (size_t i = 0; i < (n ? n : 1); ++i)
+    {
+        workers.emplace_back(new _Worker);
+        workers.back()->exec = this;
+        workers.back()->index = i;
+        workers.back()->mutex = PTHREAD_MUTEX_INITIALIZER;
+    }
+}
+
+SrExecutor::~SrExecutor()
+{
+    stop();
+
+    for (auto &w : workers)
+    {
+        pthread_mutex_destroy(&w->mutex);
+    }
+
+    sem_destroy(&sem);
+    pthread_mutex_destroy(&mutex);
+}
+
+int SrExecutor::start()
+{
+    running = true;
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        const int c = pthread_create(&workers[i]->tid, NULL, func, workers[i].get());
+
+        if (c)
+        {
+            srError("executor: start failed, " + string(strerror(c)));
+            workers.resize(i);
+            stop();
+
+            return c;
+        }
+    }
+
+    return 0;
+}
+
+void SrExecutor::stop()
+{
+    // under the mutex, so no submit() succeeds after this point
+    pthread_mutex_lock(&mutex);
+    const bool was = running.exchange(false);
+    pthread_mutex_unlock(&mutex);
+
+    if (!was)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        sem_post(&sem);
+    }
+
+    for (auto &w : workers)
+    {
+        pthread_join(w->tid, NULL);
+    }
+}
+
+int SrExecutor::submit(const void *key, Task &&task)
+{
+    if (!running)
+    {
+        return -1;
+    }
+
+    _Job job = { std::move(task), timespec() };
+    clock_gettime(CLOCK_MONOTONIC, &job.t);
+
+    pthread_mutex_lock(&mutex);
+
+    if (!running)
+    {   // stopped since the check above, no worker would run the job
+        pthread_mutex_unlock(&mutex);
+        return -1;
+    }
+
+    // a strand exists while it is scheduled, i.e., has jobs
+    unique_ptr<_Strand> &s = strands[key];
+    const bool idle = !s;
+    if (idle)
+    {
+        auto it = kstats.find(key);
+        if (it == kstats.end())
+        {
+            it = kstats.emplace(key, SrExecutorStats()).first;
+            memset(&it->second, 0, sizeof(it->second));
+        }
+
+        s.reset(new _Strand);
+        s->key = key;
+        s->stats = &it->second;
+    }
+
+    s->jobs.push_back(std::move(job));
+    SrExecutorStats &ks = *s->stats;
+    ks.depth = ++ks.submitted - ks.completed;
+    ks.maxDepth = max(ks.maxDepth, ks.depth);
+    _Strand* const strand = s.get();
+
+    pthread_mutex_unlock(&mutex);
+
+    const uint64_t depth = ++submitted - completed;
+    _max(maxDepth, depth);
+
+    if (idle)
+    {
+        schedule(strand, _exec == this ? _index : next++ % workers.size());
+    }
+
+    return 0;
+}
+
+SrExecutorStats SrExecutor::stats() const
+{
+    SrExecutorStats s;
+    s.completed = completed;
+    s.submitted = submitted;
+    s.stolen = stolen;
+    s.depth = s.submitted > s.completed ? s.submitted - s.completed : 0;
+    s.maxDepth = maxDepth;
+    s.waitTotal = waitTotal;
+    s.waitMax = waitMax;
+    s.runTotal = runTotal;
+    s.runMax = runMax;
+
+    return s;
+}
+
+SrExecutorStats SrExecutor::stats(const void *key) const
+{
+    SrExecutorStats s;
+    memset(&s, 0, sizeof(s));
+
+    pthread_mutex_lock(&mutex);
+    auto it = kstats.find(key);
+    if (it != kstats.end())
+    {
+        s = it->second;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return s;
+}
+
+void SrExecutor::schedule(_Strand *s, size_t worker)
+{
+    _Worker &w = *workers[worker];
+
+    pthread_mutex_lock(&w.mutex);
+    w.ready.push_back(s);
+    pthread_mutex_unlock(&w.mutex);
+
+    sem_post(&sem);
+}
+
+SrExecutor::_Strand *SrExecutor::take(size_t worker)
+{
+    _Strand *s = NULL;
+    _Worker &own = *workers[worker];
+
+    pthread_mutex_lock(&own.mutex);
+    if (!own.ready.empty())
+    {
+        s = own.ready.front();
+        own.ready.pop_front();
+    }
+    pthread_mutex_unlock(&own.mutex);
+
+    for (size_t i = 1; s == NULL && i < workers.size(); ++i)
+    {
+        _Worker &w = *workers[(worker + i) % workers.size()];
+
+        pthread_mutex_lock(&w.mutex);
+        if (!w.ready.empty())
+        {
+            s = w.ready.back();
+            w.ready.pop_back();
+            ++stolen;
+        }
+        pthread_mutex_unlock(&w.mutex);
+    }
+
+    return s;
+}
+
+void SrExecutor::run(_Strand *s, size_t worker)
+{
+    pthread_mutex_lock(&mutex);
+    _Job job = std::move(s->jobs.front());
+    s->jobs.pop_front();
+    pthread_mutex_unlock(&mutex);
+
+    timespec t1, t2;
+    const uint64_t wait = _since(job.t, t1);
+    waitTotal += wait;
+    _max(waitMax, wait);
+
+    job.task();
+
+    const uint64_t rt = _since(t1, t2);
+    runTotal += rt;
+    _max(runMax, rt);
+    ++completed;
+
+    // the strand stays scheduled while it has jobs, so the next job of the
+    // same key cannot start before this one has finished, an idle strand
+    // is released
+    pthread_mutex_lock(&mutex);
+    SrExecutorStats &ks = *s->stats;
+    ks.depth = ++ks.completed < ks.submitted ? ks.submitted - ks.completed : 0;
+    ks.waitTotal += wait;
+    ks.waitMax = max(ks.waitMax, wait);
+    ks.runTotal += rt;
+    ks.runMax = max(ks.runMax, rt);
+    const bool more = !s->jobs.empty();
+    if (!more)
+    {
+        strands.erase(s->key);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (more)
+    {
+        schedule(s, worker);
+    }
+}
+
+void *SrExecutor::func(void *arg)
+{
+    _Worker* const w = (_Worker*) arg;
+    SrExecutor* const exec = w->exec;
+    _exec = exec;
+    _index = w->index;
+
+    while (true)
+    {
+        sem_wait(&exec->sem);
+
+        if (!exec->running)
+        {
+            break;
+        }
+
+        // every post follows a push, so some deque holds a strand for
+        // each woken worker, unless the executor is stopping
+        _Strand* const s = exec->take(w->index);
+        if (s)
+        {
+            exec->run(s, w->index);
+        }
+    }
+
+    return NULL;
+}
@@ -69,7 +69,11 @@ void SrLuaPluginManager::operator()(SrRecord &r, SrAgent &agent)
 {
     UNUSED(agent);
 
-    SrAgent::MsgID j = strtoul(r[0].second.c_str(), NULL, 10);
+    uint32_t j = 0;
+    if (r.asU32(0, j))
+    {
+        j = strtoul(r[0].second.c_str(), NULL, 10);
+    }
     _Handler::const_iterator it = handlers.find(j);
     if (it != handlers.end())
     {
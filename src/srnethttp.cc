@@ -19,6 +19,7 @@
  */
 
 #include <srnethttp.h>
+#include <srstreamparser.h>
 #include <srlogger.h>
 
 using namespace std;
@@ -68,6 +69,17 @@ static size_t writeFunc(void *ptr, size_t size, size_t nmemb, void *data)
     return n;
 }
 
+size_t SrNetHttp::writeStream(void *ptr, size_t size, size_t nmemb,
+        void *data)
+{
+    SrNetHttp* const http = (SrNetHttp*) data;
+    const size_t n = size * nmemb;
+    http->rx += n;
+
+    // a short count aborts the transfer with CURLE_WRITE_ERROR
+    return http->stream->feed((const char *) ptr, n) == -1 ? 0 : n;
+}
+
 static curl_slist *_init(const string &xid, const string &auth)
 {
     curl_slist *chunk = curl_slist_append(NULL, "Accept:");
@@ -85,7 +97,7 @@ static curl_slist *_init(const string &xid, const string &auth)
 
 SrNetHttp::SrNetHttp(const std::string &server, const std::string &xid,
         const std::string &auth) :
-        SrNetInterface(server), chunk(NULL)
+        SrNetInterface(server), chunk(NULL), stream(NULL), rx(0), multi(NULL)
 {
     chunk = _init(xid, auth);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
@@ -106,13 +118,43 @@ SrNetHttp::SrNetHttp(const std::string &server, const std::string &xid,
 
 SrNetHttp::~SrNetHttp()
 {
+    for (auto e : easy)
+    {
+        curl_easy_cleanup(e);
+    }
+
+    if (multi)
+    {
+        curl_multi_cleanup(multi);
+    }
+
     curl_slist_free_all(chunk);
 }
 
+void SrNetHttp::setStream(SrStreamParser *sp)
+{
+    stream = sp;
+
+    if (stream)
+    {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeStream);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+    } else
+    {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunc);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
+    }
+}
+
 int SrNetHttp::post(const std::string &request)
 {
-    srDebug("HTTP post: " + request);
+    if (srLogIsEnabledFor(SRLOG_DEBUG))
+    {
+        srDebug("HTTP post: " + request);
+    }
+
     timespec tv = { 0, 0 };
+    rx = 0;
 
     clock_gettime(CLOCK_MONOTONIC_COARSE, &tv);
     meter.first = meter.second = tv.tv_sec;
@@ -122,15 +164,111 @@ int SrNetHttp::post(const std::string &request)
 
     if (errNo == CURLE_OK)
     {
-        srDebug("HTTP recv: " + resp);
         long status;
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
         statusCode = status;
+
+        if (stream)
+        {
+            srDebug("HTTP recv: " + to_string(rx) + " bytes streamed");
+            stream->finish();
+
+            return rx;
+        }
+
+        srDebug("HTTP recv: " + resp);
         return resp.size();
     } else
     {
+        if (stream)
+        {
+            resp = stream->rest();
+            stream->reset();
+        }
+
         srError(string("HTTP post: ") + _errMsg);
 
         return -1;
     }
 }
+
+int SrNetHttp::post(const std::string *reqs, size_t n, vector<int> &status,
+        vector<string> &resps)
+{
+    if (multi == NULL && (multi = curl_multi_init()) == NULL)
+    {
+        srError("HTTP post: multi init failed");
+        return -1;
+    }
+
+    // handles duplicate all options of the main handle, e.g. headers
+    for (CURL *e = NULL; easy.size() < n; easy.push_back(e))
+    {
+        if ((e = curl_easy_duphandle(curl)) == NULL)
+        {
+            srError("HTTP post: duphandle failed");
+            return -1;
+        }
+        share(e);
+    }
+
+    status.assign(n, -1);
+    resps.resize(n);
+    timespec tv = { 0, 0 };
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &tv);
+    meter.first = meter.second = tv.tv_sec;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        resps[i].clear();
+        curl_easy_setopt(easy[i], CURLOPT_WRITEFUNCTION, writeFunc);
+        curl_easy_setopt(easy[i], CURLOPT_WRITEDATA, &resps[i]);
+        curl_easy_setopt(easy[i], CURLOPT_POSTFIELDS, reqs[i].c_str());
+        curl_easy_setopt(easy[i], CURLOPT_POSTFIELDSIZE, reqs[i].size());
+        curl_easy_setopt(easy[i], CURLOPT_PRIVATE, (char*) (uintptr_t) i);
+        curl_multi_add_handle(multi, easy[i]);
+    }
+
+    int running = 0, c = 0;
+    do
+    {
+        if (curl_multi_perform(multi, &running) != CURLM_OK)
+        {
+            break;
+        } else if (running)
+        {
+            curl_multi_wait(multi, NULL, 0, 1000, NULL);
+        }
+    } while (running);
+
+    int left = 0;
+    for (CURLMsg *m = NULL; (m = curl_multi_info_read(multi, &left));)
+    {
+        char *p = NULL;
+        if (m->msg != CURLMSG_DONE || curl_easy_getinfo(m->easy_handle,
+                CURLINFO_PRIVATE, &p) != CURLE_OK)
+        {
+            continue;
+        }
+
+        const size_t i = (uintptr_t) p;
+        if (m->data.result == CURLE_OK)
+        {
+            status[i] = resps[i].size();
+            ++c;
+        } else
+        {
+            srError("HTTP post: " + to_string(i) + ": "
+                    + curl_easy_strerror(m->data.result));
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        curl_multi_remove_handle(multi, easy[i]);
+    }
+
+    srDebug("HTTP post: " + to_string(c) + "/" + to_string(n) + " succeeded");
+
+    return c;
+}
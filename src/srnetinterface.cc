@@ -19,11 +19,75 @@
  */
 
 #include <string>
+#include <mutex>
 #include <srnetinterface.h>
 #include "srlogger.h"
 
+#ifndef SR_CURL_SHARE
+#define SR_CURL_SHARE 1
+#endif
+#ifndef SR_CURL_KEEPIDLE
+#define SR_CURL_KEEPIDLE 60
+#endif
+#ifndef SR_CURL_KEEPINTVL
+#define SR_CURL_KEEPINTVL 20
+#endif
+#ifndef SR_CURL_MAXAGE
+#define SR_CURL_MAXAGE 110
+#endif
+
 using namespace std;
 
+/**
+ *  \class _CurlShare
+ *  \brief libcurl share handle with the locks libcurl requires for using it
+ *  from several threads.
+ *
+ *  Only DNS entries and TLS sessions are shared. The connection cache is
+ *  not: libcurl supports sharing it between threads only since 7.68, and
+ *  the reporter, device push and agent threads use their handles
+ *  concurrently. Each handle (and each multi handle) reuses connections
+ *  from its own cache instead, a new handle to the same host resumes the
+ *  shared TLS session.
+ */
+class _CurlShare
+{
+public:
+    _CurlShare() : sh(curl_share_init())
+    {
+        if (sh == NULL)
+        {
+            srWarning("Net: share init failed");
+            return;
+        }
+
+        curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, lock);
+        curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, unlock);
+        curl_share_setopt(sh, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    CURLSH *sh;
+
+private:
+
+    static void lock(CURL *h, curl_lock_data d, curl_lock_access a, void *p)
+    {
+        (void) h;
+        (void) a;
+        ((_CurlShare*) p)->mtx[d].lock();
+    }
+
+    static void unlock(CURL *h, curl_lock_data d, void *p)
+    {
+        (void) h;
+        ((_CurlShare*) p)->mtx[d].unlock();
+    }
+
+    std::mutex mtx[CURL_LOCK_DATA_LAST];
+};
+
 SrNetInterface::SrNetInterface(const string &server) :
         errNo(0), curl(NULL), t(0)
 {
@@ -33,6 +97,11 @@ SrNetInterface::SrNetInterface(const string &server) :
     curl = curl_easy_init();
     curl_easy_setopt(curl, CURLOPT_URL, server.c_str());
     curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, _errMsg);
+    setKeepAlive(SR_CURL_KEEPIDLE, SR_CURL_KEEPINTVL);
+#if LIBCURL_VERSION_NUM >= 0x074100
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, (long) SR_CURL_MAXAGE);
+#endif
+    share(curl);
 #if SR_CURL_SIGNAL == 0
     curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
 #endif
@@ -63,6 +132,31 @@ void SrNetInterface::setTimeout(long timeout)
     srDebug("Net: setTimeout to " + to_string(timeout));
 }
 
+void SrNetInterface::setKeepAlive(long idle, long interval)
+{
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, idle ? 1L : 0L);
+    if (idle)
+    {
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, idle);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, interval);
+    }
+}
+
+void SrNetInterface::share(CURL *h)
+{
+#if SR_CURL_SHARE
+    // never destroyed: handles may outlive any static object
+    static _CurlShare *s = new _CurlShare;
+
+    if (s->sh)
+    {
+        curl_easy_setopt(h, CURLOPT_SHARE, s->sh);
+    }
+#else
+    (void) h;
+#endif
+}
+
 void SrNetInterface::setDebug(long l)
 {
     curl_easy_setopt(curl, CURLOPT_VERBOSE, l);
@@ -59,6 +59,7 @@ SrNetSocket::SrNetSocket(const string &s) :
     // dead connections consume significant mem when using SSL
     curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, 1);
     curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+    share(curl);
 }
 
 int SrNetSocket::connect()
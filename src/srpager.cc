@@ -0,0 +1,2342 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "srpager.h"
+#include "srtypes.h"
+#include "srlogger.h"
+#include "srutils.h"
+
+using namespace std;
+
+#define SR_FILEBUF_VER 0x2
+#define SR_FILEBUF_INDEX_SUFFIX ".index"
+#define SR_FILEBUF_IOV 64 // iovecs per pwritev, well below IOV_MAX
+#define SR_MEMBUF_SCALE 8
+#define SR_MEMBUF_NUM (1 << SR_MEMBUF_SCALE)
+#define SR_MEMBUF_CHUNK 16384
+#define SR_MEMBUF_XID ((uint64_t) 1 << 63) // index flag of X-ID requests
+#define SR_MEMBUF_DEAD ((uint64_t) 1 << 62) // index flag of evicted messages
+#define SR_MEMBUF_OFF (SR_MEMBUF_DEAD - 1)
+#define SR_MEMBUF_COST 16 // index bytes per message
+#define BASE_PAGE(x) (x & 0x07)
+#define BASE_VER(x) ((x >> 3) & 0x0f)
+#define _BASE (BASE_PAGE(SR_FILEBUF_PAGE_SCALE) | (SR_FILEBUF_VER << 3))
+
+#define SR_MMBUF_MAGIC 0x424d5253 // "SRMB"
+#define SR_MMBUF_VER 0x1
+
+#define SR_LOGBUF_MAGIC 0x424c5253 // "SRLB"
+#define SR_LOGBUF_VER 0x1
+#define SR_LOGBUF_FIRST 0x80000000 // record starts a batch
+#define SR_LOGBUF_SEGMENT (16 * SR_FILEBUF_PAGE_SIZE) // roll over size
+
+#define SR_LZ_HASH 12 // log2 of the match finder table size
+#define SR_LZ_MIN 4 // minimum match length
+#define SR_LZ_WINDOW 0xffff // maximum match offset
+#define SR_LZ_DICT 0x4000 // maximum dictionary size
+#define SR_ZBUF_BATCH 12288 // raw bytes per batch, below the MQTT payload limit
+#define SR_ZBUF_DICT_SUFFIX ".dict"
+
+struct _BFHead
+{
+    _BFHead() :
+            base(_BASE), flag(0), pad(0), size(0), cnt(0)
+    {
+    }
+
+    uint8_t base, flag;
+    uint16_t pad;
+    uint32_t size, cnt;
+};
+
+struct _BFPage
+{
+    _BFPage(uint32_t idx = 0, uint16_t oft = 0, uint8_t f = 0) :
+            index(idx), offset(oft), flag(f), cnt(0)
+    {
+    }
+
+    uint32_t index;
+    uint16_t offset;
+    uint8_t flag, cnt;
+};
+
+/**
+ *  Version 1 index format, with 16-bit page indices and counts.
+ */
+struct _BFHead1
+{
+    uint8_t base, flag;
+    uint16_t size, cnt, pad2;
+};
+
+struct _BFPage1
+{
+    uint16_t index, offset;
+    uint8_t flag, cnt;
+    uint16_t pad;
+};
+
+/**
+ *  Page allocation bitmap, one bit per page. All words below hint are
+ *  full, hence find() resumes where the last search stopped, and
+ *  allocation is amortized O(1).
+ */
+class _BFMap
+{
+public:
+    _BFMap() :
+            n(0), nfree(0), hint(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return n;
+    }
+
+    void grow(size_t m)
+    {
+        if (m > n)
+        {
+            words.resize((m + 63) >> 6, 0);
+            nfree += m - n;
+            n = m;
+        }
+    }
+
+    void reset(size_t m)
+    {
+        words.assign((m + 63) >> 6, 0);
+        n = nfree = m;
+        hint = 0;
+    }
+
+    void set(size_t i)
+    {
+        words[i >> 6] |= (uint64_t) 1 << (i & 63);
+        --nfree;
+    }
+
+    void clear(size_t i)
+    {
+        words[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+        ++nfree;
+        hint = min(hint, i >> 6);
+    }
+
+    /**
+     *  Lowest free page, size() if all pages are used.
+     */
+    size_t find()
+    {
+        if (nfree == 0)
+        {
+            return n;
+        }
+
+        for (; !~words[hint]; ++hint)
+        {
+            // empty
+        }
+
+        return (hint << 6) + __builtin_ctzll(~words[hint]);
+    }
+
+private:
+    std::vector<uint64_t> words;
+    size_t n, nfree, hint;
+};
+
+typedef std::deque<_BFPage> _PCB;
+
+/**
+ *  Read the index \a fn, a version 1 index is converted.
+ *  \return 1 if the index was converted, 0 otherwise.
+ */
+static int readPCB(const string &fn, _BFHead &head, _PCB &pcb, _BFMap &map)
+{
+    ifstream fs(fn, ios::binary);
+    const int base = fs.peek();
+
+    if (base == EOF)
+    {
+        return 0;
+    } else if (BASE_PAGE(base) != SR_FILEBUF_PAGE_SCALE)
+    {
+        srWarning("filebuf: page scale mismatch, discard " + fn);
+        return 0;
+    } else if (BASE_VER(base) == 1)
+    {
+        _BFHead1 h1;
+        _BFPage1 p1;
+        if (!fs.read((char*) &h1, sizeof(h1)))
+        {
+            return 0;
+        }
+
+        for (size_t i = 0; i < h1.size && fs.read((char*) &p1, sizeof(p1)); ++i)
+        {
+            pcb.emplace_back(p1.index, p1.offset, p1.flag);
+        }
+
+        head.flag = h1.flag;
+    } else if (BASE_VER(base) == SR_FILEBUF_VER && fs.read((char*) &head, sizeof(head)))
+    {
+        _BFPage page;
+        for (size_t i = 0; i < head.size && fs.read((char*) &page, sizeof(page)); ++i)
+        {
+            pcb.push_back(page);
+        }
+    } else
+    {
+        srWarning("filebuf: unknown version, discard " + fn);
+        return 0;
+    }
+
+    uint8_t flag = 2;
+    uint32_t cnt = 0;
+    for (const auto &e : pcb)
+    {
+        map.grow(e.index + 1);
+        map.set(e.index);
+        cnt += flag == e.flag ? 0 : 1;
+        flag = e.flag;
+    }
+
+    head.base = _BASE;
+    head.size = pcb.size();
+    head.cnt = cnt;
+
+    if (BASE_VER(base) == 1)
+    {
+        srInfo("filebuf: migrate " + fn + " to version " + to_string(SR_FILEBUF_VER));
+        return 1;
+    }
+
+    return 0;
+}
+
+static void writePCB(const string &fn, const _BFHead &head, _PCB &pcb)
+{
+    ofstream out(fn, ios::binary);
+    if (!out.write((const char*) &head, sizeof(head)))
+    {
+        return;
+    }
+
+    for (const auto &e : pcb)
+    {
+        if (!out.write((const char*) &e, sizeof(_BFPage)))
+        {
+            break;
+        }
+    }
+}
+
+class _BFPager: public _Pager
+{
+public:
+    _BFPager(const string &_fn, uint32_t c) :
+            _Pager(c), fn(_fn), fd(-1), sealed(false)
+    {
+        map.grow(c);
+        if (readPCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb, map))
+        {
+            writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+        }
+
+        fd = open(fn.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            srError("filebuf: open " + fn + ": " + strerror(errno));
+        }
+    }
+
+    ~_BFPager()
+    {
+        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+
+    virtual bool empty() const
+    {
+        return head.size == 0;
+    }
+
+    virtual size_t bsize() const
+    {
+        return head.cnt;
+    }
+
+    virtual size_t size() const
+    {
+        return head.size;
+    }
+
+    virtual void at(size_t k, string &s) const
+    {
+        size_t i = 0;
+        for (; i < pcb.size() && k; ++i)
+        {   // skip k batches
+            k -= i + 1 < pcb.size() && pcb[i + 1].flag != pcb[i].flag ? 1 : 0;
+        }
+
+        if (i >= pcb.size() || k)
+        {
+            return;
+        }
+
+        size_t j = i, len = 0;
+        for (const auto flag = pcb[i].flag; j < pcb.size() && flag == pcb[j].flag; ++j)
+        {
+            len += pcb[j].offset + 1;
+        }
+
+        // one pread per run of consecutive pages, all but the last page
+        // of a batch are full, hence a run is contiguous in the file
+        const size_t n0 = s.size();
+        s.resize(n0 + len);
+        for (size_t n = n0; i < j;)
+        {
+            const size_t b = i;
+            size_t m = pcb[i].offset + 1;
+            for (++i; i < j && pcb[i].index == pcb[i - 1].index + 1
+                    && pcb[i - 1].offset + 1 == SR_FILEBUF_PAGE_SIZE; ++i)
+            {
+                m += pcb[i].offset + 1;
+            }
+
+            const off_t off = (off_t) pcb[b].index * SR_FILEBUF_PAGE_SIZE;
+            if (pread(fd, &s[n], m, off) != (ssize_t) m)
+            {
+                s.resize(n0);
+                break;
+            }
+
+            n += m;
+        }
+    }
+
+    virtual void pop_front()
+    {
+        const auto flag = pcb.front().flag;
+        size_t i = 0;
+        for (; i < pcb.size() && pcb[i].flag == flag; ++i)
+        {
+            map.clear(pcb[i].index);
+        }
+
+        pcb.erase(pcb.begin(), pcb.begin() + i);
+        head.size = pcb.size();
+        --head.cnt;
+        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+    }
+
+    virtual int emplace_back(const char *base, const _Spans &v)
+    {
+        const auto sz = SR_FILEBUF_PAGE_SIZE;
+        size_t len = 0;
+        for (const auto &e : v)
+        {
+            len += e.len;
+        }
+
+        if (len == 0)
+        {
+            return 0;
+        } else if (pcb.empty() || sealed || len + pcb.back().offset + 1 > sz)
+        {
+            sealed = false;
+            return push_back(base, v, len);
+        }
+
+        auto &t = pcb.back();
+        size_t k = 0, used = 0;
+        const off_t off = (off_t) t.index * sz + t.offset + 1;
+        if (gather(base, v, k, used, len, off) == -1)
+        {
+            return -1;
+        }
+
+        t.offset += len;
+        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+
+        return 0;
+    }
+
+    virtual void seal()
+    {
+        sealed = true;
+    }
+
+    virtual void clear()
+    {
+        pcb.clear();
+        head.size = head.cnt = 0;
+        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+        const auto c = cap;
+
+        map.reset(max<size_t>(c, map.size()));
+
+        if (c < map.size())
+        {
+            const int success = truncate(fn.c_str(), c * SR_FILEBUF_PAGE_SIZE);
+
+            if (0 == success)
+            {
+                map.reset(c);
+                srInfo("filebuf: truncate " + to_string(c));
+            }
+        }
+    }
+
+private:
+
+    /**
+     *  Write the spans \a v of \a base as a new batch. All pages are
+     *  allocated first, then each run of consecutive pages is written with
+     *  one pwritev(), gathering the spans directly from \a base.
+     */
+    int push_back(const char *base, const _Spans &v, size_t len)
+    {
+        const auto _cap = cap;
+        const size_t sz = SR_FILEBUF_PAGE_SIZE;
+        map.grow(_cap);
+
+        if (fd == -1 || _cap == 0)
+        {
+            return -1;
+        } else if (len > (size_t) _cap * sz)
+        {
+            srError("filebuf: batch exceeds capacity, truncated.");
+            len = (size_t) _cap * sz;
+        }
+
+        const uint8_t flag = (pcb.empty() || pcb.back().flag) ? 0 : 1;
+        const size_t np = (len + sz - 1) / sz;
+        pages.clear();
+        for (size_t i = 0; i < np; ++i)
+        {
+            pages.push_back(get_free_page());
+            map.set(pages.back());
+        }
+
+        size_t k = 0, used = 0;
+        for (size_t i = 0, rest = len; i < np;)
+        {
+            const size_t b = i;
+            for (++i; i < np && pages[i] == pages[i - 1] + 1; ++i)
+            {
+                // coalesce consecutive pages
+            }
+
+            const size_t n = min(rest, (i - b) * sz);
+            if (gather(base, v, k, used, n, (off_t) pages[b] * sz) == -1)
+            {   // keep the index consistent, pages are released
+                for (const auto e : pages)
+                {
+                    map.clear(e);
+                }
+
+                return -1;
+            }
+
+            rest -= n;
+        }
+
+        for (size_t i = 0, rest = len; i < np; ++i, rest -= sz)
+        {
+            pcb.emplace_back(pages[i], min(rest, sz) - 1, flag);
+        }
+
+        head.size = pcb.size();
+        ++head.cnt;
+        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+
+        return 0;
+    }
+
+    /**
+     *  Write \a n bytes of the spans \a v of \a base, starting at span \a k
+     *  with \a used bytes already written, at file offset \a off. The
+     *  cursor (k, used) is advanced past the written bytes.
+     */
+    int gather(const char *base, const _Spans &v, size_t &k, size_t &used,
+            size_t n, off_t off)
+    {
+        while (n)
+        {
+            iovec iov[SR_FILEBUF_IOV];
+            size_t m = 0;
+            int c = 0;
+
+            for (; n && c < SR_FILEBUF_IOV; ++c)
+            {
+                const size_t l = min(n, v[k].len - used);
+                iov[c].iov_base = (void*) (base + v[k].pos + used);
+                iov[c].iov_len = l;
+                m += l;
+                n -= l;
+                used += l;
+                if (used == v[k].len)
+                {
+                    ++k;
+                    used = 0;
+                }
+            }
+
+            if (pwritev(fd, iov, c, off) != (ssize_t) m)
+            {
+                srError("filebuf: write " + fn + ": " + strerror(errno));
+                return -1;
+            }
+
+            off += m;
+        }
+
+        return 0;
+    }
+
+    uint32_t get_free_page()
+    {
+        uint32_t index = map.find();
+        if (index >= cap || index >= map.size())
+        {   // pages beyond a shrunk capacity are not re-used
+            index = pcb.front().index;
+            evict();
+        }
+
+        return index;
+    }
+
+    /**
+     *  Pop the front batch to make room, it is counted as evicted.
+     */
+    void evict()
+    {
+        for (size_t i = 0; i < pcb.size() && pcb[i].flag == pcb.front().flag; ++i)
+        {
+            nevb += pcb[i].offset + 1;
+        }
+
+        pop_front();
+    }
+
+    std::deque<_BFPage> pcb;
+    std::vector<uint32_t> pages;
+    std::string fn;
+    _BFHead head;
+    _BFMap map;
+    int fd;
+    bool sealed;
+};
+
+/**
+ *  Memory engine. Messages are stored back to back in a ring of fixed size
+ *  chunks, indexed by the end offset of each message, which also carries
+ *  flags for X-ID requests and evicted messages. A batch is
+ *  SR_MEMBUF_NUM index entries, prefixed by the X-ID in effect if it does
+ *  not start with one. The X-ID of the last released X-ID request is kept,
+ *  hence a message never loses its X-ID when its predecessors are sent or
+ *  evicted. The front batch is cached until it changes.
+ *
+ *  The capacity is in messages, the budget in bytes. When the budget is
+ *  exceeded, the oldest message of the lowest priority lane is evicted,
+ *  i.e., only marked in the index and skipped when read. X-ID requests
+ *  are never evicted. The ring is compacted when evicted bytes exceed an
+ *  eighth of the budget.
+ */
+class _MemPager: public _Pager
+{
+public:
+    _MemPager(uint32_t _cap) :
+            _Pager(_cap), head(0), tail(0), base(0), seq0(0), live(0), nlive(0),
+            dead(0), budget(0), cached(false)
+    {
+    }
+
+    virtual ~_MemPager()
+    {
+    }
+
+    virtual bool empty() const
+    {
+        return ends.empty();
+    }
+
+    virtual size_t bsize() const
+    {
+        return (ends.size() + SR_MEMBUF_NUM - 1) >> SR_MEMBUF_SCALE;
+    }
+
+    virtual size_t size() const
+    {
+        return ends.size();
+    }
+
+    virtual void at(size_t k, string &s) const
+    {
+        if (k == 0 && cached)
+        {
+            s += cache;
+            return;
+        }
+
+        const size_t b = k * SR_MEMBUF_NUM;
+        if (b >= ends.size())
+        {
+            return;
+        }
+
+        const size_t e = min(ends.size(), b + SR_MEMBUF_NUM);
+        const size_t n = s.size();
+        if (!(ends[b] & SR_MEMBUF_XID))
+        {   // the X-ID in effect, the last X-ID request before b
+            auto it = lower_bound(xids.begin(), xids.end(), seq0 + b);
+            if (it != xids.begin())
+            {
+                --it;
+                const size_t i = *it - seq0;
+                read(start(i), end(i), s);
+            } else
+            {
+                s += xid;
+            }
+        }
+
+        for (size_t i = b; i < e;)
+        {   // read runs of live messages
+            for (; i < e && (ends[i] & SR_MEMBUF_DEAD); ++i)
+            {
+                // empty
+            }
+
+            const size_t j = i;
+            for (; i < e && !(ends[i] & SR_MEMBUF_DEAD); ++i)
+            {
+                // empty
+            }
+
+            if (j < i)
+            {
+                read(start(j), end(i - 1), s);
+            }
+        }
+
+        if (k == 0)
+        {
+            cache.assign(s, n, string::npos);
+            cached = true;
+        }
+    }
+
+    virtual void pop_front()
+    {
+        if (ends.size() <= SR_MEMBUF_NUM)
+        {
+            clear();
+        } else
+        {
+            release(SR_MEMBUF_NUM);
+        }
+    }
+
+    virtual int emplace_back(const char *p, const _Spans &v)
+    {
+        for (const auto &e : v)
+        {
+            if (cap && ends.size() >= cap)
+            {
+                if (!(ends[0] & (SR_MEMBUF_XID | SR_MEMBUF_DEAD)))
+                {   // the oldest message, not the incoming one
+                    nevb += end(0) - start(0);
+                    ++nevm;
+                }
+
+                release(1);
+            }
+
+            const size_t lim = budget;
+            while (lim && live + e.len + SR_MEMBUF_COST * (nlive + 1) > lim && evict())
+            {
+                // evict until the message fits
+            }
+
+            const bool isx = e.len >= 3 && !memcmp(p + e.pos, "15,", 3);
+            const uint64_t seq = seq0 + ends.size();
+            if (isx)
+            {
+                xids.push_back(seq);
+            } else
+            {
+                lanes[min<size_t>(e.lane, SR_PRIO_LANES - 1)].push_back(seq);
+            }
+
+            cached = cached && ends.size() >= SR_MEMBUF_NUM;
+            append(p + e.pos, e.len);
+            ends.push_back(tail | (isx ? SR_MEMBUF_XID : 0));
+            live += e.len;
+            ++nlive;
+        }
+
+        if (budget && dead > budget / 8)
+        {
+            compact();
+        }
+
+        return 0;
+    }
+
+    virtual void clear()
+    {
+        release(ends.size());
+        xid.clear();
+    }
+
+    virtual void setBudget(size_t bytes)
+    {
+        budget = bytes;
+    }
+
+    virtual size_t used() const
+    {
+        return tail - head + SR_MEMBUF_COST * ends.size();
+    }
+
+private:
+
+    uint64_t end(size_t i) const
+    {
+        return ends[i] & SR_MEMBUF_OFF;
+    }
+
+    uint64_t start(size_t i) const
+    {
+        return i ? end(i - 1) : head;
+    }
+
+    /**
+     *  Evict the oldest message of the lowest priority lane.
+     *  \return false if there is no message to evict.
+     */
+    bool evict()
+    {
+        for (size_t l = SR_PRIO_LANES; l--;)
+        {
+            auto &q = lanes[l];
+            for (; !q.empty(); q.pop_front())
+            {
+                if (ends[q.front() - seq0] & SR_MEMBUF_DEAD)
+                {
+                    continue;
+                }
+
+                const size_t i = q.front() - seq0, n = end(i) - start(i);
+                q.pop_front();
+                ends[i] |= SR_MEMBUF_DEAD;
+                cached = cached && i >= SR_MEMBUF_NUM;
+                live -= n;
+                dead += n;
+                --nlive;
+                nevb += n;
+                ++nevm;
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     *  Copy all messages not evicted into a new ring.
+     */
+    void compact()
+    {
+        _MemPager t(cap);
+        std::vector<size_t> gone(ends.size());
+        string buf;
+        t.seq0 = seq0;
+
+        for (size_t i = 0, n = 0; i < ends.size(); ++i)
+        {   // gone: evicted entries before i
+            gone[i] = n;
+            if (ends[i] & SR_MEMBUF_DEAD)
+            {
+                ++n;
+                continue;
+            }
+
+            buf.clear();
+            read(start(i), end(i), buf);
+            t.append(buf.data(), buf.size());
+            t.ends.push_back(t.tail | (ends[i] & SR_MEMBUF_XID));
+        }
+
+        for (const auto seq : xids)
+        {
+            t.xids.push_back(seq - gone[seq - seq0]);
+        }
+
+        for (size_t l = 0; l < SR_PRIO_LANES; ++l)
+        {
+            for (const auto seq : lanes[l])
+            {
+                if (!(ends[seq - seq0] & SR_MEMBUF_DEAD))
+                {
+                    t.lanes[l].push_back(seq - gone[seq - seq0]);
+                }
+            }
+        }
+
+        swap(chunks, t.chunks);
+        swap(ends, t.ends);
+        swap(xids, t.xids);
+        for (size_t l = 0; l < SR_PRIO_LANES; ++l)
+        {
+            swap(lanes[l], t.lanes[l]);
+        }
+
+        head = t.head;
+        tail = t.tail;
+        base = t.base;
+        dead = 0;
+        cached = false;
+    }
+
+    /**
+     *  Append the bytes [from, to) of the ring to \a s.
+     */
+    void read(uint64_t from, uint64_t to, string &s) const
+    {
+        while (from < to)
+        {
+            const size_t c = (from - base) / SR_MEMBUF_CHUNK, o = (from - base) % SR_MEMBUF_CHUNK;
+            const size_t n = min<uint64_t>(to - from, SR_MEMBUF_CHUNK - o);
+            s.append(chunks[c].get() + o, n);
+            from += n;
+        }
+    }
+
+    void append(const char *p, size_t n)
+    {
+        while (n)
+        {
+            if (tail == base + chunks.size() * SR_MEMBUF_CHUNK)
+            {
+                chunks.push_back(spare ? std::move(spare) : unique_ptr<char[]>(new char[SR_MEMBUF_CHUNK]));
+            }
+
+            const size_t o = (tail - base) % SR_MEMBUF_CHUNK;
+            const size_t c = min<size_t>(n, SR_MEMBUF_CHUNK - o);
+            memcpy(chunks.back().get() + o, p, c);
+            tail += c;
+            p += c;
+            n -= c;
+        }
+    }
+
+    /**
+     *  Remove the first \a n messages. The last removed X-ID request
+     *  becomes the X-ID in effect, chunks are freed once fully released,
+     *  one of them is kept for re-use.
+     */
+    void release(size_t n)
+    {
+        const uint64_t seq = seq0 + n;
+        if (!xids.empty() && xids.front() < seq)
+        {
+            uint64_t x = xids.front();
+            for (; !xids.empty() && xids.front() < seq; xids.pop_front())
+            {
+                x = xids.front();
+            }
+
+            const size_t i = x - seq0;
+            xid.clear();
+            read(start(i), end(i), xid);
+        }
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const size_t m = end(i) - start(i);
+            if (ends[i] & SR_MEMBUF_DEAD)
+            {
+                dead -= m;
+            } else
+            {
+                live -= m;
+                --nlive;
+            }
+        }
+
+        for (auto &q : lanes)
+        {
+            for (; !q.empty() && q.front() < seq; q.pop_front())
+            {
+                // empty
+            }
+        }
+
+        head = n ? end(n - 1) : head;
+        ends.erase(ends.begin(), ends.begin() + n);
+        seq0 = seq;
+        cached = false;
+
+        if (ends.empty())
+        {   // rewind within the current chunk
+            head = tail = base + (chunks.empty() ? 0 : (tail - base) / SR_MEMBUF_CHUNK * SR_MEMBUF_CHUNK);
+        }
+
+        for (; head - base >= SR_MEMBUF_CHUNK && !chunks.empty(); base += SR_MEMBUF_CHUNK)
+        {
+            spare = std::move(chunks.front());
+            chunks.pop_front();
+        }
+    }
+
+    std::deque<unique_ptr<char[]>> chunks;
+    unique_ptr<char[]> spare;
+    std::deque<uint64_t> ends;
+    std::deque<uint64_t> xids;
+    std::deque<uint64_t> lanes[SR_PRIO_LANES];
+    string xid;
+    mutable string cache;
+    uint64_t head, tail, base, seq0;
+    size_t live, nlive, dead;
+    std::atomic<size_t> budget;
+    mutable bool cached;
+};
+
+struct _MMHead
+{
+    uint32_t magic;
+    uint8_t ver, scale;
+    uint16_t pad;
+    uint32_t cap, head, size, cnt;
+};
+
+struct _MMPage
+{
+    uint32_t len;
+    uint8_t flag, pad[3];
+};
+
+/**
+ *  Memory-mapped file engine. The file starts with a fixed size header
+ *  region, i.e., _MMHead and one _MMPage per page, followed by the pages,
+ *  which form a ring from head over size pages. All updates are done in
+ *  place, hence appending and popping only touch the written pages, their
+ *  _MMPage and the _MMHead. The touched ranges are msync'ed according to
+ *  SR_FILEBUF_SYNC: 0 leaves write back to the kernel, 1 schedules it
+ *  (MS_ASYNC), 2 waits for it (MS_SYNC).
+ */
+class _MMPager: public _Pager
+{
+public:
+    _MMPager(const string &_fn, uint32_t c) :
+            _Pager(c), fn(_fn), fd(-1), base(NULL), len(0), head(NULL), pcb(NULL), sealed(false)
+    {
+        fd = open(fn.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            srError("filebuf: open " + fn + ": " + strerror(errno));
+            return;
+        }
+
+        _MMHead h;
+        struct stat st {};
+        const bool valid = fstat(fd, &st) == 0
+                && pread(fd, &h, sizeof(h), 0) == sizeof(h)
+                && h.magic == SR_MMBUF_MAGIC && h.ver == SR_MMBUF_VER
+                && h.scale == SR_FILEBUF_PAGE_SCALE && h.cap > 0
+                && h.head < h.cap && h.size <= h.cap
+                && (size_t) st.st_size >= total(h.cap);
+
+        if (!valid && st.st_size > 0)
+        {
+            srWarning("filebuf: " + fn + " is not a valid buffer, reset.");
+        }
+
+        if (map(valid ? h.cap : max<uint32_t>(c, 1), !valid) == 0 && valid)
+        {   // the batch count is only a hint, recount in case of a crash
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < head->size; ++i)
+            {
+                n += i == 0 || page(i).flag != page(i - 1).flag ? 1 : 0;
+            }
+
+            head->cnt = n;
+            resize();
+        }
+    }
+
+    virtual ~_MMPager()
+    {
+        unmap();
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+
+    virtual bool empty() const
+    {
+        return head == NULL || head->size == 0;
+    }
+
+    virtual size_t bsize() const
+    {
+        return head ? head->cnt : 0;
+    }
+
+    virtual size_t size() const
+    {
+        return head ? head->size : 0;
+    }
+
+    virtual void at(size_t k, string &s) const
+    {
+        if (head == NULL)
+        {
+            return;
+        }
+
+        uint32_t i = 0;
+        for (; i < head->size && k; ++i)
+        {   // skip k batches
+            k -= i + 1 < head->size && page(i + 1).flag != page(i).flag ? 1 : 0;
+        }
+
+        if (i >= head->size || k)
+        {
+            return;
+        }
+
+        for (const uint8_t flag = page(i).flag; i < head->size && page(i).flag == flag; ++i)
+        {
+            s.append(data(i), page(i).len);
+        }
+    }
+
+    virtual void pop_front()
+    {
+        if (empty())
+        {
+            return;
+        }
+
+        uint32_t n = 1;
+        for (; n < head->size && page(n).flag == page(0).flag; ++n)
+        {
+            // empty
+        }
+
+        head->head = (head->head + n) % head->cap;
+        head->size -= n;
+        --head->cnt;
+        sync(0, sizeof(_MMHead));
+    }
+
+    virtual int emplace_back(const char *p, const _Spans &v)
+    {
+        size_t n = 0;
+        for (const auto &e : v)
+        {
+            n += e.len;
+        }
+
+        if (head == NULL)
+        {
+            return -1;
+        } else if (n == 0)
+        {
+            return 0;
+        }
+
+        // a new capacity is applied here, on the thread using the pager
+        resize();
+
+        if (head->size == 0 || sealed || n + page(head->size - 1).len > SR_FILEBUF_PAGE_SIZE)
+        {
+            sealed = false;
+            return push_back(p, v);
+        }
+
+        const uint32_t i = head->size - 1;
+        _MMPage &t = page(i);
+        char *dest = data(i) + t.len;
+
+        for (const auto &e : v)
+        {
+            memcpy(dest, p + e.pos, e.len);
+            dest += e.len;
+        }
+
+        sync(data(i) + t.len - base, n);
+        t.len += n;
+        sync((char*) &t - base, sizeof(t));
+
+        return 0;
+    }
+
+    virtual void seal()
+    {
+        sealed = true;
+    }
+
+    virtual void clear()
+    {
+        if (head == NULL)
+        {
+            return;
+        }
+
+        head->head = head->size = head->cnt = 0;
+        sync(0, sizeof(_MMHead));
+        resize();
+    }
+
+private:
+
+    /**
+     *  Write the spans \a v of \a p as a new batch, the oldest batches are
+     *  discarded when the ring is full.
+     */
+    int push_back(const char *p, const _Spans &v)
+    {
+        const uint8_t flag = head->size && !page(head->size - 1).flag ? 1 : 0;
+        uint32_t own = 0;
+
+        for (size_t k = 0, used = 0; k < v.size(); ++own)
+        {
+            if (head->size == head->cap)
+            {
+                if (own == head->size)
+                {
+                    srError("filebuf: batch exceeds capacity, truncated.");
+                    break;
+                }
+
+                evict();
+            }
+
+            const uint32_t i = head->size;
+            char* const dest = data(i);
+            size_t c = 0;
+
+            for (; c < SR_FILEBUF_PAGE_SIZE && k < v.size();)
+            {
+                const size_t n = min(SR_FILEBUF_PAGE_SIZE - c, v[k].len - used);
+                memcpy(dest + c, p + v[k].pos + used, n);
+                c += n;
+                used += n;
+                if (used == v[k].len)
+                {
+                    ++k;
+                    used = 0;
+                }
+            }
+
+            _MMPage &t = page(i);
+            t.len = c;
+            t.flag = flag;
+            sync(dest - base, c);
+            sync((char*) &t - base, sizeof(t));
+            ++head->size;
+        }
+
+        ++head->cnt;
+        sync(0, sizeof(_MMHead));
+
+        return 0;
+    }
+
+    /**
+     *  Re-layout the ring for the configured capacity, if it differs from
+     *  the mapped one. Buffered pages are copied to a new file, starting at
+     *  its first page, which then replaces the current file by rename, hence
+     *  a crash leaves either layout intact. When shrinking, the oldest
+     *  batches are evicted until the rest fits.
+     */
+    void resize()
+    {
+        const uint32_t c = cap;
+        if (c == 0 || head == NULL || c == head->cap)
+        {
+            return;
+        }
+
+        while (head->size > c)
+        {
+            evict();
+        }
+
+        const string tmp = fn + ".tmp";
+        const int tfd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        void *m = MAP_FAILED;
+        if (tfd == -1 || ftruncate(tfd, total(c)) == -1 || (m = mmap(NULL,
+                total(c), PROT_READ | PROT_WRITE, MAP_SHARED, tfd, 0)) == MAP_FAILED)
+        {
+            srError("filebuf: resize " + tmp + ": " + strerror(errno));
+            if (tfd != -1)
+            {
+                close(tfd);
+                unlink(tmp.c_str());
+            }
+
+            cap = head->cap;
+            return;
+        }
+
+        char* const b = (char*) m;
+        _MMHead* const h = (_MMHead*) b;
+        _MMPage* const t = (_MMPage*) (b + sizeof(_MMHead));
+        *h = *head;
+        h->cap = c;
+        h->head = 0;
+
+        for (uint32_t i = 0; i < head->size; ++i)
+        {
+            t[i] = page(i);
+            memcpy(b + region(c) + (size_t) i * SR_FILEBUF_PAGE_SIZE, data(i), t[i].len);
+        }
+
+        const int rc = msync(b, total(c), MS_SYNC);
+        munmap(b, total(c));
+
+        if (rc == -1 || rename(tmp.c_str(), fn.c_str()) == -1)
+        {
+            srError("filebuf: resize " + fn + ": " + strerror(errno));
+            close(tfd);
+            unlink(tmp.c_str());
+            cap = head->cap;
+
+            return;
+        }
+
+        unmap();
+        close(fd);
+        fd = tfd;
+        if (map(c, false) == 0)
+        {
+            srInfo("filebuf: resize " + to_string(c));
+        }
+    }
+
+    /**
+     *  Pop the front batch to make room, it is counted as evicted.
+     */
+    void evict()
+    {
+        for (uint32_t i = 0; i < head->size && page(i).flag == page(0).flag; ++i)
+        {
+            nevb += page(i).len;
+            nevm += count(data(i), data(i) + page(i).len, '\n');
+        }
+
+        pop_front();
+    }
+
+    static size_t region(uint32_t c)
+    {
+        const size_t n = sizeof(_MMHead) + c * sizeof(_MMPage);
+        return (n + SR_FILEBUF_PAGE_SIZE - 1) & ~(size_t) (SR_FILEBUF_PAGE_SIZE - 1);
+    }
+
+    static size_t total(uint32_t c)
+    {
+        return region(c) + (size_t) c * SR_FILEBUF_PAGE_SIZE;
+    }
+
+    int map(uint32_t c, bool init)
+    {
+        len = total(c);
+        if ((init && ftruncate(fd, 0) == -1) || ftruncate(fd, len) == -1)
+        {
+            srError("filebuf: truncate " + fn + ": " + strerror(errno));
+            return -1;
+        }
+
+        void* const m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED)
+        {
+            srError("filebuf: mmap " + fn + ": " + strerror(errno));
+            return -1;
+        }
+
+        base = (char*) m;
+        head = (_MMHead*) base;
+        pcb = (_MMPage*) (base + sizeof(_MMHead));
+
+        if (init)
+        {
+            head->magic = SR_MMBUF_MAGIC;
+            head->ver = SR_MMBUF_VER;
+            head->scale = SR_FILEBUF_PAGE_SCALE;
+            head->pad = 0;
+            head->cap = c;
+            head->head = head->size = head->cnt = 0;
+            sync(0, region(c));
+        }
+
+        return 0;
+    }
+
+    void unmap()
+    {
+        if (base)
+        {
+            msync(base, len, MS_SYNC);
+            munmap(base, len);
+        }
+
+        base = NULL;
+        head = NULL;
+        pcb = NULL;
+    }
+
+    /**
+     *  msync the range [off, off + n) of the mapping, rounded to whole
+     *  system pages as required by msync.
+     */
+    void sync(size_t off, size_t n) const
+    {
+#if SR_FILEBUF_SYNC
+        static const size_t ps = sysconf(_SC_PAGESIZE);
+        const size_t b = off & ~(ps - 1);
+        msync(base + b, off + n - b, SR_FILEBUF_SYNC == 1 ? MS_ASYNC : MS_SYNC);
+#else
+        (void) off;
+        (void) n;
+#endif
+    }
+
+    /**
+     *  Control block and data of the i-th used page, counted from head.
+     */
+    _MMPage &page(uint32_t i) const
+    {
+        return pcb[(head->head + i) % head->cap];
+    }
+
+    char *data(uint32_t i) const
+    {
+        return base + region(head->cap)
+                + (size_t) ((head->head + i) % head->cap) * SR_FILEBUF_PAGE_SIZE;
+    }
+
+    string fn;
+    int fd;
+    char *base;
+    size_t len;
+    _MMHead *head;
+    _MMPage *pcb;
+    bool sealed;
+};
+
+/**
+ *  On-disk record header, followed by len & ~SR_LOGBUF_FIRST bytes payload.
+ *  crc is the CRC-32C over len and the payload.
+ */
+struct _LogRec
+{
+    uint32_t len, crc;
+};
+
+/**
+ *  Checkpoint, position of the first unacknowledged record.
+ */
+struct _LogCkpt
+{
+    uint32_t magic, ver, seg, off, crc;
+};
+
+struct _LogEnt
+{
+    _LogEnt(uint32_t s = 0, uint32_t o = 0, uint32_t n = 0, uint8_t f = 0,
+            uint32_t m = 0) :
+            seg(s), off(o), len(n), msgs(m), flag(f)
+    {
+    }
+
+    uint32_t seg, off, len;
+    // number of messages, i.e., newlines, for eviction statistics
+    uint32_t msgs;
+    uint8_t flag;
+};
+
+/**
+ *  Log-structured engine. Every emplace_back() appends one CRC framed
+ *  record to the current segment file fn.NNNNNN, segments are rolled over
+ *  at SR_LOGBUF_SEGMENT bytes. Consecutive records up to a page form a
+ *  batch, the first record of a batch is marked in its header. pop_front()
+ *  atomically replaces the checkpoint file fn.ckpt, and deletes segments
+ *  which hold acknowledged records only. On open, records are scanned from
+ *  the checkpoint, a torn or corrupt tail is truncated. The capacity is
+ *  cap pages of payload.
+ *
+ *  With SR_FILEBUF_SYNC 1 or 2, each appended record costs one fdatasync,
+ *  with 2 the checkpoint is also fsync'ed before it replaces the old one.
+ */
+class _LogPager: public _Pager
+{
+public:
+    _LogPager(const string &_fn, uint32_t c) :
+            _Pager(c), fn(_fn), fseg(0), wseg(0), woff(0), wfd(-1), rseg(0),
+            rfd(-1), bytes(0), nb(0), last(0), sealed(false)
+    {
+        recover();
+    }
+
+    virtual ~_LogPager()
+    {
+        if (wfd != -1)
+        {
+            close(wfd);
+        }
+
+        if (rfd != -1)
+        {
+            close(rfd);
+        }
+    }
+
+    virtual bool empty() const
+    {
+        return ents.empty();
+    }
+
+    virtual size_t bsize() const
+    {
+        return nb;
+    }
+
+    virtual size_t size() const
+    {
+        return (bytes + SR_FILEBUF_PAGE_SIZE - 1) / SR_FILEBUF_PAGE_SIZE;
+    }
+
+    virtual void at(size_t k, string &s) const
+    {
+        size_t i = 0;
+        for (; i < ents.size() && k; ++i)
+        {   // skip k batches
+            k -= i + 1 < ents.size() && ents[i + 1].flag != ents[i].flag ? 1 : 0;
+        }
+
+        if (i >= ents.size() || k)
+        {
+            return;
+        }
+
+        for (const auto flag = ents[i].flag; i < ents.size() && ents[i].flag == flag; ++i)
+        {
+            const _LogEnt &e = ents[i];
+            const size_t n = s.size();
+            s.resize(n + e.len);
+            const int fd = reader(e.seg);
+            if (fd == -1 || pread(fd, &s[n], e.len, e.off) != (ssize_t) e.len)
+            {
+                s.resize(n);
+                break;
+            }
+        }
+    }
+
+    virtual void pop_front()
+    {
+        if (ents.empty())
+        {
+            return;
+        }
+
+        const auto flag = ents.front().flag;
+        while (!ents.empty() && ents.front().flag == flag)
+        {
+            bytes -= ents.front().len;
+            ents.pop_front();
+        }
+
+        last = --nb ? last : 0;
+        if (ents.empty())
+        {
+            checkpoint(wseg, woff);
+        } else
+        {
+            checkpoint(ents.front().seg, ents.front().off - sizeof(_LogRec));
+        }
+
+        // delete acknowledged segments only after the checkpoint moved on
+        const uint32_t seg = ents.empty() ? wseg : ents.front().seg;
+        for (; fseg < seg; ++fseg)
+        {
+            unlink(segment(fseg).c_str());
+        }
+
+        if (rfd != -1 && rseg < fseg)
+        {
+            close(rfd);
+            rfd = -1;
+        }
+    }
+
+    virtual int emplace_back(const char *base, const _Spans &v)
+    {
+        size_t n = 0;
+        for (const auto &e : v)
+        {
+            n += e.len;
+        }
+
+        if (n == 0)
+        {
+            return 0;
+        } else if (wfd == -1 || n >= SR_LOGBUF_FIRST)
+        {
+            return -1;
+        }
+
+        const bool first = ents.empty() || sealed || last + n > SR_FILEBUF_PAGE_SIZE;
+        const size_t limit = (size_t) cap * SR_FILEBUF_PAGE_SIZE;
+        while (!ents.empty() && bytes + n > limit && (first || nb > 1))
+        {   // never evict the batch in progress
+            evict();
+        }
+
+        if (woff >= SR_LOGBUF_SEGMENT && roll() == -1)
+        {
+            return -1;
+        }
+
+        _LogRec r;
+        r.len = n | (first ? SR_LOGBUF_FIRST : 0);
+        wbuf.resize(sizeof(r));
+        for (const auto &e : v)
+        {
+            wbuf.append(base + e.pos, e.len);
+        }
+
+        r.crc = crc32c(crc32c(0, &r.len, sizeof(r.len)), wbuf.data() + sizeof(r), n);
+        memcpy(&wbuf[0], &r, sizeof(r));
+
+        if (write(wfd, wbuf.data(), wbuf.size()) != (ssize_t) wbuf.size())
+        {
+            srError("filebuf: write " + segment(wseg) + ": " + strerror(errno));
+            if (ftruncate(wfd, woff) == -1)
+            {
+                srError("filebuf: truncate " + segment(wseg) + ": " + strerror(errno));
+            }
+
+            return -1;
+        }
+#if SR_FILEBUF_SYNC
+        fdatasync(wfd);
+#endif
+        const uint8_t flag = ents.empty() ? 0 : ents.back().flag ^ (first ? 1 : 0);
+        ents.emplace_back(wseg, woff + sizeof(r), n, flag,
+                count(wbuf.begin() + sizeof(r), wbuf.end(), '\n'));
+        woff += wbuf.size();
+        bytes += n;
+        nb += first ? 1 : 0;
+        last = first ? n : last + n;
+        sealed = false;
+
+        return 0;
+    }
+
+    virtual void seal()
+    {
+        sealed = true;
+    }
+
+    virtual void clear()
+    {
+        ents.clear();
+        bytes = nb = last = 0;
+        if (wfd == -1)
+        {
+            return;
+        }
+
+        if (ftruncate(wfd, 0) == -1)
+        {
+            srError("filebuf: truncate " + segment(wseg) + ": " + strerror(errno));
+        }
+
+        woff = 0;
+        checkpoint(wseg, woff);
+        for (; fseg < wseg; ++fseg)
+        {
+            unlink(segment(fseg).c_str());
+        }
+    }
+
+private:
+
+    string segment(uint32_t seg) const
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), ".%06u", seg);
+        return fn + buf;
+    }
+
+    /**
+     *  File descriptor for reading segment \a seg, kept open for
+     *  consecutive reads from the same segment.
+     */
+    int reader(uint32_t seg) const
+    {
+        if (rfd != -1 && rseg == seg)
+        {
+            return rfd;
+        } else if (rfd != -1)
+        {
+            close(rfd);
+        }
+
+        rseg = seg;
+        rfd = open(segment(seg).c_str(), O_RDONLY | O_CLOEXEC);
+
+        return rfd;
+    }
+
+    int roll()
+    {
+        const int fd = open(segment(wseg + 1).c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            srError("filebuf: open " + segment(wseg + 1) + ": " + strerror(errno));
+            return -1;
+        }
+
+        if (wfd != -1)
+        {
+            close(wfd);
+        }
+
+        wfd = fd;
+        woff = 0;
+        ++wseg;
+        if (ents.empty())
+        {   // nothing refers to older segments anymore
+            checkpoint(wseg, woff);
+            for (; fseg < wseg; ++fseg)
+            {
+                unlink(segment(fseg).c_str());
+            }
+        }
+
+        return 0;
+    }
+
+    void checkpoint(uint32_t seg, uint32_t off)
+    {
+        _LogCkpt c;
+        c.magic = SR_LOGBUF_MAGIC;
+        c.ver = SR_LOGBUF_VER;
+        c.seg = seg;
+        c.off = off;
+        c.crc = crc32c(0, &c, offsetof(_LogCkpt, crc));
+
+        const string tmp = fn + ".ckpt.tmp";
+        const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            srError("filebuf: open " + tmp + ": " + strerror(errno));
+            return;
+        }
+
+        bool ok = write(fd, &c, sizeof(c)) == sizeof(c);
+#if SR_FILEBUF_SYNC == 2
+        ok = ok && fsync(fd) == 0;
+#endif
+        close(fd);
+
+        if (!ok || rename(tmp.c_str(), (fn + ".ckpt").c_str()) == -1)
+        {
+            srError("filebuf: checkpoint " + fn + ": " + strerror(errno));
+        }
+    }
+
+    /**
+     *  Find the lowest and highest segment number next to fn.
+     */
+    bool scan(uint32_t &lo, uint32_t &hi) const
+    {
+        const size_t pos = fn.rfind('/');
+        const string dir = pos == string::npos ? "." : fn.substr(0, pos + 1);
+        const string prefix = (pos == string::npos ? fn : fn.substr(pos + 1)) + ".";
+        bool found = false;
+
+        DIR* const d = opendir(dir.c_str());
+        for (dirent *e; d && (e = readdir(d));)
+        {
+            const char *p = e->d_name;
+            if (strncmp(p, prefix.c_str(), prefix.size()) || strlen(p) != prefix.size() + 6
+                    || strspn(p + prefix.size(), "0123456789") != 6)
+            {
+                continue;
+            }
+
+            const uint32_t seg = strtoul(p + prefix.size(), NULL, 10);
+            lo = found ? min(lo, seg) : seg;
+            hi = found ? max(hi, seg) : seg;
+            found = true;
+        }
+
+        if (d)
+        {
+            closedir(d);
+        }
+
+        return found;
+    }
+
+    /**
+     *  Rebuild the batches from the checkpoint to the end of the log.
+     */
+    void recover()
+    {
+        _LogCkpt c;
+        uint32_t lo = 0, hi = 0, off = 0;
+        const bool found = scan(lo, hi);
+
+        const int fd = open((fn + ".ckpt").c_str(), O_RDONLY | O_CLOEXEC);
+        const bool valid = fd != -1 && read(fd, &c, sizeof(c)) == sizeof(c)
+                && c.magic == SR_LOGBUF_MAGIC && c.ver == SR_LOGBUF_VER
+                && c.crc == crc32c(0, &c, offsetof(_LogCkpt, crc));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+
+        if (valid && (!found || c.seg >= lo))
+        {
+            fseg = c.seg;
+            off = c.off;
+            hi = found ? max(hi, c.seg) : c.seg;
+        } else
+        {
+            if (fd != -1)
+            {
+                srWarning("filebuf: invalid checkpoint " + fn + ".ckpt, scan all.");
+            }
+
+            fseg = found ? lo : 0;
+        }
+
+        for (; found && lo < fseg; ++lo)
+        {
+            unlink(segment(lo).c_str());
+        }
+
+        string buf;
+        for (uint32_t seg = fseg; seg <= hi; ++seg, off = 0)
+        {
+            size_t end = load(seg, off, buf);
+            if (end < buf.size())
+            {
+                srWarning("filebuf: " + segment(seg) + " corrupt at "
+                        + to_string(end) + ", " + to_string(buf.size() - end)
+                        + " bytes discarded.");
+                if (truncate(segment(seg).c_str(), end) == -1)
+                {
+                    srError("filebuf: truncate " + segment(seg) + ": " + strerror(errno));
+                }
+            }
+
+            woff = end;
+        }
+
+        wseg = hi;
+        wfd = open(segment(wseg).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (wfd == -1)
+        {
+            srError("filebuf: open " + segment(wseg) + ": " + strerror(errno));
+        }
+
+        while (nb > 1 && bytes > (size_t) cap * SR_FILEBUF_PAGE_SIZE)
+        {
+            evict();
+        }
+    }
+
+    /**
+     *  Pop the front batch to make room, it is counted as evicted.
+     */
+    void evict()
+    {
+        for (size_t i = 0; i < ents.size() && ents[i].flag == ents.front().flag; ++i)
+        {
+            nevb += ents[i].len;
+            nevm += ents[i].msgs;
+        }
+
+        pop_front();
+    }
+
+    /**
+     *  Load the valid records of segment \a seg from \a off on.
+     *  \return offset of the first invalid record, or the segment size.
+     */
+    size_t load(uint32_t seg, size_t off, string &buf)
+    {
+        buf.clear();
+        const int fd = open(segment(seg).c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st {};
+        if (fd == -1 || fstat(fd, &st) == -1)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+
+            return 0;
+        }
+
+        buf.resize(st.st_size);
+        const bool ok = read(fd, &buf[0], buf.size()) == (ssize_t) buf.size();
+        close(fd);
+        if (!ok)
+        {
+            buf.clear();
+            return 0;
+        }
+
+        _LogRec r;
+        off = min(off, buf.size());
+        while (off + sizeof(r) <= buf.size())
+        {
+            memcpy(&r, &buf[off], sizeof(r));
+            const size_t n = r.len & ~SR_LOGBUF_FIRST;
+            const char* const p = buf.data() + off + sizeof(r);
+            if (n == 0 || off + sizeof(r) + n > buf.size()
+                    || r.crc != crc32c(crc32c(0, &r.len, sizeof(r.len)), p, n))
+            {
+                return off;
+            }
+
+            const bool first = ents.empty() || (r.len & SR_LOGBUF_FIRST);
+            const uint8_t flag = ents.empty() ? 0 : ents.back().flag ^ (first ? 1 : 0);
+            ents.emplace_back(seg, off + sizeof(r), n, flag, count(p, p + n, '\n'));
+            bytes += n;
+            nb += first ? 1 : 0;
+            last = first ? n : last + n;
+            off += sizeof(r) + n;
+        }
+
+        return off;
+    }
+
+    std::deque<_LogEnt> ents;
+    string fn;
+    string wbuf;
+    uint32_t fseg, wseg, woff;
+    int wfd;
+    mutable uint32_t rseg;
+    mutable int rfd;
+    size_t bytes, nb, last;
+    bool sealed;
+};
+
+static inline uint32_t _lzHash(const char *p)
+{
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+
+    return (x * 2654435761u) >> (32 - SR_LZ_HASH);
+}
+
+static void _lzLen(string &out, size_t n)
+{
+    for (; n >= 255; n -= 255)
+    {
+        out += (char) 255;
+    }
+
+    out += (char) n;
+}
+
+/**
+ *  Append one sequence, literals [w + l, w + i) followed by a match of
+ *  length \a len at distance \a off, or literals only if \a len is 0.
+ */
+static void _lzSeq(string &out, const char *w, size_t l, size_t i,
+        size_t off, size_t len)
+{
+    const size_t ll = i - l, ml = len ? len - SR_LZ_MIN : 0;
+    out += (char) ((min<size_t>(ll, 15) << 4) | min<size_t>(ml, 15));
+    if (ll >= 15)
+    {
+        _lzLen(out, ll - 15);
+    }
+
+    out.append(w + l, ll);
+    if (len)
+    {
+        out += (char) (off & 0xff);
+        out += (char) (off >> 8);
+        if (ml >= 15)
+        {
+            _lzLen(out, ml - 15);
+        }
+    }
+}
+
+/**
+ *  LZ77 compress [w + d, w + n) into \a out, matches may refer back into
+ *  the dictionary [w, w + d). Sequences are encoded as in LZ4: a token
+ *  with the literal length and the match length in its nibbles, extended
+ *  lengths, the literals, and a 16-bit little endian match offset. The
+ *  last sequence consists of literals only.
+ */
+static void _lzPack(const char *w, size_t d, size_t n, string &out,
+        std::vector<uint32_t> &tab)
+{
+    tab.assign(1 << SR_LZ_HASH, 0);
+    for (size_t i = 0; i + SR_LZ_MIN <= d; ++i)
+    {   // positions are stored +1, 0 is none
+        tab[_lzHash(w + i)] = i + 1;
+    }
+
+    size_t l = d, i = d;
+    while (i + SR_LZ_MIN <= n)
+    {
+        const uint32_t h = _lzHash(w + i);
+        const size_t c = tab[h];
+        tab[h] = i + 1;
+
+        if (c == 0 || i - (c - 1) > SR_LZ_WINDOW || memcmp(w + c - 1, w + i, SR_LZ_MIN))
+        {
+            ++i;
+            continue;
+        }
+
+        size_t len = SR_LZ_MIN;
+        for (; i + len < n && w[c - 1 + len] == w[i + len]; ++len)
+        {
+            // empty
+        }
+
+        _lzSeq(out, w, l, i, i - (c - 1), len);
+        for (size_t j = i + 1; j < i + len && j + SR_LZ_MIN <= n; ++j)
+        {
+            tab[_lzHash(w + j)] = j + 1;
+        }
+
+        i += len;
+        l = i;
+    }
+
+    _lzSeq(out, w, l, n, 0, 0);
+}
+
+static bool _lzExt(const uint8_t *&q, const uint8_t *e, size_t &n)
+{
+    for (uint8_t b = 255; b == 255; n += b)
+    {
+        if (q == e)
+        {
+            return false;
+        }
+
+        b = *q++;
+    }
+
+    return true;
+}
+
+/**
+ *  Decompress [p, p + n) and append to \a out, which holds the
+ *  dictionary. At most \a limit bytes are appended.
+ *  \return 0 on success, -1 if the input is corrupt.
+ */
+static int _lzUnpack(const char *p, size_t n, string &out, size_t limit)
+{
+    const uint8_t *q = (const uint8_t*) p, *e = q + n;
+    limit += out.size();
+
+    while (q < e)
+    {
+        const uint8_t tok = *q++;
+        size_t ll = tok >> 4, ml = tok & 15;
+        if ((ll == 15 && !_lzExt(q, e, ll)) || ll > (size_t) (e - q)
+                || out.size() + ll > limit)
+        {
+            return -1;
+        }
+
+        out.append((const char*) q, ll);
+        q += ll;
+        if (q == e)
+        {
+            break;
+        } else if (e - q < 2)
+        {
+            return -1;
+        }
+
+        const size_t off = q[0] | (q[1] << 8);
+        q += 2;
+        if ((ml == 15 && !_lzExt(q, e, ml)) || off == 0 || off > out.size()
+                || out.size() + ml + SR_LZ_MIN > limit)
+        {
+            return -1;
+        }
+
+        for (size_t k = 0, from = out.size() - off; k < ml + SR_LZ_MIN; ++k)
+        {   // byte-wise, the match may overlap its own output
+            const char c = out[from + k];
+            out += c;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  Frame header of a compressed emplace_back(), len == raw for a frame
+ *  stored uncompressed.
+ */
+struct _ZHead
+{
+    uint32_t raw, len, dict;
+};
+
+/**
+ *  Record of the dictionary file, followed by len bytes of dictionary
+ *  with CRC32C crc.
+ */
+struct _ZDict
+{
+    uint32_t crc, len;
+};
+
+/**
+ *  Compressing wrapper around a file engine. Each emplace_back() is
+ *  compressed into one frame, hence a page holds several times the
+ *  messages for typical SmartREST requests. Batches are limited to
+ *  SR_ZBUF_BATCH bytes before compression, and decompressed by at().
+ *
+ *  Each frame refers to its dictionary by CRC. All dictionaries frames
+ *  may refer to are kept in the file fn.dict, a dictionary is appended
+ *  before the first frame using it is written. Hence frames written
+ *  before a dictionary change, e.g., of the X-ID, stay decodable. The
+ *  file is rewritten with the current dictionary only, when no frame is
+ *  buffered.
+ */
+class _ZPager: public _Pager
+{
+public:
+    _ZPager(_Pager *p, const string &fn) :
+            _Pager(p->capacity()), inner(p), dfn(fn + SR_ZBUF_DICT_SUFFIX),
+            did(0), dsaved(false), braw(SR_ZBUF_BATCH), nraw(0), nstored(0)
+    {
+        load();
+    }
+
+    virtual void setCapacity(uint32_t _cap)
+    {
+        cap = _cap;
+        inner->setCapacity(_cap);
+    }
+
+    virtual bool empty() const
+    {
+        return inner->empty();
+    }
+
+    virtual size_t bsize() const
+    {
+        return inner->bsize();
+    }
+
+    virtual size_t size() const
+    {
+        return inner->size();
+    }
+
+    virtual void at(size_t k, string &s) const
+    {
+        zbuf.clear();
+        inner->at(k, zbuf);
+
+        _ZHead h;
+        for (size_t i = 0; i < zbuf.size(); i += sizeof(h) + h.len)
+        {
+            memcpy(&h, zbuf.data() + i, min(sizeof(h), zbuf.size() - i));
+            const char* const p = zbuf.data() + i + sizeof(h);
+            const bool ok = zbuf.size() - i >= sizeof(h)
+                    && h.len <= zbuf.size() - i - sizeof(h);
+
+            if (ok && h.len == h.raw)
+            {   // stored, no dictionary needed
+                s.append(p, h.len);
+                continue;
+            }
+
+            // frames refer to the dictionary they were written with, an
+            // empty one is implied for buffers without dictionary file
+            const auto it = dicts.find(h.dict);
+            wbuf = it == dicts.end() ? string() : it->second;
+            const size_t n = wbuf.size();
+
+            if (!ok || (it == dicts.end() && h.dict != 0)
+                    || _lzUnpack(p, h.len, wbuf, h.raw) || wbuf.size() != n + h.raw)
+            {
+                srError("filebuf: corrupt compressed batch, "
+                        + to_string(zbuf.size() - i) + " bytes discarded.");
+                break;
+            }
+
+            s.append(wbuf, n, h.raw);
+        }
+    }
+
+    virtual void pop_front()
+    {
+        inner->pop_front();
+    }
+
+    virtual int emplace_back(const char *base, const _Spans &v)
+    {
+        wbuf = dict;
+        for (const auto &e : v)
+        {
+            wbuf.append(base + e.pos, e.len);
+        }
+
+        const size_t n = wbuf.size() - dict.size();
+        if (n == 0)
+        {
+            return 0;
+        } else if (!dsaved)
+        {
+            save();
+        }
+
+        if (!dsaved)
+        {   // a frame never refers to a dictionary which is not durable
+            return -1;
+        }
+
+        _ZHead h;
+        zbuf.assign(sizeof(h), '\0');
+        _lzPack(wbuf.data(), dict.size(), wbuf.size(), zbuf, tab);
+        h.raw = n;
+        h.len = zbuf.size() - sizeof(h);
+        h.dict = did;
+
+        if (h.len >= n)
+        {   // incompressible
+            zbuf.resize(sizeof(h));
+            zbuf.append(wbuf, dict.size(), n);
+            h.len = n;
+        }
+
+        memcpy(&zbuf[0], &h, sizeof(h));
+        if (braw + n > SR_ZBUF_BATCH)
+        {
+            inner->seal();
+            braw = 0;
+        }
+
+        braw += n;
+        nraw += n;
+        nstored += zbuf.size();
+
+        return inner->emplace_back(zbuf.data(), _Spans(1, _Span(0, zbuf.size())));
+    }
+
+    virtual void clear()
+    {
+        inner->clear();
+        save();
+    }
+
+    virtual void seal()
+    {
+        inner->seal();
+        braw = 0;
+    }
+
+    virtual void setDictionary(const string &d)
+    {
+        dict = d.size() > SR_LZ_DICT ? d.substr(d.size() - SR_LZ_DICT) : d;
+        did = crc32c(0, dict.data(), dict.size());
+        dsaved = false;
+    }
+
+    virtual void ratio(uint64_t &raw, uint64_t &stored) const
+    {
+        raw = nraw;
+        stored = nstored;
+    }
+
+    virtual void setBudget(size_t bytes)
+    {
+        inner->setBudget(bytes);
+        cap = inner->capacity();
+    }
+
+    virtual size_t used() const
+    {
+        return inner->used();
+    }
+
+    virtual void evicted(uint64_t &bytes, uint64_t &msgs) const
+    {
+        // the inner engine counts newlines of compressed frames
+        inner->evicted(bytes, msgs);
+        msgs = 0;
+    }
+
+private:
+
+    /**
+     *  Read all dictionaries of the dictionary file, a torn record at the
+     *  end is ignored.
+     */
+    void load()
+    {
+        ifstream fs(dfn, ios::binary);
+        string buf((istreambuf_iterator<char>(fs)), istreambuf_iterator<char>());
+        _ZDict h;
+
+        for (size_t i = 0; i + sizeof(h) <= buf.size(); i += sizeof(h) + h.len)
+        {
+            memcpy(&h, buf.data() + i, sizeof(h));
+            const char* const p = buf.data() + i + sizeof(h);
+            if (h.len > SR_LZ_DICT || h.len > buf.size() - i - sizeof(h)
+                    || crc32c(0, p, h.len) != h.crc)
+            {
+                srWarning("filebuf: " + dfn + " corrupt at " + to_string(i));
+                break;
+            }
+
+            dicts[h.crc].assign(p, h.len);
+        }
+    }
+
+    /**
+     *  Make the current dictionary durable. It is appended to the
+     *  dictionary file, unless no frame is buffered, then the file is
+     *  replaced by one holding the current dictionary only.
+     */
+    void save()
+    {
+        const bool prune = inner->empty() && (dicts.size() != 1 || !dicts.count(did));
+        if (!prune && dicts.count(did))
+        {
+            dsaved = true;
+            return;
+        }
+
+        const _ZDict h = { did, (uint32_t) dict.size() };
+        string rec((const char*) &h, sizeof(h));
+        rec += dict;
+
+        const string fn = prune ? dfn + ".tmp" : dfn;
+        const int fd = open(fn.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC
+                | (prune ? O_TRUNC : O_APPEND), 0644);
+        const off_t off = fd == -1 ? 0 : lseek(fd, 0, SEEK_END);
+        const bool ok = fd != -1 && write(fd, rec.data(), rec.size()) == (ssize_t) rec.size()
+                && fdatasync(fd) == 0;
+        const int err = errno;
+
+        if (fd != -1)
+        {
+            // a torn record would hide all later ones from load()
+            if (!ok && ftruncate(fd, off) == -1)
+            {
+                srWarning("filebuf: truncate " + fn + ": " + strerror(errno));
+            }
+
+            close(fd);
+        }
+
+        if (!ok || (prune && rename(fn.c_str(), dfn.c_str()) == -1))
+        {
+            srError("filebuf: write " + fn + ": " + strerror(ok ? errno : err));
+            return;
+        }
+
+        if (prune)
+        {
+            dicts.clear();
+        }
+
+        dicts[did] = dict;
+        dsaved = true;
+    }
+
+    std::unique_ptr<_Pager> inner;
+    string dfn;
+    string dict;
+    std::map<uint32_t, string> dicts;
+    mutable string wbuf, zbuf;
+    std::vector<uint32_t> tab;
+    uint32_t did;
+    bool dsaved;
+    size_t braw;
+    std::atomic<uint64_t> nraw, nstored;
+};
+
+_Pager *_Pager::create(int engine, const string &fn, uint32_t cap)
+{
+    _Pager *p = NULL;
+    if (fn.empty())
+    {
+        return new _MemPager(cap);
+    } else if ((engine & ~SR_FILEBUF_ZIP) == SR_FILEBUF_MMAP)
+    {
+        p = new _MMPager(fn, cap);
+    } else if ((engine & ~SR_FILEBUF_ZIP) == SR_FILEBUF_LOG)
+    {
+        p = new _LogPager(fn, cap);
+    } else
+    {
+        p = new _BFPager(fn, cap);
+    }
+
+    return engine & SR_FILEBUF_ZIP ? new _ZPager(p, fn) : p;
+}
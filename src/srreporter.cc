@@ -19,25 +19,18 @@
  */
 
 #include <algorithm>
+#include <deque>
+#include <iterator>
 #include <sstream>
-#include <fstream>
-#include <unistd.h>
 #include <cstring>
 #include "srreporter.h"
+#include "srpager.h"
+#include "srutils.h"
 
 using namespace std;
 
 #define Q_OK SrQueue<SrNews>::Q_OK
 
-#define SR_FILEBUF_VER 0x1
-#define SR_FILEBUF_PAGE_BASE 9
-#define SR_FILEBUF_PAGE_SIZE (1<<(SR_FILEBUF_PAGE_BASE+SR_FILEBUF_PAGE_SCALE))
-#define SR_FILEBUF_INDEX_SUFFIX ".index"
-#define SR_MEMBUF_SCALE 8
-#define SR_MEMBUF_NUM (1 << SR_MEMBUF_SCALE)
-#define BASE_PAGE(x) (x & 0x07)
-#define BASE_VER(x) ((x >> 3) & 0x0f)
-#define _BASE (BASE_PAGE(SR_FILEBUF_PAGE_SCALE) | (SR_FILEBUF_VER << 3))
 
 #define HTTP_CONNECTION_TIMEOUT 30 // seconds
 #define MQTT_CONNECTION_TIMEOUT 15 // seconds
@@ -48,569 +41,360 @@ using namespace std;
 
 #define MQTT_MAXIMUM_PAYLOAD_SIZE 16384 // bytes
 
+#define SR_REPORTER_REPLAY 4 // batches in flight when replaying
 
-struct _BFHead
+static int64_t _now()
 {
-    _BFHead() :
-            base(_BASE), flag(0), size(0), cnt(0), pad2(0)
-    {
-    }
-
-    uint8_t base, flag;
-    uint16_t size, cnt, pad2;
-};
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
 
-struct _BFPage
-{
-    _BFPage(uint16_t idx = 0, uint16_t oft = 0, uint8_t f = 0) :
-            index(idx), offset(oft), flag(f), cnt(0), pad(0)
-    {
-    }
-
-    uint16_t index, offset;
-    uint8_t flag, cnt;
-    uint16_t pad;
-};
+    return (int64_t) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
 
-typedef std::deque<_BFPage> _PCB;
-typedef std::vector<bool> _UFLAG;
 
-static void readPCB(const string &fn, _BFHead &head, _PCB &pcb, _UFLAG &uflag)
+/**
+ *  Reusable payload buffer of the reporter thread. Each cycle serializes
+ *  the buffered front and the aggregated messages into buf exactly once,
+ *  messages to be buffered are only recorded as spans into buf. All
+ *  members keep their capacity across cycles, hence a steady cycle does
+ *  not allocate.
+ */
+struct _Arena
 {
-    ifstream fs(fn, ios::binary);
-    if (!fs.read((char*) &head, sizeof(head)))
+    _Arena()
     {
-        return;
-    }
-
-    if (BASE_VER(head.base) != SR_FILEBUF_VER || BASE_PAGE(head.base) != SR_FILEBUF_PAGE_SCALE)
-    {
-        head.cnt = head.size = 0;
-        return;
+        buf.reserve(MQTT_MAXIMUM_PAYLOAD_SIZE);
+        spans.reserve(64);
     }
 
-    const size_t sz = head.size;
-    if (uflag.size() < sz)
+    void clear()
     {
-        uflag.resize(sz);
+        buf.clear();
+        spans.clear();
+        xid.clear();
     }
 
-    _BFPage page;
-    uint8_t flag = 2;
-    uint16_t cnt = 0;
-
-    for (size_t i = 0; fs.read((char*) &page, sizeof(page)) && i < sz; ++i)
-    {
-        pcb.push_back(page);
-        uflag[page.index] = true;
-        cnt += flag == page.flag ? 0 : 1;
-        flag = page.flag;
-    }
+    string buf;
+    _Spans spans;
+    string xid;
+    std::vector<string> pages;
+    std::vector<string> resps;
+    std::vector<int> status;
+    std::vector<size_t> idx;
+    std::deque<uint64_t> acked;
+};
 
-    head.size = pcb.size();
-    head.cnt = cnt;
+SrReporter::SrReporter(const string &s, const string &x, const string &a,
+        SrQueue<SrNews> &out, SrQueue<SrOpBatch> &in, uint32_t cap,
+        const string fn) :
+        http(new SrNetHttp(s + "/s", "", a)), mqtt(), out(out), in(in), xid(x), ptr(), arena(new _Arena), sleeping(false), isfilebuf(!fn.empty()), tid(0),
+        maxBytes(MQTT_MAXIMUM_PAYLOAD_SIZE - 1024), maxNum(SR_REPORTER_NUM), latency(SR_REPORTER_VAL),
+        inflight(SR_REPORTER_REPLAY), nbatch(0), nmsg(0), nbyte(0), ndelay(0), mdelay(0), lastn(0), nused(0)
+{
+    ptr.reset(_Pager::create(SR_FILEBUF_ENGINE | (SR_FILEBUF_COMPRESS ? SR_FILEBUF_ZIP : 0), fn, cap));
+    ptr->setDictionary("15," + xid + "\n");
 }
 
-static void writePCB(const string &fn, const _BFHead &head, _PCB &pcb)
+SrReporter::SrReporter(const string &server, const string &deviceId,
+        const string &x, const string &user, const string &pass,
+        SrQueue<SrNews> &out, SrQueue<SrOpBatch> &in, uint32_t cap,
+        const string fn) :
+        http(), mqtt(new SrNetMqtt("d:" + deviceId, server)), out(out), in(in), xid(x), ptr(), arena(new _Arena), sleeping(false), isfilebuf(!fn.empty()), tid(0),
+        maxBytes(MQTT_MAXIMUM_PAYLOAD_SIZE - 1024), maxNum(SR_REPORTER_NUM), latency(SR_REPORTER_VAL),
+        inflight(SR_REPORTER_REPLAY), nbatch(0), nmsg(0), nbyte(0), ndelay(0), mdelay(0), lastn(0), nused(0)
 {
-    ofstream out(fn, ios::binary);
-    if (!out.write((const char*) &head, sizeof(head)))
-    {
-        return;
-    }
+    ptr.reset(_Pager::create(SR_FILEBUF_ENGINE | (SR_FILEBUF_COMPRESS ? SR_FILEBUF_ZIP : 0), fn, cap));
+    ptr->setDictionary("15," + xid + "\n");
 
-    for (const auto &e : pcb)
-    {
-        if (!out.write((const char*) &e, sizeof(_BFPage)))
-        {
-            break;
-        }
-    }
+    mqtt->setUsername(user.c_str());
+    mqtt->setPassword(pass.c_str());
 }
 
-static int readPage(ifstream &in, size_t i, char *dest, size_t size)
+SrReporter::~SrReporter()
 {
-    in.seekg(i * SR_FILEBUF_PAGE_SIZE);
-    return in.read(dest, size) ? in.gcount() : -1;
+    pthread_cancel(tid);
 }
 
-static int writePage(ofstream &out, size_t index, const char *buf, size_t size,
-        size_t offset = 0)
+uint32_t SrReporter::capacity() const
 {
-    out.seekp(index * SR_FILEBUF_PAGE_SIZE + offset);
-    return out.write(buf, size) ? 0 : -1;
+    return ptr->capacity();
 }
 
-class _Pager
+void SrReporter::setCapacity(uint32_t cap)
 {
-public:
-    _Pager(uint16_t _cap) :
-            cap(_cap)
-    {
-    }
-
-    virtual ~_Pager()
-    {
-    }
-
-    size_t capacity() const
-    {
-        return cap;
-    }
-
-    void setCapacity(uint16_t _cap)
-    {
-        cap = _cap;
-    }
-
-    virtual bool empty() const = 0;
-    virtual size_t bsize() const = 0;
-    virtual size_t size() const = 0;
-    virtual string front() const = 0;
-    virtual void pop_front() = 0;
-    virtual int emplace_back(const string &s) = 0;
-    virtual void clear() = 0;
-
-protected:
-
-    uint16_t cap;
-};
+    ptr->setCapacity(cap);
+}
 
-class _BFPager: public _Pager
+void SrReporter::setBudget(size_t bytes)
 {
-public:
-    _BFPager(const string &_fn, int c) :
-            _Pager(c), fn(_fn), uflag(c)
-    {
-        readPCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb, uflag);
-        if (access(fn.c_str(), F_OK) == -1)
-            ofstream out(fn);
-    }
+    ptr->setBudget(bytes);
+}
 
-    ~_BFPager()
-    {
-        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
+void SrReporter::setDictionary(const string &srt)
+{
+    string dict;
+    for (size_t i = 0; (i = srt.find("10,", i)) != string::npos; i += 3)
+    {   // request templates: 10,<msgId>,<method>,...
+        const size_t j = srt.find(',', i + 3);
+        if ((i == 0 || srt[i - 1] == '\n') && j != string::npos)
+        {
+            dict.append(srt, i + 3, j - i - 2);
+        }
     }
 
-    virtual bool empty() const
-    {
-        return head.size == 0;
-    }
+    ptr->setDictionary(dict + "15," + xid + "\n");
+}
 
-    virtual size_t bsize() const
-    {
-        return head.cnt;
-    }
+int SrReporter::start()
+{
+    const int success = pthread_create(&tid, NULL, func, this);
 
-    virtual size_t size() const
+    if (success)
     {
-        return head.size;
+        srError("reporter: start failed, " + string(strerror(success)));
     }
 
-    virtual string front() const
-    {
-        string s;
-        if (pcb.empty())
-        {
-            return s;
-        }
-
-        char buf[SR_FILEBUF_PAGE_SIZE + 1];
-        ifstream in(fn, ios::binary);
-        const auto flag = pcb.front().flag;
-        for (size_t i = 0; i < pcb.size() && flag == pcb[i].flag; ++i)
-        {
-            const auto offset = pcb[i].offset + 1;
-            if (readPage(in, pcb[i].index, buf, offset) != offset)
-            {
-                break;
-            }
-
-            s.append(buf, offset);
-        }
-
-        return s;
-    }
+    return success;
+}
 
-    virtual void pop_front()
+void SrReporter::mqttSetOpt(int opt, long parameter)
+{
+    switch (opt)
     {
-        const auto flag = pcb.front().flag;
-        size_t i = 0;
-        for (; i < pcb.size() && pcb[i].flag == flag; ++i)
+        case SR_MQTTOPT_KEEPALIVE:
         {
-            uflag[pcb[i].index] = false;
+            mqtt->setKeepalive(parameter);
+            break;
         }
 
-        pcb.erase(pcb.begin(), pcb.begin() + i);
-        head.size = pcb.size();
-        --head.cnt;
-        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
-    }
-
-    virtual int emplace_back(const string &s)
-    {
-        const auto sz = SR_FILEBUF_PAGE_SIZE;
-
-        if (pcb.empty() || s.size() + pcb.back().offset > sz)
-        {
-            return push_back(s);
-        } else
+        default:
         {
-            auto &t = pcb.back();
-            const auto f = t.offset + 1;
-            ofstream out(fn, ios::binary | ios::in);
-            if (writePage(out, t.index, s.c_str(), s.size(), f))
-            {
-                return -1;
-            }
-
-            t.offset += s.size();
-            writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
-
-            return 0;
+            srWarning("reporter: invalid mqtt option " + to_string(opt));
+            break;
         }
     }
+}
 
-    virtual void clear()
+void SrReporter::setOpt(int opt, long parameter)
+{
+    if (parameter <= 0)
     {
-        pcb.clear();
-        fill(uflag.begin(), uflag.end(), false);
-        head.size = head.cnt = 0;
-        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
-        const auto c = cap;
-
-        if (c < uflag.size())
-        {
-            const int success = truncate(fn.c_str(), c * SR_FILEBUF_PAGE_SIZE);
-
-            if (0 == success)
-            {
-                uflag.resize(c);
-                srInfo("filebuf: truncate " + to_string(c));
-            }
-        }
+        srWarning("reporter: invalid value " + to_string(parameter)
+                + " for option " + to_string(opt));
+        return;
     }
 
-private:
-
-    virtual int push_back(const string &s)
+    switch (opt)
     {
-        const auto _cap = cap;
-        if (uflag.size() < _cap)
+        case SR_REPORTEROPT_BATCH_BYTES:
         {
-            uflag.resize(_cap);
+            maxBytes = parameter;
+            break;
         }
 
-        const uint8_t flag = (pcb.empty() || pcb.back().flag) ? 0 : 1;
-        const auto sz = SR_FILEBUF_PAGE_SIZE;
-        const int N = s.size() / sz;
-        ofstream out(fn, ios::binary | ios::in);
-        const char *buf = s.c_str();
-
-        for (int i = 0; i < N; ++i)
+        case SR_REPORTEROPT_BATCH_NUM:
         {
-            const auto index = get_free_page();
-            if (writePage(out, index, buf + i * sz, sz) == -1)
-            {
-                return -1;
-            }
-
-            uflag[index] = true;
-            pcb.emplace_back(index, sz - 1, flag);
+            maxNum = min(parameter, (long) SR_REPORTER_NUM);
+            break;
         }
 
-        const auto c = s.size() & (sz - 1);
-        if (c)
+        case SR_REPORTEROPT_LATENCY:
         {
-            const auto index = get_free_page();
-            if (writePage(out, index, buf + N * sz, c) == 0)
-            {
-                uflag[index] = true;
-                pcb.emplace_back(index, c - 1, flag);
-            }
+            latency = parameter;
+            break;
         }
 
-        head.size = pcb.size();
-        ++head.cnt;
-        writePCB(fn + SR_FILEBUF_INDEX_SUFFIX, head, pcb);
-
-        return 0;
-    }
-
-    uint16_t get_free_page()
-    {
-        uint16_t index = 0;
-        for (; index < cap && uflag[index]; ++index)
+        case SR_REPORTEROPT_REPLAY:
         {
-            // empty
+            inflight = parameter;
+            break;
         }
 
-        if (index >= cap)
+        default:
         {
-            index = pcb.front().index;
-            pop_front();
+            srWarning("reporter: invalid option " + to_string(opt));
+            break;
         }
-
-        return index;
     }
+}
 
-    std::deque<_BFPage> pcb;
-    std::string fn;
-    _BFHead head;
-    std::vector<bool> uflag;
-};
-
-class _MemPager: public _Pager
+SrReporterStats SrReporter::stats() const
 {
-public:
-    _MemPager(uint16_t _cap) :
-            _Pager(_cap)
-    {
-    }
-
-    virtual ~_MemPager()
-    {
-    }
-
-    virtual bool empty() const
-    {
-        return mcb.empty();
-    }
+    SrReporterStats s;
+    s.batches = nbatch;
+    s.messages = nmsg;
+    s.bytes = nbyte;
+    s.delay = ndelay;
+    s.maxDelay = mdelay;
+    s.lastSize = lastn;
+    ptr->ratio(s.bufRaw, s.bufStored);
+    ptr->evicted(s.bufEvicted, s.bufEvictedMsgs);
+    s.bufUsed = nused;
 
-    virtual size_t bsize() const
-    {
-        const auto s = mcb.size();
-        const auto b = s & (SR_MEMBUF_NUM - 1);
-        return (s >> SR_MEMBUF_SCALE) + (b ? 1 : 0);
-    }
+    return s;
+}
 
-    virtual size_t size() const
-    {
-        return mcb.size();
-    }
+/**
+ *  Wait for messages from the egress queue into \a pend until the batch is
+ *  due, i.e., the byte or message threshold is reached, a message with
+ *  SR_PRIO_URGENT arrives, or the oldest message, taken at \a t0, waited
+ *  for the latency. Returns after one latency period when idle.
+ */
+void SrReporter::collect(std::deque<SrNews> &pend, int64_t &t0)
+{
+    const int64_t idle = _now() + latency;
+    size_t bytes = 0, i = 0;
+    bool urgent = false;
 
-    virtual string front() const
+    while (true)
     {
-        string s;
-        for (size_t i = 0; i < mcb.size() && i < SR_MEMBUF_NUM; ++i)
+        const size_t bmax = maxBytes, nmax = maxNum;
+        for (; i < pend.size(); ++i)
         {
-            s += mcb[i];
+            bytes += pend[i].data.size() + 1;
+            urgent = urgent || (pend[i].prio & SR_PRIO_URGENT);
         }
 
-        return s;
-    }
-
-    virtual void pop_front()
-    {
-        auto p = [](const string &T)
-        {
-            return !T.compare(0, 3, "15,");
-        };
-
-        if (mcb.size() <= SR_MEMBUF_NUM)
-        {
-            mcb.clear();
-        } else if (p(mcb[SR_MEMBUF_NUM]))
+        const int64_t now = _now();
+        if (!pend.empty() && t0 == 0)
         {
-            mcb.erase(mcb.begin(), mcb.begin() + SR_MEMBUF_NUM);
-        } else
-        {
-            const auto a = mcb.size() - SR_MEMBUF_NUM;
-            auto it = find_if(mcb.rbegin() + a, mcb.rend(), p);
-            const auto s = *it;
-            mcb.erase(mcb.begin(), mcb.begin() + SR_MEMBUF_NUM);
-            mcb.push_front(s);
+            t0 = now;
         }
-    }
 
-    virtual int emplace_back(const string &s)
-    {
-        auto p = [](const string &T)
+        if (urgent || bytes >= bmax || pend.size() >= nmax)
         {
-            return T.compare(0, 3, "15,");
-        };
+            return;
+        }
 
-        if (mcb.size() >= cap)
+        const int64_t due = pend.empty() ? idle : t0 + latency;
+        if (now >= due)
         {
-            if (p(mcb.front()))
-            {
-                mcb.pop_front();
-            } else
-            {
-                const string front(mcb.front());
-                mcb.erase(mcb.begin(), mcb.begin() + 2);
-                if (!mcb.empty() && p(mcb.front()))
-                {
-                    mcb.emplace_front(front);
-                }
-            }
+            return;
         }
 
-        mcb.emplace_back(s);
-
-        return 0;
-    }
-
-    virtual void clear()
-    {
-        mcb.clear();
+        out.drain(std::back_inserter(pend), nmax - pend.size(), (int) (due - now));
     }
+}
 
-private:
+void SrReporter::count(size_t n, size_t bytes, int64_t t0)
+{
+    const uint32_t d = _now() - t0;
 
-    deque<string> mcb;
-};
+    ++nbatch;
+    nmsg += n;
+    nbyte += bytes;
+    ndelay += d;
+    lastn = n;
 
-SrReporter::SrReporter(const string &s, const string &x, const string &a,
-        SrQueue<SrNews> &out, SrQueue<SrOpBatch> &in, uint16_t cap,
-        const string fn) :
-        http(new SrNetHttp(s + "/s", "", a)), mqtt(), out(out), in(in), xid(x), ptr(), sleeping(false), isfilebuf(!fn.empty()), tid(0)
-{
-    if (isfilebuf)
+    if (d > mdelay)
     {
-        ptr.reset(new _BFPager(fn, cap));
-    }
-    else
-    {
-        ptr.reset(new _MemPager(cap));
+        mdelay = d;
     }
 }
 
-SrReporter::SrReporter(const string &server, const string &deviceId,
-        const string &x, const string &user, const string &pass,
-        SrQueue<SrNews> &out, SrQueue<SrOpBatch> &in, uint16_t cap,
-        const string fn) :
-        http(), mqtt(new SrNetMqtt("d:" + deviceId, server)), out(out), in(in), xid(x), ptr(), sleeping(false), isfilebuf(!fn.empty()), tid(0)
+/**
+ *  Move pending messages out of the egress queue in bulk into \a pend (swap
+ *  when \a pend is empty, otherwise topped up to SR_REPORTER_NUM).
+ */
+static void topup(SrQueue<SrNews> &q, std::deque<SrNews> &pend)
 {
-    if (isfilebuf)
+    if (pend.empty())
     {
-        ptr.reset(new _BFPager(fn, cap));
-    }
-    else
+        q.takeAll(pend);
+    } else if (pend.size() < (size_t) SR_REPORTER_NUM)
     {
-        ptr.reset(new _MemPager(cap));
+        q.drain(std::back_inserter(pend), SR_REPORTER_NUM - pend.size(), 0);
     }
-
-    mqtt->setUsername(user.c_str());
-    mqtt->setPassword(pass.c_str());
-}
-
-SrReporter::~SrReporter()
-{
-    pthread_cancel(tid);
-}
-
-uint16_t SrReporter::capacity() const
-{
-    return ptr->capacity();
 }
 
-void SrReporter::setCapacity(uint16_t cap)
-{
-    ptr->setCapacity(cap);
-}
-
-int SrReporter::start()
-{
-    const int success = pthread_create(&tid, NULL, func, this);
-
-    if (success)
-    {
-        srError("reporter: start failed, " + string(strerror(success)));
-    }
-
-    return success;
-}
-
-void SrReporter::mqttSetOpt(int opt, long parameter)
+/**
+ *  Move messages with SR_PRIO_URGENT from \a pend to \a hot, keeping the
+ *  order of both.
+ */
+static void split(std::deque<SrNews> &pend, std::deque<SrNews> &hot)
 {
-    switch (opt)
+    size_t k = 0;
+    for (size_t i = 0; i < pend.size(); ++i)
     {
-        case SR_MQTTOPT_KEEPALIVE:
+        if (pend[i].prio & SR_PRIO_URGENT)
         {
-            mqtt->setKeepalive(parameter);
-            break;
-        }
-
-        default:
+            hot.push_back(std::move(pend[i]));
+        } else if (k++ != i)
         {
-            srWarning("reporter: invalid mqtt option " + to_string(opt));
-            break;
+            pend[k - 1] = std::move(pend[i]);
         }
     }
+
+    pend.resize(k);
 }
 
-static string aggregate(SrQueue<SrNews> &q, _Pager *p, bool isfilebuf, const string &defaultXid)
+/**
+ *  Aggregate pending messages into one request, messages exceeding the
+ *  size limit stay in \a pend for the next request. The request is
+ *  appended to the arena \a a, messages with SR_PRIO_BUF set are recorded
+ *  as spans into the arena and handed to the pager \a p in one go, unless
+ *  \a p is NULL.
+ *
+ *  \return number of aggregated messages.
+ */
+static int aggregate(std::deque<SrNews> &pend, _Pager *p, _Arena &a,
+        const string &defaultXid)
 {
-    string s, buf, currentXid;
+    string &s = a.buf;
+    const size_t base = s.size();
+    int i = 0;
 
-    for (int i = 0; i < SR_REPORTER_NUM && !q.empty(); i++)
+    for (; i < SR_REPORTER_NUM && !pend.empty(); i++, pend.pop_front())
     {   // sending message is not empty
 
         // prevent the violation of our mqtt maximum accepted payload size
-        if (s.size() > MQTT_MAXIMUM_PAYLOAD_SIZE - 1024) {
+        if (s.size() - base > MQTT_MAXIMUM_PAYLOAD_SIZE - 1024) {
             break;
         }
 
-        SrQueue<SrNews>::Event e;
-
-        // get next message from sending queue
-        if ((e = q.get(0)).second != Q_OK)
-        {
-            break;
-        }
+        const SrNews &news = pend.front();
 
         // get message string
-        const string& data = e.first.data;
+        const string& data = news.data;
 
         // check, if message contains X-ID
-        const bool alternate = e.first.prio & SR_PRIO_XID;
+        const bool alternate = news.prio & SR_PRIO_XID;
         const size_t pos = alternate ? data.find(',') : 0;
-        const string newXid = alternate ? data.substr(0, pos) : defaultXid;
+        const char *xid = alternate ? data.c_str() : defaultXid.c_str();
+        const size_t xlen = alternate ? min(pos, data.size()) : defaultXid.size();
+        const bool isbuf = news.prio & SR_PRIO_BUF;
 
-        if (newXid != currentXid)
+        if (a.xid.compare(0, string::npos, xid, xlen))
         {   // different X-ID than current one
 
-            currentXid = newXid;
-            s += "15," + currentXid + '\n';
+            a.xid.assign(xid, xlen);
+            const size_t n = s.size();
+            s.append("15,", 3).append(xid, xlen) += '\n';
 
-            if (e.first.prio & SR_PRIO_BUF)
+            if (isbuf)
             {
-                if (isfilebuf)
-                {
-                    buf += "15," + currentXid + '\n';
-                }
-                else
-                {
-                    p->emplace_back("15," + currentXid + '\n');
-                }
+                a.spans.emplace_back(n, s.size() - n, srNewsLane(news));
             }
         }
 
         // append message, but without X-ID, if preceding
         const size_t pos2 = pos ? pos + 1 : 0;
+        const size_t n = s.size();
         s.append(data, pos2, data.size() - pos2);
         s += '\n';
 
-        if (e.first.prio & SR_PRIO_BUF)
+        if (isbuf)
         {
-            if (isfilebuf)
-            {
-                buf.append(data, pos2, data.size() - pos2);
-                buf += '\n';
-            } else
-            {
-                p->emplace_back(data.substr(pos2) + '\n');
-            }
+            a.spans.emplace_back(n, s.size() - n, srNewsLane(news));
         }
     }
 
-    if (!buf.empty())
+    if (p && !a.spans.empty())
     {
-        p->emplace_back(buf);
+        p->emplace_back(s.data(), a.spans);
     }
 
-    return s;
+    return i;
 }
 
 class MyMqttMsgHandler: public SrMqttAppMsgHandler
@@ -653,13 +437,21 @@ static int _mqtt_connect(SrNetMqtt *mqtt, bool clean, const string &xid)
     return mqtt->subscribe(topics, qos, N);
 }
 
-static int exp_send(void *net, bool ishttp, const string &data, SrQueue<SrOpBatch> &in, const string &xid)
+/**
+ *  Send \a data, retrying up to \a tries times with exponential wait. With
+ *  a single try there is no wait at all.
+ *
+ *  \return 0 on success, -1 otherwise.
+ */
+static int exp_send(void *net, bool ishttp, const string &data, SrQueue<SrOpBatch> &in,
+        const string &xid, int tries = SR_REPORTER_RETRIES)
 {
+    static const string topic = "s/ul";
     SrNetHttp* const http = ishttp ? (SrNetHttp*) net : nullptr;
     SrNetMqtt* const mqtt = !ishttp ? (SrNetMqtt*) net : nullptr;
     int i = 0;
 
-    for (i = 0; i < SR_REPORTER_RETRIES; ++i)
+    for (i = 0; i < tries; ++i)
     {
         if (http && http->post(data) >= 0)
         {
@@ -675,7 +467,7 @@ static int exp_send(void *net, bool ishttp, const string &data, SrQueue<SrOpBatc
 
         if (mqtt)
         {
-            if (mqtt->publish("s/ul", data, 2))
+            if (mqtt->publish(topic, data, 2))
             {
                 _mqtt_connect(mqtt, true, xid);
             }
@@ -685,16 +477,108 @@ static int exp_send(void *net, bool ishttp, const string &data, SrQueue<SrOpBatc
             }
         }
 
-        ::sleep(1 << i);
+        if (tries > 1)
+        {
+            ::sleep(1 << i);
+        }
     }
 
-    return i < SR_REPORTER_RETRIES ? 0 : -1;
+    return i < tries ? 0 : -1;
+}
+
+/**
+ *  Tag of a buffered batch the server already acknowledged, while a batch
+ *  before it is still unacknowledged. The tag holds the CRC of the batch,
+ *  hence it never applies to another batch after the pager evicted from
+ *  the front.
+ */
+static uint64_t _tag(const string &s)
+{
+    return crc32c(0, s.data(), s.size()) | 1ULL << 32;
+}
+
+static bool _acked(const _Arena &a, size_t i, const string &s)
+{
+    return i < a.acked.size() && a.acked[i] == _tag(s);
+}
+
+static void _pop(_Pager *p, _Arena &a)
+{
+    p->pop_front();
+
+    if (!a.acked.empty())
+    {
+        a.acked.pop_front();
+    }
+}
+
+/**
+ *  Post the first \a k buffered batches concurrently, the first one is
+ *  already in the arena. Batches are popped in order up to the first
+ *  unacknowledged one. Acknowledged batches after it are tagged, and are
+ *  neither posted nor forwarded again when the window is retried.
+ *
+ *  \return number of popped batches.
+ */
+static size_t replay(SrNetHttp *http, _Pager *p, _Arena &a, size_t k,
+        SrQueue<SrOpBatch> &in)
+{
+    a.pages.resize(k);
+    a.pages[0].swap(a.buf);
+    for (size_t i = 1; i < k; ++i)
+    {
+        a.pages[i].clear();
+        p->at(i, a.pages[i]);
+    }
+
+    // move the batches to post to the front, keeping their order
+    a.idx.clear();
+    for (size_t i = 0; i < k; ++i)
+    {
+        if (!_acked(a, i, a.pages[i]))
+        {
+            a.pages[a.idx.size()].swap(a.pages[i]);
+            a.idx.push_back(i);
+        }
+    }
+
+    const size_t m = a.idx.size();
+    if (m)
+    {
+        http->post(a.pages.data(), m, a.status, a.resps);
+    }
+
+    for (size_t j = 0; j < m; ++j)
+    {
+        if (a.status[j] >= 0 && !a.resps[j].empty())
+        {
+            in.put(SrOpBatch(a.resps[j]));
+        }
+    }
+
+    // undo the moves in reverse order, then tag the acknowledged batches
+    a.acked.resize(max(a.acked.size(), k), 0);
+    for (size_t j = m; j-- > 0;)
+    {
+        const size_t i = a.idx[j];
+        a.pages[j].swap(a.pages[i]);
+        a.acked[i] = a.status[j] >= 0 ? _tag(a.pages[i]) : 0;
+    }
+
+    a.pages[0].swap(a.buf);
+
+    size_t n = 0;
+    for (; n < k && a.acked.front(); ++n)
+    {
+        _pop(p, a);
+    }
+
+    return n;
 }
 
 void *SrReporter::func(void *arg)
 {
     SrReporter* const rpt = (SrReporter*) arg;
-    int rc = 0;
     void* const net = rpt->http ? (void*) rpt->http.get() : (void*) rpt->mqtt.get();
     _Pager* const pager = rpt->ptr.get();
     MyMqttMsgHandler mh(rpt->in);
@@ -717,7 +601,7 @@ void *SrReporter::func(void *arg)
 
     if (rpt->isfilebuf)
     {
-        const string s = "filebuf: " + to_string(SR_FILEBUF_VER);
+        const string s = "filebuf: engine " + to_string(SR_FILEBUF_ENGINE);
 
         // trace
         srNotice(s + ", " + to_string(SR_FILEBUF_PAGE_SIZE));
@@ -726,66 +610,98 @@ void *SrReporter::func(void *arg)
     // trace
     srInfo("reporter: buf capacity: " + to_string(pager->capacity()));
 
-    size_t bsize = pager->bsize();
-    string data = pager->front();
-    string aggre = aggregate(rpt->out, pager, rpt->isfilebuf, rpt->xid);
+    std::deque<SrNews> pend, hot;
+    _Arena &arena = *rpt->arena;
+    string &data = arena.buf;
+    int64_t t0 = 0, ty = _now();
 
-    if (bsize <= 1)
-    {
-        data += aggre;
-    }
+    // trace
+    srInfo("reporter: listening...");
 
-    if (!data.empty())
+    while (true)
     {
-        rc = exp_send(net, ishttp, data, rpt->in, rpt->xid);
+        // wait until the batch is due, or for one latency period when idle
+        rpt->collect(pend, t0);
+        rpt->nused = pager->used();
 
-        if (rc == 0)
-        {   // on success
-
-            if (bsize <= 1)
-            {
-                pager->clear();
-            }
-            else
+        if (rpt->mqtt && (pend.empty() || _now() - ty >= 1000))
+        {   // poll the connection when idle, but at least once per second
+            ty = _now();
+            if (rpt->mqtt->yield(1000) == -1)
             {
-                pager->pop_front();
+                _mqtt_connect(rpt->mqtt.get(), true, rpt->xid);
             }
         }
-    }
 
-    // trace
-    srInfo("reporter: listening...");
+        topup(rpt->out, pend);
+        t0 = t0 == 0 && !pend.empty() ? _now() : t0;
+        const size_t bsize = pager->bsize();
 
-    while (true)
-    {
-        // wait for a period of time between report sending (SR_REPORTER_VAL is given in milliseconds)
-        static const timespec ts = { SR_REPORTER_VAL / 1000, (SR_REPORTER_VAL % 1000) * 1000000 };
-        nanosleep(&ts, NULL);
+        if (bsize > 1 && !rpt->sleeping)
+        {   // urgent messages preempt the backlog replay, which still
+            // sends its next batch below, hence never starves
+            split(pend, hot);
+        }
+
+        // urgent batches are tried once, without retry waits. Once one
+        // fails the link is down, the remaining ones are buffered in the
+        // urgent lane right away, and the backlog waits for the next cycle
+        bool down = false;
+        while (!hot.empty())
+        {
+            arena.clear();
+            const int m = aggregate(hot, NULL, arena, rpt->xid);
+            rpt->count(m, data.size(), t0);
+
+            if (down || exp_send(net, ishttp, data, rpt->in, rpt->xid, 1))
+            {
+                down = true;
+                if (!arena.spans.empty())
+                {
+                    pager->emplace_back(data.data(), arena.spans);
+                }
+            }
+        }
 
         // pre-fetching
-        bsize = pager->bsize();
-        data = pager->front();
+        arena.clear();
+        pager->front(data);
+        const size_t n = data.size();
+        const int m = aggregate(pend, pager, arena, rpt->xid);
 
-        if (rpt->mqtt && rpt->mqtt->yield(1000) == -1)
+        if (m > 0)
         {
-            _mqtt_connect(rpt->mqtt.get(), true, rpt->xid);
+            rpt->count(m, data.size() - n, t0);
         }
 
-        aggre = aggregate(rpt->out, pager, rpt->isfilebuf, rpt->xid);
+        t0 = pend.empty() ? 0 : t0;
 
-        if (bsize <= 1)
-        {
-            data += aggre;
+        if (bsize > 1)
+        {   // send the buffered front only, the aggregate is in the pager
+            data.resize(n);
         }
 
         // sleeping mode
-        if (rpt->sleeping || data.empty())
+        if (rpt->sleeping || data.empty() || down)
+        {
+            continue;
+        }
+
+        // the last batch is still open for appending, hence not replayed
+        const size_t k = ishttp && bsize > 1 ? min<size_t>(rpt->inflight, bsize - 1) : 1;
+        if (k > 1 && replay(rpt->http.get(), pager, arena, k, rpt->in))
         {
             continue;
         }
 
+        if (bsize > 1 && _acked(arena, 0, data))
+        {   // acknowledged by a replay with a smaller window
+            _pop(pager, arena);
+            continue;
+        }
+
         // sending with exponential wait
-        rc = exp_send(net, ishttp, data, rpt->in, rpt->xid);
+        const int rc = exp_send(net, ishttp, data, rpt->in, rpt->xid);
 
         if (rc == 0)
         {   // on success
@@ -793,10 +709,11 @@ void *SrReporter::func(void *arg)
             if (bsize <= 1)
             {
                 pager->clear();
+                arena.acked.clear();
             }
             else
             {
-                pager->pop_front();
+                _pop(pager, arena);
             }
         }
     }
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstring>
+#include "srstreamparser.h"
+#include "srlogger.h"
+
+using namespace std;
+
+int SrStreamParser::feed(const char *p, size_t n)
+{
+    // records delivered so far are no longer referenced
+    if (pos)
+    {
+        buf.erase(0, pos);
+        pos = 0;
+    }
+
+    buf.append(p, n);
+
+    // no record can complete without a newline in this chunk
+    const int c = memchr(p, '\n', n) ? parse(false) : 0;
+
+    if (limit && pending() > limit)
+    {
+        srError("stream: record exceeds " + to_string(limit) + " bytes");
+        reset();
+
+        return -1;
+    }
+
+    return c;
+}
+
+int SrStreamParser::finish()
+{
+    const int c = parse(true);
+    reset();
+
+    return c;
+}
+
+int SrStreamParser::parse(bool last)
+{
+    const char* const base = buf.data() + pos;
+    SrLexer::SrTokenView t;
+    size_t done = 0;
+    int c = 0;
+
+    // re-scan from the start of the first incomplete record, a lexer
+    // starting after a newline is in the same state as one passing it
+    lex.reset(base, buf.size() - pos);
+
+    while (true)
+    {
+        r.reset(base);
+
+        for (lex.scan(t); !lex.isdelimiter(t.type); lex.scan(t))
+        {
+            r.push_back(t);
+        }
+
+        if (t.type == SrLexer::SR_EOB && !last)
+        {   // incomplete record, wait for more data
+            break;
+        }
+
+        if (r.size())
+        {
+            h(r, base + done, lex.end - done);
+            ++c;
+        }
+
+        done = lex.end;
+
+        if (t.type == SrLexer::SR_EOB)
+        {
+            break;
+        }
+    }
+
+    pos += done;
+
+    if (c)
+    {
+        h.flush();
+    }
+
+    return c;
+}
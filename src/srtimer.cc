@@ -19,8 +19,175 @@
  */
 
 #include "srtimer.h"
+#include "srtimerqueue.h"
 
 bool operator<=(const timespec &l, const timespec &r)
 {
     return l.tv_sec == r.tv_sec ? l.tv_nsec <= r.tv_nsec : l.tv_sec <= r.tv_sec;
 }
+
+SrTimer::~SrTimer()
+{
+    if (tq)
+    {
+        tq->remove(*this);
+    }
+}
+
+static int64_t _ns(const timespec &t)
+{
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int64_t _now(clockid_t clk)
+{
+    timespec t;
+    clock_gettime(clk, &t);
+
+    return _ns(t);
+}
+
+void SrTimer::modify(const std::function<void()> &fn)
+{
+    if (tq)
+    {
+        tq->update(*this, fn);
+    } else
+    {
+        fn();
+    }
+}
+
+void SrTimer::start()
+{
+    modify([this]()
+    {
+        clock_gettime(CLOCK_MONOTONIC, &beg);
+        skipped = nmissed = 0;
+
+        if (periodic)
+        {
+            wall = align > 0;
+
+            if (wall)
+            {   // first fire at the next wall clock boundary
+                const int64_t a = (int64_t) align * 1000000;
+                anchor = (_now(CLOCK_REALTIME) / a + 1) * a;
+                nth = 0;
+            } else
+            {
+                anchor = _ns(beg);
+                nth = 1;
+            }
+
+            armPeriod();
+        } else
+        {
+            arm();
+        }
+
+        active = true;
+    });
+}
+
+void SrTimer::setInterval(int millisec)
+{
+    modify([this, millisec]()
+    {
+        val = millisec;
+
+        if (!active)
+        {
+            return;
+        } else if (periodic)
+        {   // the new period counts from the previous fire time
+            anchor = _ns(beg);
+            if (wall)
+            {
+                anchor += _now(CLOCK_REALTIME) - _now(CLOCK_MONOTONIC);
+            }
+
+            nth = 1;
+            armPeriod();
+        } else
+        {
+            arm();
+        }
+    });
+}
+
+bool SrTimer::rearm(const timespec &now)
+{
+    bool run = true;
+
+    modify([this, &now, &run]()
+    {
+        const int64_t d = _ns(end);
+        const int64_t p = (int64_t) val * 1000000;
+        const int64_t late = _ns(now) - d;
+        const uint32_t k = p > 0 && late > 0 ? late / p : 0;
+
+        switch (policy)
+        {
+        case SKIP:
+            if (k)
+            {
+                run = false;
+                skipped += k + 1;
+                nth += k + 1;
+            } else
+            {
+                nmissed = skipped;
+                skipped = 0;
+                ++nth;
+            }
+            break;
+        case COALESCE:
+            nmissed = k;
+            nth += k + 1;
+            break;
+        case BURST:
+            nmissed = k;
+            ++nth;
+            break;
+        }
+
+        beg = end;
+        armPeriod();
+    });
+
+    return run;
+}
+
+void SrTimer::armPeriod()
+{
+    int64_t d = anchor + (int64_t) nth * val * 1000000;
+    if (wall)
+    {   // convert from wall clock with the current offset
+        d += _now(CLOCK_MONOTONIC) - _now(CLOCK_REALTIME);
+    }
+
+    d = d < 0 ? 0 : d;
+    end.tv_sec = d / 1000000000;
+    end.tv_nsec = d % 1000000000;
+}
+
+void SrTimer::arm()
+{
+    end.tv_sec = beg.tv_sec + val / 1000;
+    end.tv_nsec = beg.tv_nsec + (val % 1000) * 1000000;
+
+    if (end.tv_nsec >= 1000000000)
+    {
+        ++end.tv_sec;
+        end.tv_nsec -= 1000000000;
+    }
+}
+
+void SrTimer::stop()
+{
+    modify([this]()
+    {
+        active = false;
+    });
+}
@@ -0,0 +1,493 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <limits>
+#include <algorithm>
+#include <unistd.h>
+#include <stdint.h>
+#include "srtimerqueue.h"
+
+using namespace std;
+
+static bool operator<(const timespec &l, const timespec &r)
+{
+    return l.tv_sec == r.tv_sec ? l.tv_nsec < r.tv_nsec : l.tv_sec < r.tv_sec;
+}
+
+SrTimerQueue::SrTimerQueue() :
+        awaited(), efd(-1), waiting(false)
+{
+    mutex = PTHREAD_MUTEX_INITIALIZER;
+}
+
+SrTimerQueue::~SrTimerQueue()
+{
+    for (auto &e : timers)
+    {
+        e->tq = NULL;
+        e->queued = false;
+    }
+
+    pthread_mutex_destroy(&mutex);
+}
+
+void SrTimerQueue::add(SrTimer &timer)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (timers.insert(&timer).second)
+    {
+        timer.tq = this;
+
+        if (timer.isActive())
+        {
+            schedule(timer);
+            timer.queued = true;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+void SrTimerQueue::remove(SrTimer &timer)
+{
+    pthread_mutex_lock(&mutex);
+
+    if (timers.erase(&timer))
+    {
+        if (timer.queued)
+        {
+            unschedule(timer);
+            timer.queued = false;
+        }
+
+        timer.tq = NULL;
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+void SrTimerQueue::update(SrTimer &timer)
+{
+    update(timer, [](){});
+}
+
+void SrTimerQueue::update(SrTimer &timer, const function<void()> &fn)
+{
+    bool wake = false;
+    pthread_mutex_lock(&mutex);
+    fn();
+
+    if (timer.queued)
+    {
+        unschedule(timer);
+        timer.queued = false;
+    }
+
+    if (timer.isActive())
+    {
+        schedule(timer);
+        timer.queued = true;
+        wake = waiting && timer.fireTime() < awaited;
+        if (wake)
+        {
+            awaited = timer.fireTime();
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    if (wake && efd != -1)
+    {
+        const uint64_t v = 1;
+        if (write(efd, &v, sizeof(v)) == -1)
+        {
+            // the counter is saturated, the sleeper wakes up anyway
+        }
+    }
+}
+
+void SrTimerQueue::moveTo(SrTimerQueue &other)
+{
+    pthread_mutex_lock(&mutex);
+
+    const vector<SrTimer*> vec(timers.begin(), timers.end());
+    for (auto &e : vec)
+    {
+        if (e->queued)
+        {
+            unschedule(*e);
+            e->queued = false;
+        }
+
+        e->tq = NULL;
+    }
+
+    timers.clear();
+    pthread_mutex_unlock(&mutex);
+
+    for (auto &e : vec)
+    {
+        other.add(*e);
+    }
+}
+
+size_t SrTimerQueue::expired(const timespec &now, vector<SrTimer*> &fired)
+{
+    pthread_mutex_lock(&mutex);
+
+    const size_t n = fired.size();
+    expire(now, fired);
+
+    for (size_t i = n; i < fired.size(); ++i)
+    {
+        fired[i]->queued = false;
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return fired.size() - n;
+}
+
+bool SrTimerQueue::wait(timespec &t)
+{
+    pthread_mutex_lock(&mutex);
+
+    const bool has = next(t);
+    awaited.tv_sec = has ? t.tv_sec : numeric_limits<time_t>::max();
+    awaited.tv_nsec = has ? t.tv_nsec : 0;
+    waiting = true;
+
+    pthread_mutex_unlock(&mutex);
+
+    return has;
+}
+
+void SrTimerQueue::awake()
+{
+    pthread_mutex_lock(&mutex);
+    waiting = false;
+    pthread_mutex_unlock(&mutex);
+}
+
+void SrTimerHeap::schedule(SrTimer &timer)
+{
+    heap.push_back(_Entry(timer.fireTime(), &timer));
+    place(heap.size() - 1, heap.back());
+    up(heap.size() - 1);
+}
+
+void SrTimerHeap::unschedule(SrTimer &timer)
+{
+    const size_t i = position(timer);
+    const _Entry last = heap.back();
+    heap.pop_back();
+
+    if (i < heap.size())
+    {
+        place(i, last);
+        up(i);
+        down(position(*last.second));
+    }
+}
+
+bool SrTimerHeap::next(timespec &t)
+{
+    if (heap.empty())
+    {
+        return false;
+    }
+
+    t = heap.front().first;
+
+    return true;
+}
+
+void SrTimerHeap::expire(const timespec &now, vector<SrTimer*> &fired)
+{
+    while (!heap.empty() && heap.front().first <= now)
+    {
+        SrTimer* const t = heap.front().second;
+        unschedule(*t);
+        fired.push_back(t);
+    }
+}
+
+void SrTimerHeap::up(size_t i)
+{
+    const _Entry e = heap[i];
+
+    while (i > 0)
+    {
+        const size_t p = (i - 1) / 2;
+        if (!(e.first < heap[p].first))
+        {
+            break;
+        }
+
+        place(i, heap[p]);
+        i = p;
+    }
+
+    place(i, e);
+}
+
+void SrTimerHeap::down(size_t i)
+{
+    const _Entry e = heap[i];
+    const size_t n = heap.size();
+
+    while (2 * i + 1 < n)
+    {
+        size_t c = 2 * i + 1;
+        if (c + 1 < n && heap[c + 1].first < heap[c].first)
+        {
+            ++c;
+        }
+
+        if (!(heap[c].first < e.first))
+        {
+            break;
+        }
+
+        place(i, heap[c]);
+        i = c;
+    }
+
+    place(i, e);
+}
+
+SrTimerWheel::SrTimerWheel() :
+        slots(), bitmap(), origin(), cur(0)
+{
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+}
+
+uint64_t SrTimerWheel::ticks(const timespec &t, bool up) const
+{
+    if (t <= origin)
+    {
+        return 0;
+    }
+
+    const uint64_t ns = (uint64_t) (t.tv_sec - origin.tv_sec) * 1000000000
+            + t.tv_nsec - origin.tv_nsec;
+
+    return (ns + (up ? 999999 : 0)) / 1000000;
+}
+
+void SrTimerWheel::link(SrTimer &timer)
+{
+    const uint64_t tick = key(timer);
+    size_t pos = READY;
+
+    if (tick > cur)
+    {
+        // the level is the highest byte where the fire tick and the current
+        // tick differ, so the timer is cascaded exactly when the current
+        // tick reaches its slot on that level
+        const uint64_t d = tick ^ cur;
+        size_t l = 0;
+        while (l + 1 < LEVELS && (d >> (BITS * (l + 1))))
+        {
+            ++l;
+        }
+
+        size_t slot = (tick >> (BITS * l)) & (SLOTS - 1);
+        if (d >> (BITS * LEVELS))
+        {   // beyond the wheel, park in the last slot of the top level
+            slot = ((cur >> (BITS * l)) - 1) & (SLOTS - 1);
+        }
+
+        pos = l * SLOTS + slot;
+        bitmap[l][slot / 64] |= (uint64_t) 1 << (slot % 64);
+    }
+
+    prevOf(timer) = NULL;
+    nextOf(timer) = slots[pos];
+    if (slots[pos])
+    {
+        prevOf(*slots[pos]) = &timer;
+    }
+
+    slots[pos] = &timer;
+    position(timer) = pos;
+}
+
+void SrTimerWheel::unlink(SrTimer &timer)
+{
+    const size_t pos = position(timer);
+    SrTimer* const p = prevOf(timer);
+    SrTimer* const n = nextOf(timer);
+
+    if (p)
+    {
+        nextOf(*p) = n;
+    } else
+    {
+        slots[pos] = n;
+    }
+
+    if (n)
+    {
+        prevOf(*n) = p;
+    }
+
+    if (slots[pos] == NULL && pos < READY)
+    {
+        const size_t slot = pos % SLOTS;
+        bitmap[pos / SLOTS][slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+    }
+}
+
+void SrTimerWheel::schedule(SrTimer &timer)
+{
+    key(timer) = ticks(timer.fireTime(), true);
+    link(timer);
+}
+
+void SrTimerWheel::unschedule(SrTimer &timer)
+{
+    unlink(timer);
+}
+
+void SrTimerWheel::cascade(size_t level)
+{
+    const size_t pos = level * SLOTS + ((cur >> (BITS * level)) & (SLOTS - 1));
+
+    while (slots[pos])
+    {
+        SrTimer &timer = *slots[pos];
+        unlink(timer);
+        link(timer);
+    }
+}
+
+void SrTimerWheel::collect(size_t pos, vector<SrTimer*> &fired)
+{
+    while (slots[pos])
+    {
+        fired.push_back(slots[pos]);
+        unlink(*slots[pos]);
+    }
+}
+
+int SrTimerWheel::findSlot(size_t level, size_t from) const
+{
+    for (size_t w = from / 64; w < SLOTS / 64; ++w)
+    {
+        uint64_t bits = bitmap[level][w];
+        if (w == from / 64)
+        {
+            bits &= ~(uint64_t) 0 << (from % 64);
+        }
+
+        if (bits)
+        {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+
+    return -1;
+}
+
+void SrTimerWheel::expire(const timespec &now, vector<SrTimer*> &fired)
+{
+    const uint64_t target = ticks(now, false);
+
+    collect(READY, fired);
+
+    while (cur < target)
+    {
+        // fire level 0 slots up to the target or the end of this rotation
+        const uint64_t end = std::min(target, cur | (SLOTS - 1));
+        int s = cur & (SLOTS - 1);
+
+        while ((s = findSlot(0, s + 1)) != -1 && (uint64_t) s <= (end & (SLOTS - 1)))
+        {
+            collect(s, fired);
+        }
+
+        if (end == target)
+        {
+            cur = target;
+            break;
+        }
+
+        // next rotation, cascade higher levels as their index wraps
+        cur = end + 1;
+        for (size_t l = 1; l < LEVELS; ++l)
+        {
+            cascade(l);
+            if ((cur >> (BITS * l)) & (SLOTS - 1))
+            {
+                break;
+            }
+        }
+
+        collect(READY, fired);
+    }
+}
+
+bool SrTimerWheel::next(timespec &t)
+{
+    uint64_t tick = cur;
+
+    if (slots[READY] == NULL)
+    {
+        size_t l = 0;
+        int s = -1;
+        for (; l < LEVELS; ++l)
+        {
+            const size_t idx = (cur >> (BITS * l)) & (SLOTS - 1);
+            if ((s = findSlot(l, idx + 1)) != -1 || (l + 1 == LEVELS
+                    && (s = findSlot(l, 0)) != -1))
+            {
+                break;
+            }
+        }
+
+        if (s == -1)
+        {
+            return false;
+        }
+
+        // lower bound of the slot, timers on higher levels are cascaded
+        // when it is reached
+        const unsigned shift = BITS * (l + 1);
+        uint64_t upper = shift < 64 ? cur >> shift << shift : 0;
+        if ((size_t) s <= ((cur >> (BITS * l)) & (SLOTS - 1)))
+        {   // parked beyond the wheel, next round of the top level
+            upper += (uint64_t) 1 << shift;
+        }
+
+        tick = upper | (uint64_t) s << (BITS * l);
+    }
+
+    t.tv_sec = origin.tv_sec + tick / 1000;
+    t.tv_nsec = origin.tv_nsec + (tick % 1000) * 1000000;
+    if (t.tv_nsec >= 1000000000)
+    {
+        ++t.tv_sec;
+        t.tv_nsec -= 1000000000;
+    }
+
+    return true;
+}
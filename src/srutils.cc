@@ -19,9 +19,18 @@
  */
 
 #include <fstream>
+#include <cstring>
 #include "srutils.h"
 #include "smartrest.h"
 
+#if defined(__x86_64__) && (defined(__SSE4_2__) || defined(__GNUC__))
+#include <nmmintrin.h>
+#define SR_CRC32C_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define SR_CRC32C_ARM
+#endif
+
 using namespace std;
 
 
@@ -223,3 +232,94 @@ string b64Decode(const string &s)
 
     return ret;
 }
+
+#if !defined(SR_CRC32C_ARM) && !(defined(SR_CRC32C_X86) && defined(__SSE4_2__))
+/**
+ *  Table for the reflected CRC-32C polynomial 0x82f63b78.
+ */
+static const uint32_t *_crcTable()
+{
+    static uint32_t t[256];
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t c = i;
+        for (int j = 0; j < 8; ++j)
+        {
+            c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+        }
+
+        t[i] = c;
+    }
+
+    return t;
+}
+
+static uint32_t _crc32cSw(uint32_t crc, const uint8_t *p, size_t n)
+{
+    static const uint32_t* const t = _crcTable();
+    for (size_t i = 0; i < n; ++i)
+    {
+        crc = t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+#endif
+
+#if defined(SR_CRC32C_X86)
+#ifndef __SSE4_2__
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t _crc32cHw(uint32_t crc, const uint8_t *p, size_t n)
+{
+    uint64_t c = crc;
+    for (uint64_t x; n >= 8; p += 8, n -= 8)
+    {
+        memcpy(&x, p, 8);
+        c = _mm_crc32_u64(c, x);
+    }
+
+    crc = c;
+    for (; n; ++p, --n)
+    {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+
+    return crc;
+}
+#elif defined(SR_CRC32C_ARM)
+static uint32_t _crc32cHw(uint32_t crc, const uint8_t *p, size_t n)
+{
+    for (uint64_t x; n >= 8; p += 8, n -= 8)
+    {
+        memcpy(&x, p, 8);
+        crc = __crc32cd(crc, x);
+    }
+
+    for (; n; ++p, --n)
+    {
+        crc = __crc32cb(crc, *p);
+    }
+
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *p, size_t n)
+{
+    const uint8_t* const s = (const uint8_t*) p;
+    crc = ~crc;
+
+#if defined(SR_CRC32C_X86) && defined(__SSE4_2__)
+    crc = _crc32cHw(crc, s, n);
+#elif defined(SR_CRC32C_X86)
+    static const bool hw = __builtin_cpu_supports("sse4.2");
+    crc = hw ? _crc32cHw(crc, s, n) : _crc32cSw(crc, s, n);
+#elif defined(SR_CRC32C_ARM)
+    crc = _crc32cHw(crc, s, n);
+#else
+    crc = _crc32cSw(crc, s, n);
+#endif
+
+    return ~crc;
+}
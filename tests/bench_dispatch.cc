@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <sragent.h>
+
+using namespace std;
+
+const int RECORDS = 10000;
+const int ROUNDS = 100;
+
+static timespec t0;
+
+static double since(const timespec &t)
+{
+    timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (t1.tv_sec - t.tv_sec) * 1e9 + (t1.tv_nsec - t.tv_nsec);
+}
+
+class Counter: public SrMsgHandler
+{
+public:
+    Counter() :
+            n(0)
+    {
+    }
+
+    void operator()(SrRecord &r, SrAgent &agent)
+    {
+        if (++n == (long) RECORDS * ROUNDS)
+        {
+            printf("agent:  %8.1f ns/record (lexing and dispatch)\n",
+                    since(t0) / n);
+            exit(0);
+        }
+    }
+
+    long n;
+};
+
+int main()
+{
+    // 10k records, 64 message IDs of the default template, every 8th
+    // section for an additional template
+    vector<pair<uint32_t, uint16_t>> keys;
+    string batch;
+    for (int i = 0; i < RECORDS; ++i)
+    {
+        const uint32_t xid = i % 1024 < 128 ? 4711 : 0;
+        if (i % 1024 == 0 || i % 1024 == 128)
+        {
+            batch += "87,1," + to_string(xid) + "\n";
+        }
+
+        const uint16_t id = 100 + (i * 7) % 64 * 13;
+        keys.emplace_back(xid, id);
+        batch += to_string(id) + ",1234," + to_string(i) + "\n";
+    }
+
+    // lookup only, the former std::map tables against the new ones
+    Counter c;
+    map<uint16_t, SrMsgHandler*> m;
+    map<pair<uint32_t, uint16_t>, SrMsgHandler*> xm;
+    SrAgent agent("", "", NULL, NULL);
+
+    for (auto &e : keys)
+    {
+        if (e.first)
+        {
+            xm[e] = &c;
+            agent.addXMsgHandler(e.first, e.second, &c);
+        } else
+        {
+            m[e.second] = &c;
+            agent.addMsgHandler(e.second, &c);
+        }
+    }
+
+    vector<string> ids;
+    for (auto &e : keys)
+    {
+        ids.push_back(to_string(e.second));
+    }
+
+    long hits = 0;
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (int i = 0; i < RECORDS; ++i)
+        {
+            const uint16_t id = strtoul(ids[i].c_str(), NULL, 10);
+            const uint32_t xid = keys[i].first;
+            hits += (xid ? xm.find(make_pair(xid, id))->second :
+                    m.find(id)->second) != NULL;
+        }
+    }
+    printf("map:    %8.1f ns/record (strtoul and lookup)\n", since(t) / hits);
+
+    SrAgent::MsgTable mt;
+    SrAgent::XMsgTable xmt;
+    for (auto &e : keys)
+    {
+        if (e.first)
+        {
+            xmt.set(e.first, e.second, &c);
+        } else
+        {
+            mt.set(e.second, &c);
+        }
+    }
+
+    hits = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (int i = 0; i < RECORDS; ++i)
+        {
+            const char *p = ids[i].c_str();
+            uint16_t id = 0;
+            for (; *p >= '0' && *p <= '9'; ++p)
+            {
+                id = id * 10 + (*p - '0');
+            }
+
+            const uint32_t xid = keys[i].first;
+            hits += (xid ? xmt.find(xid, id) : mt.find(id)) != NULL;
+        }
+    }
+    printf("table:  %8.1f ns/record (parse and lookup)\n", since(t) / hits);
+
+    // same lookups through the agent dispatch path
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        agent.ingress.put(SrOpBatch(batch));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    agent.loop();
+
+    return 0;
+}
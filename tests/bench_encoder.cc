@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <new>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <srencoder.h>
+
+using namespace std;
+
+const int N = 1000000;
+
+static long allocs = 0;
+
+void *operator new(size_t n)
+{
+    ++allocs;
+    void* const p = malloc(n ? n : 1);
+    if (p == NULL)
+    {
+        throw bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static double since(const timespec &t)
+{
+    timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (t1.tv_sec - t.tv_sec) * 1e9 + (t1.tv_nsec - t.tv_nsec);
+}
+
+static void report(const char *name, const timespec &t0, size_t bytes)
+{
+    printf("%-14s %8.1f ns/msg %6.2f allocs/msg (%zu bytes)\n", name,
+            since(t0) / N, (double) allocs / N, bytes);
+    allocs = 0;
+}
+
+int main()
+{
+    // the measurement of examples/ex-03-measurement, with a 9 digit
+    // managed object ID and a CPU load with one decimal
+    const string id = "123456789";
+    size_t bytes = 0;
+    timespec t0;
+
+    allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; ++i)
+    {
+        const int cpu = i % 100;
+        SrNews news("103," + id + "," + to_string(cpu));
+        bytes += news.data.size();
+    }
+    report("concat int", t0, bytes);
+
+    bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; ++i)
+    {
+        SrNews news(SrEncoder<103, SrId, SrInt>::news(id, i % 100));
+        bytes += news.data.size();
+    }
+    report("encoder int", t0, bytes);
+
+    bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; ++i)
+    {
+        const double cpu = (i % 1000) / 10.0;
+        SrNews news("103," + id + "," + to_string(cpu));
+        bytes += news.data.size();
+    }
+    report("concat double", t0, bytes);
+
+    bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; ++i)
+    {
+        const double cpu = (i % 1000) / 10.0;
+        SrNews news(SrEncoder<103, SrId, SrFloat<>>::news(id, cpu));
+        bytes += news.data.size();
+    }
+    report("encoder double", t0, bytes);
+
+    // a pooled buffer, e.g., of a batch, re-used after sending
+    string pool;
+    bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; ++i)
+    {
+        const double cpu = (i % 1000) / 10.0;
+        pool.clear();
+        SrEncoder<103, SrId, SrFloat<>>::append(pool, id, cpu);
+        bytes += pool.size();
+    }
+    report("pooled double", t0, bytes);
+
+    return 0;
+}
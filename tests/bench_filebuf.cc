@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <unistd.h>
+#include <srpager.h>
+
+using namespace std;
+
+const char* const path = "tests/bench.buf";
+const size_t CYCLE = 64; // messages per reporter cycle
+
+static double since(const timespec &t0)
+{
+    timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static void cleanup()
+{
+    unlink(path);
+    unlink((string(path) + ".index").c_str());
+    unlink((string(path) + ".ckpt").c_str());
+    for (int i = 0; i < 1000; ++i)
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), ".%06d", i);
+        unlink((path + string(buf)).c_str());
+    }
+}
+
+// append n messages in reporter cycles, then replay and pop all batches
+static void run(const char *name, int engine, const string &fn, size_t n)
+{
+    string arena;
+    _Spans v;
+    for (size_t i = 0; i < CYCLE; ++i)
+    {
+        const string s = "200,c8y_Temperature,T," + to_string(20 + i % 10)
+                + ",2019-01-01T00:00:00.000Z\n";
+        v.emplace_back(arena.size(), s.size());
+        arena += s;
+    }
+
+    cleanup();
+    unique_ptr<_Pager> p(_Pager::create(engine, fn, 1 << 14));
+    timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i = 0; i < n; i += CYCLE)
+    {
+        p->emplace_back(arena.data(), v);
+    }
+    const double ta = since(t0);
+
+    string s;
+    size_t bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (!p->empty())
+    {
+        s.clear();
+        p->front(s);
+        bytes += s.size();
+        p->pop_front();
+    }
+    const double tr = since(t0);
+
+    uint64_t raw, stored;
+    p->ratio(raw, stored);
+    printf("%8s %8zu %12.0f %12.0f %10.1f %8.1f\n", name, n, n / ta, n / tr,
+            bytes / tr / (1 << 20), stored ? (double) raw / stored : 1.0);
+    p.reset();
+    cleanup();
+}
+
+int main()
+{
+    printf("%8s %8s %12s %12s %10s %8s\n", "engine", "msgs", "append/s",
+            "replay/s", "replay MB/s", "ratio");
+
+    for (size_t n = 1000; n <= 100000; n *= 10)
+    {
+        run("memory", SR_FILEBUF_STREAM, "", n);
+        run("stream", SR_FILEBUF_STREAM, path, n);
+        run("mmap", SR_FILEBUF_MMAP, path, n);
+        run("log", SR_FILEBUF_LOG, path, n);
+        run("zip", SR_FILEBUF_STREAM | SR_FILEBUF_ZIP, path, n);
+    }
+
+    return 0;
+}
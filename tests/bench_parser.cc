@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <new>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <smartrest.h>
+
+using namespace std;
+
+const int RECORDS = 10000;
+const int ROUNDS = 20;
+
+static long allocs = 0;
+
+void *operator new(size_t n)
+{
+    ++allocs;
+    void* const p = malloc(n ? n : 1);
+    if (p == NULL)
+    {
+        throw bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static double since(const timespec &t)
+{
+    timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (t1.tv_sec - t.tv_sec) * 1e9 + (t1.tv_nsec - t.tv_nsec);
+}
+
+/**
+ *  The copying lexer and parser before the zero-copy rewrite, as baseline.
+ */
+class CopyLexer
+{
+public:
+    CopyLexer(const string &_s) : s(_s), end(0), delimit(false)
+    {
+    }
+
+    SrLexer::SrToken next()
+    {
+        SrLexer::SrToken tok;
+
+        if (end == s.size())
+        {
+            tok.first = SrLexer::SR_EOB;
+            return tok;
+        }
+
+        if (delimit)
+        {
+            for (; end < s.size(); ++end)
+            {
+                if (s[end] == ',')
+                {
+                    ++end;
+                    break;
+                } else if (s[end] == '\n')
+                {
+                    tok.first = SrLexer::SR_NEWLINE;
+                    tok.second = s[end++];
+                    delimit = false;
+
+                    return tok;
+                }
+            }
+        }
+
+        for (; end < s.size() && !isgraph(s[end]) && s[end] != '\n'; ++end)
+        {
+        }
+
+        bool escape = false;
+        size_t digits = 0, others = 0, dots = 0;
+
+        if (s[end] == '"')
+        {
+            escape = true;
+            ++end;
+        } else if (s[end] == '+' || s[end] == '-')
+        {
+            tok.second += s[end++];
+        }
+
+        for (; isprint(s[end]) || escape; ++end)
+        {
+            if (isdigit(s[end]))
+            {
+                ++digits;
+            } else if (s[end] == '.')
+            {
+                ++dots;
+            } else if (s[end] == '"')
+            {
+                if (!escape)
+                {
+                    break;
+                }
+
+                ++end;
+
+                if (s[end] == '"')
+                {
+                    ++others;
+                } else
+                {
+                    escape = false;
+                    break;
+                }
+            } else if (s[end] == ',' || s[end] == '\n')
+            {
+                if (escape)
+                {
+                    ++others;
+                } else
+                {
+                    break;
+                }
+            } else
+            {
+                ++others;
+            }
+
+            tok.second += s[end];
+        }
+
+        if (escape)
+        {
+            tok.first = SrLexer::SR_ERROR;
+        } else if (others || dots > 1)
+        {
+            tok.first = SrLexer::SR_STRING;
+        } else if (dots)
+        {
+            tok.first = digits ? SrLexer::SR_FLOAT : SrLexer::SR_STRING;
+        } else if (digits)
+        {
+            tok.first = SrLexer::SR_INT;
+        } else
+        {
+            tok.first = tok.second.empty() ? SrLexer::SR_NONE : SrLexer::SR_STRING;
+        }
+
+        delimit = true;
+
+        return tok;
+    }
+
+    vector<SrLexer::SrToken> record()
+    {
+        vector<SrLexer::SrToken> r;
+        SrLexer::SrToken t = next();
+
+        for (; t.first != SrLexer::SR_NEWLINE && t.first != SrLexer::SR_EOB;
+                t = next())
+        {
+            r.push_back(t);
+        }
+
+        return r;
+    }
+
+private:
+    string s;
+    size_t end;
+    bool delimit;
+};
+
+static void report(const char *name, double ns, long n, double base)
+{
+    printf("%-10s %8.1f ns/record %8.2f allocs/record %6.1fx\n", name,
+            ns / RECORDS / ROUNDS, (double) n / RECORDS / ROUNDS,
+            base ? base / ns : 1.0);
+}
+
+static void bench(const char *title, const string &batch)
+{
+    size_t fields = 0;
+    timespec t0;
+
+    printf("%s\n", title);
+    allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int k = 0; k < ROUNDS; ++k)
+    {
+        CopyLexer lex(batch);
+        for (vector<SrLexer::SrToken> r = lex.record(); r.size(); r = lex.record())
+        {
+            fields += r.size();
+        }
+    }
+    const double base = since(t0);
+    const size_t total = fields;
+    report("copying", base, allocs, 0);
+
+    allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int k = 0; k < ROUNDS; ++k)
+    {
+        SrParser sr(batch);
+        for (SrRecord r = sr.next(); r.size(); r = sr.next())
+        {
+            fields -= r.size();
+        }
+    }
+    report("next()", since(t0), allocs, base);
+
+    allocs = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    SrRecord r;
+    for (int k = 0; k < ROUNDS; ++k)
+    {
+        SrParser sr(batch);
+        while (sr.next(r))
+        {
+            fields += r.size();
+        }
+    }
+    report("next(r)", since(t0), allocs, base);
+
+    // next() counted down to 0, next(r) up again
+    if (fields != total)
+    {
+        printf("field count mismatch\n");
+    }
+}
+
+int main()
+{
+    // an operation batch as sent by the platform, with long quoted values
+    string batch;
+    for (int i = 0; i < RECORDS; ++i)
+    {
+        batch += "511,1234" + to_string(i) + ",\"set configuration to "
+                "\"\"mode=eco, interval=60\"\" for the whole fleet of devices\","
+                "-12.5,3600,EXECUTING,c8y_Configuration,"
+                "\"firmware-update-package-" + to_string(i) + ".bin\"\n";
+    }
+    bench("short values", batch);
+
+    // operations carrying a configuration file or a shell script
+    const string text(400, 'x');
+    batch.clear();
+    for (int i = 0; i < RECORDS; ++i)
+    {
+        batch += "513,1234" + to_string(i) + ",\"" + text + "\",\"" + text
+                + "\"\n";
+    }
+    bench("long values", batch);
+
+    return 0;
+}
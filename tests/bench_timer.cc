@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <srtimerqueue.h>
+
+using namespace std;
+
+const int TICKS = 20000;
+
+static double since(const timespec &t0)
+{
+    timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+}
+
+static timespec add(const timespec &t, long millisec)
+{
+    timespec r = { t.tv_sec + millisec / 1000, t.tv_nsec + (millisec % 1000) * 1000000 };
+    if (r.tv_nsec >= 1000000000)
+    {
+        ++r.tv_sec;
+        r.tv_nsec -= 1000000000;
+    }
+
+    return r;
+}
+
+// the former agent loop, scanning all timers on every tick
+static double scan(vector<unique_ptr<SrTimer>> &timers)
+{
+    timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size_t n = 0;
+
+    for (int i = 0; i < TICKS / 10; ++i)
+    {
+        for (auto &e : timers)
+        {
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+            n += e->isActive() && e->fireTime() <= now;
+        }
+    }
+
+    return n ? 0 : since(t0) / (TICKS / 10);
+}
+
+// one agent tick: expiry check and deadline, plus one reschedule
+static void tick(SrTimerQueue &q, vector<unique_ptr<SrTimer>> &timers,
+        double &tns, double &rns)
+{
+    vector<SrTimer*> fired;
+    timespec base, deadline, t0;
+    clock_gettime(CLOCK_MONOTONIC, &base);
+    tns = rns = 0;
+
+    for (int i = 0; i < TICKS; ++i)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        q.expired(add(base, i), fired);
+        q.wait(deadline);
+        q.awake();
+        tns += since(t0);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        timers[rand() % timers.size()]->start();
+        rns += since(t0);
+    }
+
+    tns /= TICKS;
+    rns /= TICKS;
+}
+
+int main()
+{
+    printf("%8s %12s %12s %12s %12s %12s\n", "timers", "scan/tick",
+            "heap/tick", "heap/start", "wheel/tick", "wheel/start");
+
+    for (int n = 10; n <= 100000; n *= 10)
+    {
+        vector<unique_ptr<SrTimer>> timers;
+        SrTimerHeap heap;
+        SrTimerWheel wheel;
+        double ht, hr, wt, wr;
+
+        for (int i = 0; i < n; ++i)
+        {
+            timers.emplace_back(new SrTimer(100000 + rand() % 3600000));
+            timers.back()->start();
+        }
+
+        const double st = scan(timers);
+
+        for (auto &e : timers)
+        {
+            heap.add(*e);
+        }
+        tick(heap, timers, ht, hr);
+        heap.moveTo(wheel);
+        tick(wheel, timers, wt, wr);
+
+        printf("%8d %10.0fns %10.0fns %10.0fns %10.0fns %10.0fns\n", n, st,
+                ht, hr, wt, wr);
+    }
+
+    return 0;
+}
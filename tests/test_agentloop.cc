@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sragent.h>
+
+using namespace std;
+
+static timespec t0;
+static long nvcsw = 0;
+static int stage = 0;
+
+static int elapsed()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - t0.tv_sec) * 1000 + (now.tv_nsec - t0.tv_nsec) / 1000000;
+}
+
+static long switches()
+{
+    rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+
+    return ru.ru_nvcsw;
+}
+
+class MsgCallback: public SrMsgHandler
+{
+public:
+    void operator()(SrRecord &r, SrAgent &agent)
+    {
+        // woken up by the ingress batch put at 100 ms
+        const int t = elapsed();
+        assert(stage == 0 && r.size() == 2 && t >= 100 && t < 120);
+        stage = 1;
+    }
+};
+
+class TimerCallback: public SrTimerHandler
+{
+public:
+    void operator()(SrTimer &timer, SrAgent &agent)
+    {
+        const int t = elapsed();
+        if (timer.interval() == 20)
+        {
+            // started by another thread at 150 ms, earlier than the 400 ms
+            // timer the agent is sleeping for
+            assert(stage == 1 && t >= 170 && t < 190);
+            stage = 2;
+            timer.stop();
+        } else
+        {
+            assert(stage == 2 && t >= 400 && t < 420);
+
+            // only a handful of wakeups, a 5 ms polling loop has 80
+            assert(switches() - nvcsw < 10);
+            cerr << "OK!" << endl;
+
+            exit(0);
+        }
+    }
+};
+
+static SrAgent *agent = NULL;
+static SrTimer *early = NULL;
+
+static void *func(void *arg)
+{
+    usleep(100 * 1000);
+    agent->ingress.put(SrOpBatch("151,a"));
+    usleep(50 * 1000);
+    early->start();
+
+    return NULL;
+}
+
+int main()
+{
+    cerr << "Test SrAgent loop: ";
+
+    SrAgent a("", "", NULL, NULL);
+    MsgCallback mcb;
+    TimerCallback tcb;
+    SrTimer late(400, &tcb);
+    SrTimer e(20, &tcb);
+    agent = &a;
+    early = &e;
+
+    a.addMsgHandler(151, &mcb);
+    a.addTimer(late);
+    a.addTimer(e);
+    a.setTimerQueue(new SrTimerWheel);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    late.start();
+    nvcsw = switches();
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, &func, NULL);
+    a.loop();
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <srutils.h>
+
+using namespace std;
+
+int main()
+{
+    cerr << "Test crc32c: ";
+
+    assert(crc32c(0, "", 0) == 0);
+    assert(crc32c(0, "123456789", 9) == 0xe3069283);
+    assert(crc32c(0, string(32, '\0').data(), 32) == 0x8a9136aa);
+
+    const string s = "The quick brown fox jumps over the lazy dog";
+    const uint32_t c = crc32c(0, s.data(), s.size());
+    assert(c == 0x22620404);
+    for (size_t i = 0; i <= s.size(); ++i)
+    {   // chaining and unaligned tails
+        assert(crc32c(crc32c(0, s.data(), i), s.data() + i, s.size() - i) == c);
+    }
+    cerr << "OK!" << endl;
+
+    return 0;
+}
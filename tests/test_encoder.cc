@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <srencoder.h>
+#include <smartrest.h>
+
+using namespace std;
+
+typedef SrEncoder<103, SrId, SrFloat<>, SrInt, SrStr> M;
+
+int main()
+{
+    cerr << "Test SrEncoder: ";
+
+    assert(M::news("1234", 0.1, -42, "ok").data == "103,1234,0.1,-42,ok");
+    assert((SrEncoder<1, SrFloat<2>, SrFloat<0>, SrFloat<3>>::news(2.5, 2.5,
+            -0.05).data == "1,2.50,3,-0.050"));
+    assert((SrEncoder<2, SrInt, SrUInt>::news(INT64_MIN, UINT64_MAX).data
+            == "2,-9223372036854775808,18446744073709551615"));
+    assert((SrEncoder<3, SrFloat<>, SrFloat<>, SrFloat<>>::news(100, 1e-7,
+            -0.0).data == "3,100,0.0000001,0"));
+    assert((SrEncoder<5, SrFloat<>>::news(0.1 + 0.2).data
+            == "5,0.30000000000000004"));
+
+    // beyond 2^53 and below 1e-22 still shortest and without exponent
+    assert((SrEncoder<6, SrFloat<>, SrFloat<>, SrFloat<2>>::news(
+            1.2345678901234568e+17, 1e-30, -1e20).data == "6,"
+            "123456789012345680,0.000000000000000000000000000001,"
+            "-100000000000000000000"));
+    const double ext[] =
+    {
+        1.2345678901234568e+17, 1.0000000000000001e-30, 1e300, -5e-324,
+        1.7976931348623157e308, 123456.78901234567
+    };
+    for (size_t i = 0; i < sizeof(ext) / sizeof(ext[0]); ++i)
+    {
+        string e;
+        M::append(e, "1", ext[i], 1, "x");
+        SrParser sr(e);
+        SrRecord r;
+        double d = 0;
+        assert(sr.next(r) == 5 && r.asDouble(2, d) == 0 && d == ext[i]);
+        assert(r.type(2) == SrLexer::SR_FLOAT || r.type(2) == SrLexer::SR_INT);
+        assert(e.find('e') == string::npos);
+        assert(e.size() <= M::bound("1", ext[i], 1, "x"));
+    }
+
+    // strings are quoted and escaped as the inverse of the lexer
+    const string strs[] =
+    {
+        "", "a b ", " lead", "a,b", "say \"hi\"", "\"", "multi\nline",
+        "tab\there", "\xc3\xa4", "-5"
+    };
+
+    string s;
+    for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i)
+    {
+        s.clear();
+        SrEncoder<4, SrStr, SrStr>::append(s, strs[i], strs[i]);
+        SrParser sr(s);
+        SrRecord r;
+        assert(sr.next(r) == 3);
+        assert(r.value(1) == strs[i] && r.value(2) == strs[i]);
+    }
+
+    // shortest floats parse back to the same double
+    for (int i = 0; i < 100000; ++i)
+    {
+        const double v = (rand() - RAND_MAX / 2) / pow(10, rand() % 12);
+        s.clear();
+        M::append(s, "1", v, i, "x");
+        SrParser sr(s);
+        SrRecord r;
+        double d = 0;
+        assert(sr.next(r) == 5 && r.asDouble(2, d) == 0 && d == v);
+        assert(r.type(2) == SrLexer::SR_FLOAT || r.type(2) == SrLexer::SR_INT);
+        assert(s.size() <= M::bound("1", v, i, "x"));
+    }
+
+    // caller-provided buffer
+    char buf[128];
+    assert(M::encode(buf, 40, "1", 1.5, 1, "x") == 0);
+    const size_t n = M::encode(buf, sizeof(buf), "1", 1.5, 1, "x");
+    assert(string(buf, n) == "103,1,1.5,1,x");
+    cerr << "OK!" << endl;
+
+    return 0;
+}
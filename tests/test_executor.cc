@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <atomic>
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <unistd.h>
+#include <sragent.h>
+
+using namespace std;
+
+const int K = 8;
+const int N = 2000;
+atomic<int> busy[K];
+int last[K];
+
+// a slow operation handler must not stall the measurement timer
+class SlowHandler: public SrMsgHandler
+{
+public:
+    SlowHandler() :
+            n(0)
+    {
+    }
+
+    void operator()(SrRecord &r, SrAgent &agent)
+    {
+        assert(busy[0]++ == 0);
+        assert(atoi(r.value(1).c_str()) == n++);
+        usleep(100 * 1000);
+        --busy[0];
+    }
+
+    int n;
+};
+
+class TimerCallback: public SrTimerHandler
+{
+public:
+    TimerCallback(SlowHandler &h) :
+            n(0), h(h)
+    {
+    }
+
+    void operator()(SrTimer &timer, SrAgent &agent)
+    {
+        // 20 fires in 200 ms, while only 2 of the slow handlers could run
+        if (++n == 20)
+        {
+            assert(h.n <= 3);
+            cerr << "OK!" << endl;
+            exit(0);
+        }
+    }
+
+private:
+
+    int n;
+    SlowHandler &h;
+};
+
+int main()
+{
+    cerr << "Test SrExecutor: ";
+
+    SrExecutor exec(4);
+    assert(exec.submit(&exec, [] {}) == -1);
+    assert(exec.start() == 0);
+
+    // tasks of one key never overlap and keep their order
+    for (int i = 0; i < N; ++i)
+    {
+        for (int k = 0; k < K; ++k)
+        {
+            assert(exec.submit(&last[k], [k, i]
+            {
+                assert(busy[k]++ == 0);
+                assert(last[k] == i);
+                last[k] = i + 1;
+                --busy[k];
+            }) == 0);
+        }
+    }
+
+    while (exec.stats().completed < (uint64_t) N * K)
+    {
+        usleep(1000);
+    }
+
+    SrExecutorStats s = exec.stats();
+    assert(s.submitted == (uint64_t) N * K && s.depth == 0);
+    assert(s.maxDepth > 0 && s.maxDepth <= (uint64_t) N * K);
+    assert(s.waitMax > 0 && s.runTotal > 0);
+    for (int k = 0; k < K; ++k)
+    {
+        assert(last[k] == N);
+
+        // per key figures add up to the global ones
+        SrExecutorStats ks = exec.stats(&last[k]);
+        assert(ks.submitted == (uint64_t) N && ks.completed == (uint64_t) N);
+        assert(ks.depth == 0 && ks.maxDepth > 0);
+        assert(ks.runTotal > 0 && ks.runMax <= s.runMax);
+        assert(ks.waitMax <= s.waitMax);
+    }
+    assert(exec.stats(&exec).submitted == 0);
+
+    // idle strands are released, the statistics of their key are kept
+    assert(exec.submit(&last[0], [] {}) == 0);
+    while (exec.stats(&last[0]).completed < (uint64_t) N + 1)
+    {
+        usleep(1000);
+    }
+    assert(exec.stats(&last[0]).submitted == (uint64_t) N + 1);
+
+    SrAgent agent("", "", NULL, NULL);
+    SlowHandler h;
+    TimerCallback tcb(h);
+    SrTimer timer(10, &tcb);
+    timer.setPeriodic(true);
+    agent.setExecutor(&exec);
+    agent.addMsgHandler(151, &h);
+    agent.addTimer(timer);
+    agent.ingress.put(SrOpBatch("151,0\n151,1\n151,2\n151,3"));
+    timer.start();
+    agent.loop();
+
+    return 0;
+}
@@ -47,6 +47,25 @@ int main()
     assert(tok.first == SrLexer::SR_NONE && tok.second == "");
     tok = lex.next();
     assert(tok.first == SrLexer::SR_EOB && tok.second == "");
+
+    // zero-copy tokens are views into the buffer, unescaped on demand
+    SrLexer::SrTokenView v;
+    lex.reset(s);
+    assert(lex.scan(v) == SrLexer::SR_INT);
+    assert(s.compare(v.pos, v.len, "+59") == 0 && !v.escaped);
+    assert(lex.scan(v) == SrLexer::SR_STRING);
+    assert(s.compare(v.pos, v.len, "ab cc \"\"") == 0 && v.escaped);
+    string val;
+    SrLexer::assign(val, lex.buffer(), v);
+    assert(val == "ab cc \"");
+
+    // unterminated quote, garbage after the closing quote, trailing comma
+    SrLexer lex2("\"a,\"b c,\"x\n");
+    tok = lex2.next();
+    assert(tok.first == SrLexer::SR_STRING && tok.second == "a,");
+    tok = lex2.next();
+    assert(tok.first == SrLexer::SR_ERROR && tok.second == "x\n");
+    assert(lex2.next().first == SrLexer::SR_EOB);
     cerr << "OK!" << endl;
 
     return 0;
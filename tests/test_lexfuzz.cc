@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <cassert>
+#include <smartrest.h>
+
+using namespace std;
+
+/**
+ *  Reference lexer: the original byte-at-a-time SrLexer::next() using the
+ *  ctype functions, bounded at the end of buffer for an unterminated quote.
+ */
+class RefLexer
+{
+public:
+    RefLexer(const string &_s) :
+            pre(0), start(0), end(0), s(_s), delimit(false)
+    {
+    }
+
+    SrLexer::SrToken next()
+    {
+        SrLexer::SrToken tok;
+
+        if (end == s.size())
+        {
+            tok.first = SrLexer::SR_EOB;
+            pre = start = end;
+
+            return tok;
+        }
+
+        if (delimit)
+        {
+            pre = end;
+
+            for (; end < s.size(); ++end)
+            {
+                if (s[end] == ',')
+                {
+                    ++end;
+                    break;
+                } else if (s[end] == '\n')
+                {
+                    start = end;
+
+                    tok.first = SrLexer::SR_NEWLINE;
+                    tok.second = s[end++];
+                    delimit = false;
+
+                    return tok;
+                }
+            }
+        }
+
+        pre = end;
+
+        for (; end < s.size() && !isgraph(c(end)) && s[end] != '\n'; ++end)
+        {
+        }
+
+        start = end;
+        bool escape = false;
+        size_t digits = 0, others = 0, dots = 0;
+
+        if (s[end] == '"')
+        {
+            escape = true;
+            ++end;
+        } else if (s[end] == '+' || s[end] == '-')
+        {
+            tok.second += s[end++];
+        }
+
+        for (; isprint(c(end)) || (escape && end < s.size()); ++end)
+        {
+            if (isdigit(c(end)))
+            {
+                ++digits;
+            } else if (s[end] == '.')
+            {
+                ++dots;
+            } else if (s[end] == '"')
+            {
+                if (!escape)
+                {
+                    break;
+                }
+
+                ++end;
+
+                if (s[end] == '"')
+                {
+                    ++others;
+                } else
+                {
+                    escape = false;
+                    break;
+                }
+            } else if (s[end] == ',' || s[end] == '\n')
+            {
+                if (escape)
+                {
+                    ++others;
+                } else
+                {
+                    break;
+                }
+            } else
+            {
+                ++others;
+            }
+
+            tok.second += s[end];
+        }
+
+        if (escape)
+        {
+            tok.first = SrLexer::SR_ERROR;
+        } else if (others || dots > 1)
+        {
+            tok.first = SrLexer::SR_STRING;
+        } else if (dots)
+        {
+            tok.first = digits ? SrLexer::SR_FLOAT : SrLexer::SR_STRING;
+        } else if (digits)
+        {
+            tok.first = SrLexer::SR_INT;
+        } else
+        {
+            tok.first = tok.second.empty() ? SrLexer::SR_NONE : SrLexer::SR_STRING;
+        }
+
+        delimit = true;
+
+        return tok;
+    }
+
+    size_t pre, start, end;
+
+private:
+    int c(size_t i) const
+    {
+        return (unsigned char) s[i];
+    }
+
+    const string s;
+    bool delimit;
+};
+
+// numbers computed by the lexer against strtoll and strtod
+static void numbers(const string &s)
+{
+    SrLexer lex(s);
+    SrLexer::SrTokenView t;
+    string v;
+
+    while (lex.scan(t) != SrLexer::SR_EOB)
+    {
+        SrLexer::assign(v, lex.buffer(), t);
+
+        if (t.type == SrLexer::SR_INT)
+        {
+            errno = 0;
+            const long long i = strtoll(v.c_str(), NULL, 10);
+            assert(t.valid == (errno == 0));
+            assert(!t.valid || t.num.i == i);
+        } else if (t.type == SrLexer::SR_FLOAT)
+        {
+            assert(t.valid && t.num.d == strtod(v.c_str(), NULL));
+        }
+    }
+}
+
+static void check(const string &s)
+{
+    RefLexer ref(s);
+    SrLexer lex(s);
+
+    // an empty value and a newline per byte at most
+    for (size_t i = 0; i <= 2 * s.size() + 1; ++i)
+    {
+        const SrLexer::SrToken a = ref.next();
+        const SrLexer::SrToken b = lex.next();
+
+        if (a != b || ref.pre != lex.pre || ref.start != lex.start
+                || ref.end != lex.end)
+        {
+            cerr << "mismatch at " << i << " for input:\n" << s << endl;
+            assert(false);
+        }
+
+        if (a.first == SrLexer::SR_EOB)
+        {
+            numbers(s);
+            return;
+        }
+    }
+
+    assert(false);
+}
+
+// characters of the test_lexer inputs, plus controls and non-ASCII bytes
+const string alpha = "+-0123456789.,\"\n \t\rabc \"\",,.9\x7f\xc3\xa4\x01";
+
+static string mutate(string s)
+{
+    for (int k = rand() % 4; k >= 0; --k)
+    {
+        const size_t i = s.empty() ? 0 : rand() % s.size();
+        const char c = alpha[rand() % alpha.size()];
+
+        switch (rand() % 3)
+        {
+        case 0:
+            s.insert(i, 1, c);
+            break;
+        case 1:
+            if (!s.empty())
+            {
+                s[i] = c;
+            }
+            break;
+        default:
+            if (!s.empty())
+            {
+                s.erase(i, 1);
+            }
+        }
+    }
+
+    return s;
+}
+
+int main()
+{
+    cerr << "Test SrLexer differential: ";
+    srand(20171017);
+
+    const string seeds[] =
+    {
+        "+59, \"ab cc \"\"\",-.9\n,", "a, b,\n+5.,hello world\n",
+        "\"a,\"b c,\"x\n", "511,\"a \"\"b\"\"\",3\n",
+        "801,12345,\"set configuration to \"\"mode=eco, interval=60\"\" for "
+        "the whole fleet\",-12.5,3600,EXECUTING,c8y_Configuration\n",
+        "9223372036854775807,-9223372036854775808,9223372036854775808,"
+        "0.1,-0.000123,123456789012345.6,1234567890123456789.25,+.5\n"
+    };
+
+    for (size_t i = 0; i < sizeof(seeds) / sizeof(seeds[0]); ++i)
+    {
+        check(seeds[i]);
+
+        // mutations, and long values crossing the vector block boundaries
+        for (int j = 0; j < 4000; ++j)
+        {
+            string s = mutate(seeds[i]);
+            if (j % 4 == 0)
+            {
+                s = mutate(s + s + s);
+            }
+            check(s);
+        }
+    }
+
+    // random strings over the alphabet, up to a few blocks long
+    for (int j = 0; j < 20000; ++j)
+    {
+        string s(rand() % 100, ' ');
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            s[i] = alpha[rand() % alpha.size()];
+        }
+        check(s);
+    }
+
+    cerr << "OK!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <new>
+#include <deque>
+#include <string>
+#include <iterator>
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <sragent.h>
+
+using namespace std;
+
+// only allocations of at least this size are counted, i.e., message payloads
+const size_t LEN = 4096;
+static bool armed = false;
+static int allocs = 0;
+
+void *operator new(size_t n)
+{
+    if (armed && n >= LEN)
+    {
+        ++allocs;
+    }
+
+    void* const p = malloc(n ? n : 1);
+    if (p == NULL)
+    {
+        throw bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static void send(SrAgent &agent)
+{
+    allocs = 0;
+    armed = true;
+    agent.send(SrNews(string(LEN, 'x'), SR_PRIO_BUF));
+    agent.send(SrNews(string(LEN, 'y')));
+    agent.egress.emplace(string(LEN, 'z'), SR_PRIO_XID);
+
+    // same bulk transfer as the reporter aggregation
+    deque<SrNews> pend;
+    assert(agent.egress.takeAll(pend) == 3);
+    armed = false;
+
+    assert(allocs == 3);
+    assert(pend[0].data[0] == 'x' && pend[0].prio == SR_PRIO_BUF);
+    assert(pend[1].data[0] == 'y' && pend[1].prio == 0);
+    assert(pend[2].data[0] == 'z' && pend[2].prio == SR_PRIO_XID);
+}
+
+int main()
+{
+    cerr << "Test move semantics: ";
+
+    SrAgent agent("", "", NULL, NULL);
+    send(agent);
+    assert(agent.egress.setRing(16) == 0);
+    send(agent);
+
+    // single get() moves the element out as well
+    allocs = 0;
+    armed = true;
+    agent.ingress.put(SrOpBatch(string(LEN, 'a')));
+    agent.ingress.put(SrOpBatch(string(LEN, 'b')));
+    SrQueue<SrOpBatch>::Event e = agent.ingress.get();
+    SrQueue<SrOpBatch>::Event f = agent.ingress.get(0);
+    armed = false;
+
+    assert(allocs == 2);
+    assert(e.second == SrQueue<SrOpBatch>::Q_OK && e.first.data[0] == 'a');
+    assert(f.second == SrQueue<SrOpBatch>::Q_OK && f.first.data[0] == 'b');
+    cerr << "OK!" << endl;
+
+    return 0;
+}
@@ -60,6 +60,26 @@ int main()
 {
     cerr << "Test MSG Handler: ";
 
+    // handler tables, including growth and cleared entries
+    SrAgent::MsgTable mt;
+    SrAgent::XMsgTable xmt;
+    Callback dummy({});
+    assert(mt.find(151) == NULL && xmt.find(1, 151) == NULL);
+    for (int i = 0; i < 1000; ++i)
+    {
+        mt.set(i * 61, &dummy);
+        xmt.set(i % 10, i, &dummy);
+    }
+
+    mt.set(61, NULL);
+    xmt.set(3, 3, NULL);
+    for (int i = 0; i < 1000; ++i)
+    {
+        assert(mt.find(i * 61) == (i == 1 ? NULL : (SrMsgHandler*) &dummy));
+        assert(xmt.find(i % 10, i) == (i == 3 ? NULL : (SrMsgHandler*) &dummy));
+        assert(xmt.find(i % 10 + 1, i) == NULL);
+    }
+
     SrAgent agent("", "", NULL, NULL);
     vector<string> vec = { "151", "329", "payload" };
 
@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <srpager.h>
+
+using namespace std;
+
+static const char *path = "tests/pager.buf";
+
+static string segment(int i)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), ".%06d", i);
+    return path + string(buf);
+}
+
+static void cleanup()
+{
+    unlink(path);
+    unlink((string(path) + ".index").c_str());
+    unlink((string(path) + ".ckpt").c_str());
+    unlink((string(path) + ".dict").c_str());
+    for (int i = 0; i < 8; ++i)
+    {
+        unlink(segment(i).c_str());
+    }
+}
+
+static void testMigrate()
+{
+    // version 1 index: 8 bytes header, 8 bytes per page with 16-bit index
+    const string a = "200,c8y_Temperature,T,25\n", b = "15,100\n";
+    const uint8_t base = SR_FILEBUF_PAGE_SCALE | (1 << 3);
+    const uint16_t h[] = {(uint16_t) base, 2, 2, 0};
+    const uint16_t p0[] = {1, (uint16_t) (a.size() - 1), 0, 0};
+    const uint16_t p1[] = {0, (uint16_t) (b.size() - 1), 1, 0};
+    {
+        ofstream idx(string(path) + ".index", ios::binary);
+        idx.write((const char*) h, sizeof(h));
+        idx.write((const char*) p0, sizeof(p0));
+        idx.write((const char*) p1, sizeof(p1));
+        ofstream data(path, ios::binary);
+        data.write(b.data(), b.size());
+        data.seekp(SR_FILEBUF_PAGE_SIZE);
+        data.write(a.data(), a.size());
+    }
+
+    unique_ptr<_Pager> p(_Pager::create(SR_FILEBUF_STREAM, path, 70000));
+    assert(p->bsize() == 2 && p->size() == 2 && p->capacity() == 70000);
+    string s;
+    p->at(0, s);
+    p->at(1, s);
+    assert(s == a + b);
+    assert(ifstream(string(path) + ".index").get() == (SR_FILEBUF_PAGE_SCALE | (2 << 3)));
+
+    // the lowest free page is allocated
+    const string c(SR_FILEBUF_PAGE_SIZE - 1, 'c');
+    p->emplace_back(c.c_str(), _Spans(1, _Span(0, c.size())));
+    p->pop_front();
+    p->pop_front();
+    p->emplace_back(c.c_str(), _Spans(1, _Span(0, c.size())));
+    p.reset(_Pager::create(SR_FILEBUF_STREAM, path, 70000));
+    assert(p->bsize() == 2);
+    s.clear();
+    p->at(1, s);
+    assert(s == c);
+    ifstream data(path, ios::binary | ios::ate);
+    assert(data.tellg() == 3 * SR_FILEBUF_PAGE_SIZE - 1);
+}
+
+// batches of 256 messages, prefixed by the X-ID in effect
+static void testMem()
+{
+    string in = "15,A\n15,B\n";
+    _Spans v = {_Span(0, 5)};
+    for (int i = 0; i < 600; ++i)
+    {
+        const size_t n = in.size();
+        in += "200," + to_string(i) + "\n";
+        v.emplace_back(n, in.size() - n);
+        if (i == 299)
+        {
+            v.emplace_back(5, 5);
+        }
+    }
+
+    auto lines = [&](size_t b, size_t e)
+    {
+        string s;
+        for (size_t i = b; i < e; ++i)
+        {
+            s.append(in, v[i].pos, v[i].len);
+        }
+        return s;
+    };
+
+    unique_ptr<_Pager> p(_Pager::create(SR_FILEBUF_STREAM, "", 1000));
+    p->emplace_back(in.data(), v);
+    assert(p->bsize() == 3 && p->size() == 602);
+    string s, t;
+    p->at(0, s);
+    assert(s == lines(0, 256));
+    s.clear();
+    p->at(1, s);
+    assert(s == "15,A\n" + lines(256, 512));
+    s.clear();
+    p->at(2, s);
+    assert(s == "15,B\n" + lines(512, 602));
+
+    // the cached front is invalidated by appending to it
+    p.reset(_Pager::create(SR_FILEBUF_STREAM, "", 1000));
+    p->emplace_back(in.data(), _Spans(v.begin(), v.begin() + 2));
+    p->front(s);
+    p->emplace_back(in.data(), _Spans(v.begin() + 2, v.end()));
+    s.clear();
+    p->front(s);
+    assert(s == lines(0, 256));
+    p->pop_front();
+    p->at(1, t);
+    s.clear();
+    p->front(s);
+    assert(s == "15,A\n" + lines(256, 512));
+    p->pop_front();
+    s.clear();
+    p->front(s);
+    assert(s == t && s == "15,B\n" + lines(512, 602));
+
+    // evicted X-ID requests stay in effect
+    p.reset(_Pager::create(SR_FILEBUF_STREAM, "", 200));
+    p->emplace_back(in.data(), v);
+    assert(p->bsize() == 1 && p->size() == 200);
+    s.clear();
+    p->front(s);
+    assert(s == "15,B\n" + lines(402, 602));
+}
+
+// evict bulk first, then ordinary, then urgent messages, keep X-IDs
+static void testBudget()
+{
+    string in = "15,A\n";
+    _Spans v = {_Span(0, 5)};
+    const char* const ids[] = {"400,", "300,", "200,"};
+    for (int l = 2; l >= 0; --l)
+    {
+        for (int i = 0; i < (l ? 100 : 10); ++i)
+        {
+            const size_t n = in.size();
+            in += ids[l] + to_string(i) + "\n";
+            v.emplace_back(n, in.size() - n, l);
+        }
+    }
+
+    unique_ptr<_Pager> p(_Pager::create(SR_FILEBUF_STREAM, "", 1000));
+    p->setBudget(2000);
+    p->emplace_back(in.data(), v);
+    assert(p->used() <= 2500);
+
+    string s;
+    for (size_t k = 0; k < p->bsize(); ++k)
+    {
+        p->at(k, s);
+    }
+
+    uint64_t bytes, msgs;
+    p->evicted(bytes, msgs);
+    const size_t n = count(s.begin(), s.end(), '\n');
+    assert(msgs == v.size() - n && bytes == in.size() - s.size());
+    assert(s.compare(0, 5, "15,A\n") == 0 && s.find("200,") == string::npos);
+    const size_t pos = s.find("300,");
+    assert(pos != string::npos && s.find("\n300,", pos) != string::npos);
+    assert(s.compare(s.size() - 64, 64, in, in.size() - 64, 64) == 0);
+    assert(in.compare(in.size() - s.size() + pos, s.size() - pos, s, pos, s.size() - pos) == 0);
+
+    // capacity eviction counts the evicted messages, not the incoming ones
+    string big(1000, 'x');
+    in = "200," + big + "\n200,1\n";
+    v = {_Span(0, 1005), _Span(0, 1005), _Span(0, 1005), _Span(1005, 6),
+            _Span(1005, 6), _Span(1005, 6)};
+    p.reset(_Pager::create(SR_FILEBUF_STREAM, "", 3));
+    p->emplace_back(in.data(), v);
+    p->evicted(bytes, msgs);
+    assert(msgs == 3 && bytes == 3 * 1005);
+    s.clear();
+    p->front(s);
+    assert(s == "200,1\n200,1\n200,1\n");
+}
+
+// file engines evict whole batches and count their messages
+static void testEvicted(int engine)
+{
+    string a;
+    _Spans v;
+    for (size_t i = 0; a.size() + 100 <= SR_FILEBUF_PAGE_SIZE - 10; ++i)
+    {
+        v.emplace_back(a.size(), 100);
+        a += string(99, 'a' + i % 26) + "\n";
+    }
+
+    unique_ptr<_Pager> p(_Pager::create(engine, path, 4));
+    for (int i = 0; i < 6; ++i)
+    {
+        p->emplace_back(a.data(), v);
+        p->seal();
+    }
+
+    uint64_t bytes, msgs;
+    p->evicted(bytes, msgs);
+    assert(p->bsize() == 4 && bytes == 2 * a.size() && msgs == 2 * v.size());
+
+    // recovered batches are counted as well
+    p.reset(_Pager::create(engine, path, 4));
+    p->emplace_back(a.data(), v);
+    p->evicted(bytes, msgs);
+    assert(p->bsize() == 4 && bytes == a.size() && msgs == v.size());
+}
+
+static void testZip(int engine)
+{
+    string in, out, s;
+    _Spans v;
+    unique_ptr<_Pager> p(_Pager::create(engine | SR_FILEBUF_ZIP, path, 64));
+    p->setDictionary("200,201,15,100\n");
+    p->clear();
+
+    for (int i = 0; i < 3000; ++i)
+    {
+        const size_t n = in.size();
+        in += "200,c8y_Temperature,T," + to_string(20 + i % 7) + "."
+                + to_string(i % 10) + ",2019-01-01T00:00:" + to_string(i % 60)
+                + ".000Z\n";
+        v.emplace_back(n, in.size() - n);
+        if (v.size() == 64 || i == 2999)
+        {
+            p->emplace_back(in.data(), v);
+            out.append(in, v.front().pos, in.size() - v.front().pos);
+            v.clear();
+        }
+    }
+
+    // incompressible
+    const size_t n = in.size();
+    for (int i = 0; i < 1000; ++i)
+    {
+        in += (char) (rand() & 0xff);
+    }
+    p->emplace_back(in.data(), _Spans(1, _Span(n, 1000)));
+    out.append(in, n, 1000);
+
+    uint64_t raw, stored;
+    p->ratio(raw, stored);
+    assert(raw == out.size() && raw > 3 * stored);
+
+    p.reset(_Pager::create(engine | SR_FILEBUF_ZIP, path, 64));
+    p->setDictionary("200,201,15,100\n");
+    for (; !p->empty(); p->pop_front())
+    {
+        string t;
+        p->front(t);
+        assert(t.size() <= 16384);
+        s += t;
+    }
+    assert(s == out);
+
+    // frames decompress with the dictionary they were written with
+    in = "15,100\n200,c8y_Temperature,T,25\n";
+    p->emplace_back(in.data(), _Spans(1, _Span(0, in.size())));
+    p.reset(_Pager::create(engine | SR_FILEBUF_ZIP, path, 64));
+    p->setDictionary("15,101\n200,c8y_Temperature,T,");
+    p->emplace_back(in.data(), _Spans(1, _Span(0, in.size())));
+    p.reset(_Pager::create(engine | SR_FILEBUF_ZIP, path, 64));
+    p->setDictionary("201,");
+    s.clear();
+    for (; !p->empty(); p->pop_front())
+    {
+        p->front(s);
+    }
+    assert(s == in + in);
+
+    // the dictionary file only keeps the current one when empty
+    const string dfn = string(path) + ".dict";
+    p->clear();
+    assert(ifstream(dfn, ios::binary | ios::ate).tellg() == 8 + 4);
+
+    // without dictionary file the frame is discarded
+    p->setDictionary(in);
+    p->emplace_back(in.data(), _Spans(1, _Span(0, in.size())));
+    p.reset();
+    unlink(dfn.c_str());
+    p.reset(_Pager::create(engine | SR_FILEBUF_ZIP, path, 64));
+    s.clear();
+    p->front(s);
+    assert(s.empty());
+
+    // no frame is written while its dictionary can not be saved
+    assert(mkdir(dfn.c_str(), 0755) == 0);
+    p->setDictionary("15,101\n");
+    assert(p->emplace_back(in.data(), _Spans(1, _Span(0, in.size()))) == -1);
+    assert(rmdir(dfn.c_str()) == 0);
+}
+
+static void testLog()
+{
+    const string b(SR_FILEBUF_PAGE_SIZE - 10, 'b');
+    const _Spans v(1, _Span(0, b.size()));
+    unique_ptr<_Pager> p(_Pager::create(SR_FILEBUF_LOG, path, 64));
+    for (int i = 0; i < 40; ++i)
+    {
+        p->emplace_back(b.c_str(), v);
+    }
+    assert(p->bsize() == 40 && access(segment(2).c_str(), F_OK) == 0);
+
+    // acknowledged segments are deleted
+    for (int i = 0; i < 20; ++i)
+    {
+        p->pop_front();
+    }
+    assert(p->bsize() == 20 && access(segment(0).c_str(), F_OK) == -1);
+
+    // a torn record at the tail is discarded on recovery
+    p.reset();
+    ofstream(segment(2), ios::app) << "torn";
+    p.reset(_Pager::create(SR_FILEBUF_LOG, path, 64));
+    assert(p->bsize() == 20);
+    p->emplace_back(b.c_str(), v);
+    p.reset(_Pager::create(SR_FILEBUF_LOG, path, 64));
+    assert(p->bsize() == 21);
+
+    // a corrupt record and all records after it are discarded
+    p.reset();
+    {
+        fstream f(segment(2), ios::in | ios::out | ios::binary);
+        f.seekp(-100, ios::end);
+        f.put('x');
+    }
+    p.reset(_Pager::create(SR_FILEBUF_LOG, path, 64));
+    assert(p->bsize() == 20);
+    string s;
+    p->at(19, s);
+    assert(s == b);
+
+    // the capacity is enforced on recovery
+    p.reset(_Pager::create(SR_FILEBUF_LOG, path, 8));
+    assert(p->bsize() == 8);
+    s.clear();
+    p->front(s);
+    assert(s == b);
+}
+
+// a new capacity re-lays out the ring while batches are buffered
+static void testResize()
+{
+    string b[40];
+    for (int i = 0; i < 40; ++i)
+    {
+        b[i].assign(SR_FILEBUF_PAGE_SIZE - 10, 'a' + i % 26);
+    }
+
+    const _Spans v(1, _Span(0, b[0].size()));
+    unique_ptr<_Pager> p(_Pager::create(SR_FILEBUF_MMAP, path, 4));
+    p->clear();
+    for (int i = 0; i < 3; ++i)
+    {
+        p->emplace_back(b[i].c_str(), v);
+    }
+
+    p->setBudget(16 * SR_FILEBUF_PAGE_SIZE);
+    assert(p->capacity() == 16);
+    for (int i = 3; i < 16; ++i)
+    {
+        p->emplace_back(b[i].c_str(), v);
+    }
+    assert(p->size() == 16);
+
+    uint64_t bytes, msgs;
+    p->evicted(bytes, msgs);
+    assert(bytes == 0);
+
+    // reopening with another capacity keeps the buffered batches
+    p.reset(_Pager::create(SR_FILEBUF_MMAP, path, 64));
+    assert(p->size() == 16 && p->capacity() == 64);
+    for (int i = 16; i < 40; ++i)
+    {
+        p->emplace_back(b[i].c_str(), v);
+    }
+    assert(p->size() == 40);
+
+    // shrinking keeps the newest batches, in order
+    p.reset(_Pager::create(SR_FILEBUF_MMAP, path, 4));
+    assert(p->size() == 4 && p->capacity() == 4);
+    for (int i = 36; i < 40; ++i, p->pop_front())
+    {
+        string s;
+        p->front(s);
+        assert(s == b[i]);
+    }
+    assert(p->empty() && access((string(path) + ".tmp").c_str(), F_OK) == -1);
+}
+
+static void test(int engine, const string &fn)
+{
+    const string a = "200,c8y_Temperature,T,25\n";
+    const string b(SR_FILEBUF_PAGE_SIZE - 10, 'b');
+    _Spans v(1, _Span(0, a.size()));
+    string s;
+
+    unique_ptr<_Pager> p(_Pager::create(engine, fn, 4));
+    p->clear();
+    assert(p->empty() && p->bsize() == 0);
+
+    // small messages are appended to the last page of the last batch
+    p->emplace_back(a.c_str(), v);
+    p->emplace_back(a.c_str(), v);
+    assert(p->bsize() == 1 && p->size() == 1);
+    p->front(s);
+    assert(s == a + a);
+
+    // messages not fitting into the last page start a new batch
+    v[0] = _Span(0, b.size());
+    p->emplace_back(b.c_str(), v);
+    p->emplace_back(b.c_str(), v);
+    assert(p->bsize() == 3 && p->size() == 3);
+    s.clear();
+    p->at(2, s);
+    assert(s == b);
+    s.clear();
+    p->at(3, s);
+    assert(s.empty());
+
+    // a batch spanning two pages, the oldest batch is evicted
+    const _Spans w = {_Span(0, b.size()), _Span(0, b.size())};
+    p->emplace_back(b.c_str(), w);
+    assert(p->bsize() == 3 && p->size() == 4);
+    s.clear();
+    p->front(s);
+    assert(s == b);
+    s.clear();
+    p->at(2, s);
+    assert(s == b + b);
+
+    p->pop_front();
+    assert(p->bsize() == 2 && p->size() == 3);
+
+    // reopen
+    p.reset(_Pager::create(engine, fn, 4));
+    assert(p->bsize() == 2 && p->size() == 3);
+    s.clear();
+    p->at(1, s);
+    assert(s == b + b);
+
+    p->pop_front();
+    p->pop_front();
+    assert(p->empty() && p->bsize() == 0);
+}
+
+int main()
+{
+    cerr << "Test _Pager memory: ";
+    const string a = "200,c8y_Temperature,T,25\n";
+    const _Spans v(1, _Span(0, a.size()));
+    unique_ptr<_Pager> p(_Pager::create(SR_FILEBUF_MMAP, "", 4));
+    for (int i = 0; i < 6; ++i)
+    {
+        p->emplace_back(a.c_str(), v);
+    }
+    assert(p->bsize() == 1 && p->size() == 4);
+    string s;
+    p->front(s);
+    assert(s == a + a + a + a);
+    p->pop_front();
+    assert(p->empty());
+    testMem();
+    testBudget();
+    cerr << "OK!" << endl;
+
+    cerr << "Test _Pager stream: ";
+    cleanup();
+    test(SR_FILEBUF_STREAM, path);
+    cleanup();
+    testMigrate();
+    cleanup();
+    cerr << "OK!" << endl;
+
+    cerr << "Test _Pager mmap: ";
+    test(SR_FILEBUF_MMAP, path);
+    cleanup();
+    testResize();
+    cleanup();
+    testEvicted(SR_FILEBUF_MMAP);
+    cleanup();
+    cerr << "OK!" << endl;
+
+    cerr << "Test _Pager compress: ";
+    testZip(SR_FILEBUF_STREAM);
+    cleanup();
+    testZip(SR_FILEBUF_MMAP);
+    cleanup();
+    testZip(SR_FILEBUF_LOG);
+    cleanup();
+    cerr << "OK!" << endl;
+
+    cerr << "Test _Pager log: ";
+    test(SR_FILEBUF_LOG, path);
+    cleanup();
+    testLog();
+    cleanup();
+    testEvicted(SR_FILEBUF_LOG);
+    cleanup();
+    cerr << "OK!" << endl;
+
+    return 0;
+}
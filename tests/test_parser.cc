@@ -18,12 +18,61 @@
  * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <new>
 #include <iostream>
+#include <cstdlib>
 #include <cassert>
 #include <smartrest.h>
 
 using namespace std;
 
+static int allocs = 0;
+
+void *operator new(size_t n)
+{
+    ++allocs;
+    void* const p = malloc(n ? n : 1);
+    if (p == NULL)
+    {
+        throw bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ *  Count allocations for parsing \a s into a re-used record, after the
+ *  record has grown to its final capacity.
+ */
+static int parse(const string &s, SrRecord &r)
+{
+    SrParser warm(s);
+    while (warm.next(r))
+    {
+    }
+
+    allocs = 0;
+    SrParser sr(s);
+    size_t n = 0;
+    while (sr.next(r))
+    {
+        n += r.size();
+    }
+
+    assert(n);
+    return allocs;
+}
+
 int main()
 {
     cerr << "Test SmartREST: ";
@@ -40,6 +89,52 @@ int main()
     assert(r.value(1) == "hello world");
     r = sr.next();
     assert(r.size() == 0);
+
+    // records refer to the buffer, copies own their values
+    const string buf = "511,\"a \"\"b\"\"\",3\n";
+    SrParser sr2(buf);
+    assert(sr2.next(r) == 3);
+    assert(string(r.raw(1), r.length(1)) == "a \"\"b\"\"" && r.escaped(1));
+    assert(r.value(1) == "a \"b\"" && r.type(2) == SrLexer::SR_INT);
+    SrRecord c = r;
+    sr2.reset("1,2\n");
+    assert(sr2.next(r) == 2 && r.value(0) == "1");
+    assert(c.size() == 3 && c.value(0) == "511" && c.value(1) == "a \"b\"");
+    SrLexer::SrToken t(SrLexer::SR_STRING, "x");
+    c.push_back(t);
+    assert(c.size() == 4 && c.value(3) == "x" && c.value(2) == "3");
+
+    // numbers computed by the lexer, with error codes
+    SrParser sr3("511,-42,4294967296,2.5,\"7\",abc,99999999999999999999\n");
+    assert(sr3.next(r) == 7);
+    int64_t i = 0;
+    uint32_t u = 0;
+    double d = 0;
+    assert(r.asU32(0, u) == 0 && u == 511);
+    assert(r.asInt(1, i) == 0 && i == -42);
+    assert(r.asU32(1, u) == -2 && u == 511);
+    assert(r.asU32(2, u) == -2 && r.asInt(2, i) == 0 && i == 4294967296);
+    assert(r.asInt(3, i) == -1 && r.asDouble(3, d) == 0 && d == 2.5);
+    assert(r.asU32(4, u) == 0 && u == 7);
+    assert(r.asInt(5, i) == -1 && r.asDouble(5, d) == -1 && d == 2.5);
+    assert(r.asInt(6, i) == -2 && r.asDouble(6, d) == 0 && d == 1e20);
+    assert(c.asInt(2, i) == 0 && i == 3);
+
+    // no allocations per field with a re-used record
+    string narrow, wide;
+    for (int i = 0; i < 100; ++i)
+    {
+        narrow += "511,1,\"a long value which does not fit small strings\"\n";
+        wide += "511,1";
+        for (int j = 0; j < 50; ++j)
+        {
+            wide += ",\"a long value which does not fit small strings\"";
+        }
+        wide += "\n";
+    }
+    SrRecord reused;
+    assert(parse(narrow, reused) == 0);
+    assert(parse(wide, reused) == 0);
     cerr << "OK!" << endl;
 
     return 0;
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include <unistd.h>
+#include <sragent.h>
+
+using namespace std;
+
+static int64_t ns(const timespec &t)
+{
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static timespec ts(int64_t ns)
+{
+    timespec t = { ns / 1000000000, ns % 1000000000 };
+    return t;
+}
+
+// scheduling tolerance, the same as for a single shot timer in test_timer
+const int64_t TOLERANCE_IN_NS = 5000000;
+const int N = 25;
+
+// the callback takes 7 ms of a 20 ms period, fire times must not drift
+class Callback: public SrTimerHandler
+{
+public:
+    Callback() :
+            n(0)
+    {
+    }
+
+    void operator()(SrTimer &timer, SrAgent &agent)
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        // the schedule time is the fire time of the current period, and
+        // the n-th period is exactly n periods after the first one
+        late[n] = ns(now) - ns(timer.shedTime());
+        assert(late[n] >= 0);
+
+        if (n == 0)
+        {
+            t0 = ns(timer.shedTime());
+        } else
+        {
+            assert(ns(timer.shedTime()) == t0 + n * 20000000LL);
+        }
+
+        usleep(7000);
+        if (++n == N)
+        {
+            // a virtual machine host preempts the whole guest now and then,
+            // which delays single wake-ups by up to tens of ms, a plain
+            // clock_nanosleep() loop shows the same. The tolerance applies
+            // to the median, which those outliers cannot shift, while any
+            // systematic lateness of the agent loop still shows.
+            std::sort(late, late + N);
+            assert(late[N / 2] < TOLERANCE_IN_NS);
+            cerr << "OK!" << endl;
+            exit(0);
+        }
+    }
+
+private:
+
+    int64_t t0;
+    int64_t late[N];
+    int n;
+};
+
+static void catchup(SrTimer::CatchUp policy, bool run, uint32_t missed, int next)
+{
+    SrTimer timer(10);
+    timer.setPeriodic(true, policy);
+    timer.start();
+
+    // fire 35 ms late, i.e., 3 periods missed
+    const int64_t d = ns(timer.fireTime());
+    assert(timer.rearm(ts(d + 35000000)) == run);
+    assert(ns(timer.shedTime()) == d);
+    assert(ns(timer.fireTime()) == d + next * 10000000LL);
+
+    if (policy == SrTimer::SKIP)
+    {
+        // dropped periods are reported with the next callback
+        assert(timer.rearm(timer.fireTime()));
+    }
+
+    assert(timer.missed() == missed);
+}
+
+int main()
+{
+    cerr << "Test SrTimer periodic: ";
+
+    catchup(SrTimer::SKIP, false, 4, 4);
+    catchup(SrTimer::COALESCE, true, 3, 4);
+    catchup(SrTimer::BURST, true, 3, 1);
+
+    // aligned to 100 ms of the wall clock
+    SrTimer aligned(1000);
+    aligned.setPeriodic(true);
+    aligned.setAlignment(100);
+    aligned.start();
+    timespec rt, mono;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    const int64_t wall = ns(aligned.fireTime()) + ns(rt) - ns(mono);
+    const int64_t off = (wall + 50000000) % 100000000 - 50000000;
+    assert(off > -1000000 && off < 1000000);
+    assert(aligned.rearm(aligned.fireTime()));
+
+    SrAgent agent("", "", NULL, NULL);
+    Callback callback;
+    SrTimer timer(20, &callback);
+    timer.setPeriodic(true, SrTimer::BURST);
+    agent.addTimer(timer);
+    timer.start();
+    agent.loop();
+
+    return 0;
+}
@@ -20,6 +20,9 @@
 
 #include <string>
 #include <set>
+#include <deque>
+#include <vector>
+#include <iterator>
 #include <iostream>
 #include <cassert>
 #include <srqueue.h>
@@ -70,6 +73,58 @@ int main()
 
     pthread_join(tid, NULL);
     assert(S == S2);
+
+    // bulk drain and takeAll, for both mutex and ring backend
+    SrQueue<int> D;
+    SrQueue<int> R(16);
+    for (SrQueue<int> *q : { &D, &R })
+    {
+        vector<int> v;
+        assert(q->drain(back_inserter(v), 8, 0) == 0);
+        assert(q->drain(back_inserter(v), 8, 10) == 0);
+        for (int i = 0; i < 10; ++i)
+        {
+            q->put(i);
+        }
+
+        assert(q->drain(back_inserter(v), 4, 0) == 4);
+        assert(q->drain(back_inserter(v), 4, -1) == 4);
+        deque<int> d = { -1 };
+        assert(q->takeAll(d) == 2);
+        assert(d.size() == 3 && d[1] == 8 && d[2] == 9);
+        for (int i = 0; i < 8; ++i)
+        {
+            assert(v[i] == i);
+        }
+
+        assert(q->takeAll(d) == 0 && q->empty());
+        assert(q->get(0).second == SrQueue<int>::Q_TIMEOUT);
+        q->put(42);
+        d.clear();
+        assert(q->takeAll(d) == 1 && d.front() == 42);
+        assert(q->get(10).second == SrQueue<int>::Q_TIMEOUT);
+    }
+
+    // priority lanes: lane is the value / 100, FIFO within a lane, lane 1
+    // is served once after being skipped 2 times
+    SrQueue<int> L;
+    assert(L.setLanes(2, [](const int &i) -> size_t { return i / 100; }, 2) == 0);
+    for (int i : { 100, 101, 0, 1, 2, 3, 4 })
+    {
+        L.put(i);
+    }
+
+    assert(L.size() == 7);
+    vector<int> v;
+    assert(L.drain(back_inserter(v), 4, 0) == 4);
+    assert(L.get(0).first == 3);
+    deque<int> d;
+    assert(L.takeAll(d) == 2 && L.empty());
+    assert((v == vector<int> { 0, 1, 100, 2 }));
+    assert(d.size() == 2 && d[0] == 101 && d[1] == 4);
+    assert(L.get(10).second == SrQueue<int>::Q_TIMEOUT);
+    L.put(500);
+    assert(L.get(0).first == 500);
     cerr << "OK!" << endl;
 
     return 0;
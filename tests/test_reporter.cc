@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <srreporter.h>
+
+using namespace std;
+
+static SrQueue<string> bodies;
+static int lfd = -1;
+static int delay = 0;
+static atomic<int> active(0), peak(0);
+// message number of a request failed once with 500, -1 for none
+static atomic<int> failAt(-1);
+
+static int64_t now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (int64_t) t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static void *conn(void *arg)
+{
+    const int fd = (intptr_t) arg;
+    string s;
+    char buf[4096];
+
+    for (int n = 0; (n = read(fd, buf, sizeof(buf))) > 0;)
+    {
+        s.append(buf, n);
+
+        for (size_t p = 0; (p = s.find("\r\n\r\n")) != string::npos;)
+        {
+            const size_t c = s.find("Content-Length: ");
+            const size_t len = c < p ? atoi(s.c_str() + c + 16) : 0;
+            if (s.size() < p + 4 + len)
+            {
+                const size_t e = s.find("Expect: 100-continue");
+                if (e < p)
+                {
+                    static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+                    assert(write(fd, cont, sizeof(cont) - 1) > 0);
+                    s.erase(e, 20);
+                }
+
+                break;
+            }
+
+            const int a = ++active;
+            peak = max(peak.load(), a);
+            usleep(delay * 1000);
+            --active;
+
+            const string body = s.substr(p + 4, len);
+            s.erase(0, p + 4 + len);
+
+            int f = failAt;
+            if (f >= 0 && body.find("\n200," + to_string(f) + "\n") != string::npos
+                    && failAt.compare_exchange_strong(f, -1))
+            {
+                static const char resp[] = "HTTP/1.1 500 Error\r\nContent-Length: 0\r\n\r\n";
+                assert(write(fd, resp, sizeof(resp) - 1) > 0);
+                continue;
+            }
+
+            // an operation naming the first message of the request
+            const size_t m = body.find("\n200,");
+            const string op = m == string::npos ? "" :
+                    "510," + to_string(atoi(body.c_str() + m + 5));
+            const string resp = "HTTP/1.1 200 OK\r\nContent-Length: "
+                    + to_string(op.size()) + "\r\n\r\n" + op;
+            assert(write(fd, resp.data(), resp.size()) > 0);
+            bodies.put(body);
+        }
+    }
+
+    close(fd);
+
+    return NULL;
+}
+
+/**
+ *  Minimal HTTP server, puts each request body into bodies and replies with
+ *  an empty 200 response after delay milliseconds, one thread per
+ *  connection.
+ */
+static void *server(void *)
+{
+    while (true)
+    {
+        pthread_t tid;
+        const intptr_t fd = accept(lfd, NULL, NULL);
+        pthread_create(&tid, NULL, conn, (void*) fd);
+        pthread_detach(tid);
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    cerr << "Test SrReporter: ";
+
+    sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(bind(lfd, (sockaddr*) &addr, sizeof(addr)) == 0);
+    assert(listen(lfd, 4) == 0);
+    assert(getsockname(lfd, (sockaddr*) &addr, &alen) == 0);
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, server, NULL);
+
+    const string url = "http://127.0.0.1:" + to_string(ntohs(addr.sin_port));
+    const string xid = "xid";
+    SrQueue<SrNews> out;
+    SrQueue<SrOpBatch> in;
+    SrReporter rpt(url, xid, "", out, in, 2000);
+    rpt.setOpt(SR_REPORTEROPT_LATENCY, 1000);
+    assert(rpt.start() == 0);
+    usleep(100000);
+
+    // urgent message flushes the batch without waiting for the latency
+    int64_t t = now();
+    out.put(SrNews("200,1"));
+    out.put(SrNews("200,2"));
+    usleep(50000);
+    out.put(SrNews("301,3", SR_PRIO_URGENT));
+    auto e = bodies.get(2000);
+    assert(e.second == SrQueue<string>::Q_OK);
+    assert(e.first == "15,xid\n200,1\n200,2\n301,3\n");
+    assert(now() - t < 500);
+
+    SrReporterStats s = rpt.stats();
+    assert(s.batches == 1 && s.messages == 3 && s.lastSize == 3);
+    assert(s.bytes == e.first.size() && s.maxDelay >= 50 && s.maxDelay < 500);
+
+    // message threshold flushes the batch
+    rpt.setOpt(SR_REPORTEROPT_BATCH_NUM, 4);
+    t = now();
+    for (int i = 0; i < 4; ++i)
+    {
+        out.put(SrNews("200," + to_string(i)));
+    }
+
+    e = bodies.get(2000);
+    assert(e.second == SrQueue<string>::Q_OK);
+    assert(e.first == "15,xid\n200,0\n200,1\n200,2\n200,3\n");
+    assert(now() - t < 500);
+
+    // single message waits for the latency
+    t = now();
+    out.put(SrNews("200,9"));
+    e = bodies.get(3000);
+    assert(e.second == SrQueue<string>::Q_OK && e.first == "15,xid\n200,9\n");
+    assert(now() - t >= 1000 && now() - t < 1500);
+
+    s = rpt.stats();
+    assert(s.batches == 3 && s.messages == 8 && s.lastSize == 1);
+    assert(s.maxDelay >= 1000);
+
+    // buffer 6 batches of 256 messages while sleeping, the first 4 are
+    // replayed concurrently after resuming
+    rpt.setOpt(SR_REPORTEROPT_LATENCY, 100);
+    rpt.sleep();
+    for (int i = 0; i < 6 * 256; ++i)
+    {
+        out.put(SrNews("200," + to_string(i), SR_PRIO_BUF));
+    }
+
+    usleep(500000);
+    delay = 200;
+    peak = 0;
+    rpt.resume();
+
+    vector<int> seen(6 * 256, 0);
+    while ((e = bodies.get(5000)).second == SrQueue<string>::Q_OK)
+    {   // replayed batches may arrive in any order
+        assert(e.first.compare(0, 7, "15,xid\n") == 0);
+        for (size_t p = 0, q = 0; (q = e.first.find('\n', p)) != string::npos; p = q + 1)
+        {
+            if (e.first.compare(p, 4, "200,") == 0)
+            {
+                ++seen[atoi(e.first.c_str() + p + 4)];
+            }
+        }
+    }
+
+    assert(peak == 4);
+    assert(count(seen.begin(), seen.end(), 1) == 6 * 256);
+
+    // the second batch of the replay window fails, the acknowledged third
+    // and fourth are neither sent nor forwarded again
+    vector<SrOpBatch> batches;
+    in.drain(back_inserter(batches), 1 << 20, 0);
+
+    rpt.sleep();
+    for (int i = 0; i < 6 * 256; ++i)
+    {
+        out.put(SrNews("200," + to_string(i), SR_PRIO_BUF));
+    }
+
+    usleep(500000);
+    failAt = 256 + 7;
+    rpt.resume();
+
+    seen.assign(6 * 256, 0);
+    while ((e = bodies.get(5000)).second == SrQueue<string>::Q_OK)
+    {
+        for (size_t p = 0, q = 0; (q = e.first.find('\n', p)) != string::npos; p = q + 1)
+        {
+            if (e.first.compare(p, 4, "200,") == 0)
+            {
+                ++seen[atoi(e.first.c_str() + p + 4)];
+            }
+        }
+    }
+
+    assert(failAt == -1);
+    assert(count(seen.begin(), seen.end(), 1) == 6 * 256);
+
+    vector<int> ops(6 * 256, 0);
+    batches.clear();
+    in.drain(back_inserter(batches), 1 << 20, 0);
+    for (const SrOpBatch &b : batches)
+    {
+        assert(b.data.compare(0, 4, "510,") == 0);
+        ++ops[atoi(b.data.c_str() + 4)];
+    }
+    assert(*max_element(ops.begin(), ops.end()) == 1);
+    assert(count(ops.begin(), ops.end(), 1) >= 6);
+
+    cerr << "OK!" << endl;
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <srqueue.h>
+
+using namespace std;
+
+const int P = 4;
+const int N = 20000;
+SrQueue<int> Q(64, SrQueue<int>::Q_BLOCK);
+
+void *producer(void *arg)
+{
+    const int id = *(int*) arg;
+    for (int i = 0; i < N; ++i)
+    {
+        assert(Q.put(id * N + i) == 0);
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    cerr << "Test SrRing: ";
+
+    // multiple blocking producers, single consumer, per-producer FIFO order
+    pthread_t tid[P];
+    int ids[P];
+    for (int i = 0; i < P; ++i)
+    {
+        ids[i] = i;
+        pthread_create(&tid[i], NULL, &producer, &ids[i]);
+    }
+
+    vector<int> last(P, -1);
+    for (int i = 0; i < P * N;)
+    {
+        auto e = Q.get(200);
+        if (e.second == SrQueue<int>::Q_OK)
+        {
+            const int p = e.first / N;
+            assert(e.first % N == last[p] + 1);
+            last[p] = e.first % N;
+            ++i;
+        }
+    }
+
+    for (int i = 0; i < P; ++i)
+    {
+        pthread_join(tid[i], NULL);
+    }
+
+    assert(Q.empty());
+    assert(Q.get(10).second == SrQueue<int>::Q_TIMEOUT);
+
+    // full ring rejects new elements
+    SrQueue<string> R(4);
+    for (int i = 0; i < 4; ++i)
+    {
+        assert(R.put(to_string(i)) == 0);
+    }
+
+    assert(R.put("x") == -1);
+    assert(R.get(0).first == "0");
+
+    // full ring overwrites the oldest elements
+    SrQueue<string> O(4, SrQueue<string>::Q_OVERWRITE);
+    for (int i = 0; i < 10; ++i)
+    {
+        assert(O.put(to_string(i)) == 0);
+    }
+
+    assert(O.size() == 4);
+    for (int i = 6; i < 10; ++i)
+    {
+        assert(O.get(0).first == to_string(i));
+    }
+
+    assert(O.get(0).second == SrQueue<string>::Q_TIMEOUT);
+    cerr << "OK!" << endl;
+
+    return 0;
+}
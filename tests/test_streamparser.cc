@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <srstreamparser.h>
+#include <srnethttp.h>
+
+using namespace std;
+
+class Collector: public SrRecordHandler
+{
+public:
+    Collector() : flushes(0)
+    {
+    }
+
+    void operator()(SrRecord &r, const char *raw, size_t len)
+    {
+        vector<string> v;
+        for (size_t i = 0; i < r.size(); ++i)
+        {
+            v.push_back(to_string(r.type(i)) + ":" + r.value(i));
+        }
+
+        recs.push_back(v);
+        raws += string(raw, len);
+    }
+
+    void flush()
+    {
+        ++flushes;
+    }
+
+    vector<vector<string>> recs;
+    string raws;
+    int flushes;
+};
+
+// records of the whole buffer as parsed by SrParser
+static vector<vector<string>> whole(const string &s)
+{
+    vector<vector<string>> recs;
+    SrParser sr(s);
+    SrRecord r;
+
+    while (sr.end < s.size())
+    {
+        sr.next(r);
+        if (r.size() == 0)
+        {
+            continue;
+        }
+
+        vector<string> v;
+        for (size_t i = 0; i < r.size(); ++i)
+        {
+            v.push_back(to_string(r.type(i)) + ":" + r.value(i));
+        }
+        recs.push_back(v);
+    }
+
+    return recs;
+}
+
+/**
+ *  Serves two connections: answers each request with a complete record and
+ *  an unterminated record, longer than any sane limit for the first one,
+ *  then stalls and closes before the announced length was sent.
+ */
+static void *server(void *arg)
+{
+    for (size_t len = 64; len; len = len == 64 ? 8 : 0)
+    {
+        const int fd = accept((intptr_t) arg, NULL, NULL);
+        char buf[4096];
+        assert(read(fd, buf, sizeof(buf)) > 0);
+
+        const string body = "1,2\n3," + string(len, 'a');
+        const string resp = "HTTP/1.1 200 OK\r\nContent-Length: 4096\r\n\r\n" + body;
+        assert(write(fd, resp.data(), resp.size()) == (ssize_t) resp.size());
+        usleep(500000);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    cerr << "Test SrStreamParser: ";
+
+    const string s = "87,2,xid\n511,\"multi\nline, \"\"quoted\"\"\",-1.5\n"
+            " \n\n88,12\n513,1,\"x\"\"\",\"\"\n86,,,,retry";
+    const vector<vector<string>> expect = whole(s);
+    assert(expect.size() == 7);
+
+    // every split into two chunks, and byte by byte
+    for (size_t i = 0; i <= s.size(); ++i)
+    {
+        Collector c;
+        SrStreamParser sp(c);
+        sp.feed(s.data(), i);
+        sp.feed(s.data() + i, s.size() - i);
+        sp.finish();
+        assert(c.recs == expect);
+        assert(c.raws == s);
+        assert(sp.pending() == 0);
+    }
+
+    Collector c;
+    SrStreamParser sp(c);
+    int n = 0;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        n += sp.feed(s.data() + i, 1);
+
+        // a record is delivered with its newline, not before
+        if (i == 7)
+        {
+            assert(n == 0);
+        } else if (i == 8)
+        {
+            assert(n == 1 && c.recs[0][0] == "3:87");
+        }
+    }
+    assert(n == 6 && c.flushes == 6);
+    assert(sp.finish() == 1 && c.recs == expect);
+
+    // only the incomplete record is buffered, bounded by the limit
+    Collector d;
+    SrStreamParser lp(d, 16);
+    assert(lp.feed("1,2\n3,4", 7) == 1 && lp.pending() == 3);
+    assert(lp.feed(",\"a long quoted", 15) == -1 && lp.pending() == 0);
+    assert(lp.feed("5\n", 2) == 1 && d.recs.back()[0] == "3:5");
+
+    // an oversized record aborts the transfer and resets the stream
+    sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const intptr_t lfd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(bind(lfd, (sockaddr*) &addr, sizeof(addr)) == 0);
+    assert(listen(lfd, 1) == 0);
+    assert(getsockname(lfd, (sockaddr*) &addr, &alen) == 0);
+    pthread_t tid;
+    pthread_create(&tid, NULL, server, (void*) lfd);
+
+    Collector e;
+    SrStreamParser hp(e, 16);
+    SrNetHttp http("http://127.0.0.1:" + to_string(ntohs(addr.sin_port)), "", "");
+    http.setTimeout(5);
+    http.setStream(&hp);
+    assert(http.post("83,1") == -1 && http.errNo == CURLE_WRITE_ERROR);
+    assert(e.recs.size() == 1 && e.recs[0][0] == "3:1");
+    assert(hp.pending() == 0);
+
+    // the undelivered bytes of a failed transfer are kept as response
+    Collector f;
+    SrStreamParser fp(f, 16);
+    http.clear();
+    http.setStream(&fp);
+    assert(http.post("83,1") == -1 && http.errNo == CURLE_PARTIAL_FILE);
+    assert(f.recs.size() == 1 && http.response() == "3,aaaaaaaa");
+    assert(fp.pending() == 0);
+    pthread_join(tid, NULL);
+    close(lfd);
+    cerr << "OK!" << endl;
+
+    return 0;
+}
@@ -33,6 +33,7 @@ const int MS_TO_NS = 1 * 1000000; // ns
 
 const int TIMER_VALUE_IN_MS = 20; // ms
 const int TIMER_VALUE_IN_NS = (TIMER_VALUE_IN_MS * MS_TO_NS); // ns
+const int TOLERANCE_IN_MS = 5; // ms
 }
 
 
@@ -48,15 +49,15 @@ public:
         const timespec &scheduledTime = timer.shedTime();
 
         timespec currentTime;
-        clock_gettime(CLOCK_MONOTONIC_COARSE, &currentTime);
+        clock_gettime(CLOCK_MONOTONIC, &currentTime);
 
-        // check time range with some tolerance (SR_AGENT_VAL) of upper limit
+        // check time range with some scheduling tolerance of upper limit
         const int elapsedTime = (currentTime.tv_sec - scheduledTime.tv_sec) * SECONDS_TO_NS + (currentTime.tv_nsec - scheduledTime.tv_nsec);
 
         // check condition
         assert(
                 (TIMER_VALUE_IN_NS <= elapsedTime) &&
-                 (elapsedTime <= (TIMER_VALUE_IN_NS + (SR_AGENT_VAL * MS_TO_NS))));
+                 (elapsedTime <= (TIMER_VALUE_IN_NS + (TOLERANCE_IN_MS * MS_TO_NS))));
 
         cerr << "OK!" << endl;
 
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2015-2017 Cumulocity GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <cassert>
+#include <srtimerqueue.h>
+
+using namespace std;
+
+static timespec add(const timespec &t, long millisec)
+{
+    timespec r = { t.tv_sec + millisec / 1000, t.tv_nsec + (millisec % 1000) * 1000000 };
+    if (r.tv_nsec >= 1000000000)
+    {
+        ++r.tv_sec;
+        r.tv_nsec -= 1000000000;
+    }
+
+    return r;
+}
+
+static void check(SrTimerQueue &q)
+{
+    const int N = 3000;
+    vector<unique_ptr<SrTimer>> timers;
+    map<SrTimer*, int> fired;
+    timespec prev;
+    clock_gettime(CLOCK_MONOTONIC, &prev);
+
+    for (int i = 0; i < N; ++i)
+    {
+        // mostly level 0 and 1, some on level 2 and 3 of the wheel
+        int val = i * 37 % 5000;
+        if (i % 100 == 1)
+        {
+            val = 70000 + i * 1000;
+        } else if (i == N - 1)
+        {
+            val = 20000000;
+        }
+
+        timers.emplace_back(new SrTimer(val));
+        if (i % 2)
+        {
+            timers.back()->start();
+            q.add(*timers.back());
+        } else
+        {
+            q.add(*timers.back());
+            timers.back()->start();
+        }
+    }
+
+    for (int i = 0; i < N; i += 7)
+    {
+        timers[i]->stop();
+    }
+
+    for (int i = 0; i < N; i += 11)
+    {
+        timers[i]->setInterval(timers[i]->interval() / 2);
+    }
+
+    timespec base;
+    clock_gettime(CLOCK_MONOTONIC, &base);
+    vector<SrTimer*> vec;
+
+    for (long ms = 0; ms <= 21000000; ms += ms < 6000 ? 3 : 997)
+    {
+        const timespec now = add(base, ms);
+
+        if (ms % 300 == 0)
+        {
+            // the awaited deadline is never later than any fire time,
+            // rounded up to the 1 ms tick of the wheel
+            timespec deadline;
+            const bool timed = q.wait(deadline);
+            q.awake();
+            for (auto &e : timers)
+            {
+                if (e->isActive() && fired[e.get()] == 0)
+                {
+                    assert(timed && deadline <= add(e->fireTime(), 1));
+                }
+            }
+        }
+
+        vec.clear();
+        q.expired(now, vec);
+        for (auto &e : vec)
+        {
+            // never early, at most one step plus 1 ms late
+            assert(e->fireTime() <= now);
+            assert(!(add(e->fireTime(), 1) <= prev));
+            assert(++fired[e] == 1);
+        }
+
+        prev = now;
+    }
+
+    for (int i = 0; i < N; ++i)
+    {
+        assert(fired[timers[i].get()] == (i % 7 ? 1 : 0));
+    }
+
+    timespec deadline;
+    assert(!q.wait(deadline));
+    q.awake();
+
+    // restarted timers are scheduled again, moved to another queue as well
+    for (auto &e : timers)
+    {
+        e->stop();
+    }
+
+    timers[1]->start();
+    SrTimerHeap h;
+    q.moveTo(h);
+    vec.clear();
+    h.expired(add(timers[1]->fireTime(), 1), vec);
+    assert(vec.size() == 1 && vec[0] == timers[1].get());
+}
+
+int main()
+{
+    cerr << "Test SrTimerQueue: ";
+
+    SrTimerHeap heap;
+    check(heap);
+    SrTimerWheel wheel;
+    check(wheel);
+    cerr << "OK!" << endl;
+
+    return 0;
+}